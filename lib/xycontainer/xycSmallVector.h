@@ -0,0 +1,489 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*! \author Udo Frese */
+/*! \file xycSmallVector.h
+
+    This file contains the template class \c XycSmallVector.
+*/
+
+#ifndef XYCSMALLVECTOR
+#define XYCSMALLVECTOR
+
+#include "xycVector.h"
+
+//! A vector like \c XycVector that stores up to \c N entries inside the object
+/*! As long as there are at most \c N entries, they are stored in an
+    array that is part of the vector itself, so creating, filling and
+    destroying the vector does not touch the heap. Only when the
+    vector grows beyond \c N entries, memory is allocated and
+    everything moved, just as with \c XycVector. The heap memory is
+    managed by \c XycAllocator<T> as well.
+
+    The interface is the same as the one of \c XycVector, but
+    iterators and pointers into the inline storage become invalid
+    when the vector is copied, swapped or moved in memory.
+
+    Function not supported by the STL vector are marked as NONSTD.
+ */
+template<class T, int N> class XycSmallVector {
+protected:
+   //! The 0th entry starts here, either \c _inline or on the heap
+   T* _begin;
+
+   //! One beyond the last entry
+   T* _end;
+
+   //! One beyond the end of the allocated memory
+   T* _storageEnd;
+
+   //! Storage for the first \c N entries while there are not more
+   T _inline[N];
+
+   //! Frees \c p unless it is the inline storage
+   void release (T* p) {if (p!=_inline && p!=NULL) XycAllocator<T>::deallocate (p);}
+
+   //! Makes the vector empty using the inline storage
+   /*! Does not free memory. */
+   void setInline ()
+   {
+     _begin = _end = _inline;
+     _storageEnd = _inline+N;
+   }
+
+   //! Takes over the entries of \c v2 leaving \c v2 empty
+   /*! \c *this must be empty and inline before. */
+   void takeOver (XycSmallVector<T,N>& v2)
+   {
+     assert (_begin==_inline && _end==_inline);
+     if (v2.isInline()) {
+       for (T *p=v2._begin, *p2=_inline; p!=v2._end; p++, p2++) xycMoveEntry (*p2, *p);
+       _end = _inline + v2.size();
+     }
+     else {
+       _begin = v2._begin;
+       _end   = v2._end;
+       _storageEnd = v2._storageEnd;
+     }
+     v2.setInline ();
+   }
+
+ public:
+   //! Entries in the container
+   typedef T value_type;
+   //! Pointer to entries
+   typedef T* pointer;
+   //! Reference to entries
+   typedef T& reference;
+   //! Const reference to entries
+   typedef const T& const_reference;
+   //! For compatibility with STL
+   typedef unsigned int size_type;
+   //! For compatibility with STL
+   typedef int difference_type;
+   //! Plain pointer used as an iterator
+   typedef T* iterator;
+   //! Plain pointer used as an const iterator
+   typedef const T* const_iterator;
+
+   //! Empty container using the inline storage
+   XycSmallVector() :_begin(_inline), _end(_inline), _storageEnd(_inline+N) {}
+
+   //! Container with n entries, initialized as t
+   XycSmallVector (int n, const T& t=T())
+     :_begin(_inline), _end(_inline), _storageEnd(_inline+N)
+   {
+      resize (n, t);
+   }
+
+   //! Copy constructor (deep copy)
+   XycSmallVector (const XycSmallVector<T,N>& v2)
+     :_begin(_inline), _end(_inline), _storageEnd(_inline+N)
+   {
+      resizeWithUndefinedData (v2.size());
+      for (T *p=v2._begin, *p2=_begin; p!=v2._end; p++, p2++) *p2 = *p;
+   }
+
+   //! Copy a vector from a range of iterators including \c from, not including \c to
+   XycSmallVector (const T* from, const T* to)
+     :_begin(_inline), _end(_inline), _storageEnd(_inline+N)
+   {
+      resizeWithUndefinedData (to-from);
+      for (T *p2=_begin; from!=to; from++, p2++) *p2 = *from;
+   }
+
+   //! Assignment operator (deep copy)
+   XycSmallVector<T,N>& operator = (const XycSmallVector<T,N>& v2)
+   {
+      if (&v2==this) return *this;
+      resizeWithUndefinedData (v2.size());
+      for (T *p=v2._begin, *p2=_begin; p!=v2._end; p++, p2++) *p2 = *p;
+      return *this;
+   }
+
+#if __cplusplus>=201103L
+   //! Move constructor, takes over the heap memory or copies the inline entries
+   XycSmallVector (XycSmallVector<T,N>&& v2)
+     :_begin(_inline), _end(_inline), _storageEnd(_inline+N)
+   {
+      takeOver (v2);
+   }
+
+   //! Move assignment, takes over the heap memory or copies the inline entries
+   XycSmallVector<T,N>& operator = (XycSmallVector<T,N>&& v2)
+   {
+      if (&v2==this) return *this;
+      release (_begin);
+      setInline ();
+      takeOver (v2);
+      return *this;
+   }
+#endif
+
+   //! Destructor, frees the heap memory if any
+   ~XycSmallVector() {release (_begin);}
+
+   //! NONSTD: Whether the entries are stored inside the object and not on the heap
+   bool isInline () const {return _begin==_inline;}
+
+   //! Whether there is no entry in the vector
+   bool empty() const {return _begin==_end;}
+
+   //! Number of entries
+   int size() const {return _end-_begin;}
+
+   //! Capacity reserved (at least \c N)
+   /*! The vector can grow up to size()==capacity()
+       without the need for allocating new memory and
+       copying data. */
+   int capacity() const {return _storageEnd-_begin;}
+
+   //! NONSTD: return, whether \c idx is a valid index for (*this)[]
+   bool idx (int idx) const {return 0<=idx && idx<(int) (_end-_begin);}
+
+   //! (*this)[i] returns the i-th entry of the vector
+   /*! Validity of the index is asserted. */
+   T& operator[] (int idx) {
+      assert (0<=idx && idx<size());
+      return _begin[idx];
+   }
+
+   //! (*this)[i] returns the i-th entry of the vector
+   /*! Validity of the index is asserted. */
+   const T& operator[] (int idx) const {
+      assert (0<=idx && idx<size());
+      return _begin[idx];
+   }
+
+   //! Iterator/pointer to first entry
+   T* begin() {return _begin;}
+
+   //! Iterator/pointer to first entry
+   const T* begin() const {return _begin;}
+
+   //! Iterator/pointer to one beyond the last entry
+   T* end() {return _end;}
+
+   //! Iterator/pointer to one beyond the last entry
+   const T* end() const {return _end;}
+
+   //! The last entry
+   T& back() {return *(_end-1);}
+
+   //! The last entry
+   const T& back() const {return *(_end-1);}
+
+   //! The first entry
+   T& front() {return *_begin;}
+
+   //! The first entry
+   const T& front() const {return *_begin;}
+
+   //! NONSTD: Erases all entry after \c end (including)
+   void eraseAfter (T* end)
+   {
+     _end = end;
+   }
+
+   //! NONSTD: Resizes but does not initinialize
+   void resizeWithUndefinedData (int n)
+   {
+     if (_storageEnd<_begin+n) {
+       release (_begin);
+       _begin = XycAllocator<T>::allocate (n);
+       _end   = _storageEnd = _begin + n;
+     }
+     else _end = _begin+n;
+   }
+
+   //! NONSTD: Resizes and allocates new memory except the current memory exactly fits
+   /*! Up to \c N entries always fit into the inline storage, so
+       the heap memory is freed in that case. */
+   void resizeCompactlyWithUndefindedData (int n)
+   {
+     if (n<=N) {
+       release (_begin);
+       setInline ();
+       _end = _inline+n;
+     }
+     else if (_storageEnd!=_begin+n) {
+       release (_begin);
+       _begin = XycAllocator<T>::allocate (n);
+       _end   = _storageEnd = _begin + n;
+     }
+     else _end = _begin+n;
+   }
+
+   //! Shrink or expand to size \c n initializing new entries with \c t
+   /*! \c resize never frees unused memory. */
+   void resize (int n, const T& t = T())
+   {
+      reserve (n);
+      T* nEnd = _begin + n;
+      for (T* p=_end; p<nEnd; p++) *p = t;
+      _end = nEnd;
+   }
+
+   //! Allocate memory for at least \c n entries
+   /*! If \c n is smaller than the current \c capacity()
+       nothing is done. Otherwise at least the capacity is doubled.
+   */
+   void reserve (int n)
+   {
+     if (_storageEnd<_begin+n) { // extend and reallocate
+       if (n<2*(_storageEnd-_begin)) n = 2*(_storageEnd-_begin);
+       int used = _end-_begin;
+       if (isInline()) {
+         _begin = XycAllocator<T>::allocate (n);
+         for (int i=0; i<used; i++) xycMoveEntry (_begin[i], _inline[i]);
+       }
+       else _begin = XycAllocator<T>::reallocate (_begin, used, n);
+       _end = _begin + used;
+       _storageEnd = _begin+n;
+     }
+   }
+
+   //! Make the vector empty
+   /*! Does not free any memory */
+   void clear () {_end = _begin;}
+
+   //! NONSTD: Copy the vector content to new memory of exactly the right size
+   /*! If there are at most \c N entries, they are moved to the inline
+       storage. */
+   void compact ()
+     {
+       if (isInline() || _storageEnd==_end) return;
+       int n = _end-_begin;
+       if (n<=N) {
+         for (int i=0; i<n; i++) xycMoveEntry (_inline[i], _begin[i]);
+         release (_begin);
+         _begin = _inline;
+         _storageEnd = _inline+N;
+       }
+       else {
+         _begin = XycAllocator<T>::reallocate (_begin, n, n);
+         _storageEnd = _begin+n;
+       }
+       _end = _begin + n;
+     }
+
+   //! Heap memory used by the vector
+   /*! The inline storage is part of \c sizeof(XycSmallVector) and
+       hence not included. */
+   int memory () const
+   {
+     if (isInline()) return 0;
+     else return capacity()*sizeof(T);
+   }
+
+   //! NONSTD: Whether \c t is an entry of the vector
+   bool contains (const T& t) const {return _begin<=&t && &t<_end;}
+
+   //! Append \c t to the end of the vector
+   /*! If adding an entry exceeds the vectors capacity, new memory
+       is allocated and everything moved.
+   */
+   void push_back (const T& t)
+   {
+     if (_storageEnd>_end) {
+       *_end = t;
+       _end++;
+     }
+     else if (contains (t)) {
+       int i = &t-_begin;
+       reserve (_storageEnd-_begin+1);
+       *_end = _begin[i];
+       _end++;
+     }
+     else {
+       reserve (_storageEnd-_begin+1);
+       *_end = t;
+       _end++;
+     }
+   }
+
+   //! Remove the last entry
+   void pop_back () {
+      assert (_end!=_begin);
+      _end--;
+   }
+
+   //! Erase all entries between \c from and \c to (not including)
+   void erase (T* from, T* to)
+   {
+      assert (_begin<=from && from<=to && to<=_end);
+      for (T *p=to, *p2=from; p!=_end; p++,p2++) *p2 = *p;
+      _end -= (to-from);
+   }
+
+   //! Swap \c *this and \c v2
+   /*! The entries are only copied if one of the vectors uses the
+       inline storage. */
+   void swap (XycSmallVector<T,N>& v2)
+   {
+     if (!isInline() && !v2.isInline()) {
+       T* buf = _begin; _begin = v2._begin; v2._begin = buf;
+       buf = _end; _end = v2._end, v2._end = buf;
+       buf = _storageEnd; _storageEnd = v2._storageEnd; v2._storageEnd = buf;
+     }
+     else {
+       XycSmallVector<T,N> tmp;
+       tmp.takeOver (*this);
+       takeOver (v2);
+       v2.takeOver (tmp);
+     }
+   }
+
+   //! NONSTD: Swap \c *this and \c v2
+   /*! The heap memory of \c v2 is taken over. If \c *this uses the
+       inline storage, \c v2 receives a copy on the heap. This is
+       used to exchange memory with caches of \c XycVector buffers. */
+   void swap (XycVector<T>& v2)
+   {
+     T *b = v2._begin, *e = v2._end, *s = v2._storageEnd;
+     if (isInline()) {
+       int n = size();
+       if (n>0) {
+         v2._begin = XycAllocator<T>::allocate (n);
+         for (T *p=_begin, *p2=v2._begin; p!=_end; p++, p2++) *p2 = *p;
+         v2._end = v2._storageEnd = v2._begin+n;
+       }
+       else v2._begin = v2._end = v2._storageEnd = NULL;
+     }
+     else {
+       v2._begin = _begin;
+       v2._end = _end;
+       v2._storageEnd = _storageEnd;
+     }
+     if (b!=NULL) {
+       _begin = b;
+       _end = e;
+       _storageEnd = s;
+     }
+     else setInline ();
+   }
+
+   //! Insert an entry t before \c pos
+   /*! Returns a new iterator to the entry
+       that was \c pos before.
+
+       If \c capacity() is too low, new memory is
+       allocated and the whole vector copied.
+   */
+   T* insert (T* pos, const T& t)
+   {
+      return insert (pos, 1, t);
+   }
+
+   //! insert entries \c *from to  *to (exclusive) before \c *pos
+   /*! Returns a new iterator to the entry
+       that was \c pos before.
+
+       If \c capacity() is too low, new memory is
+       allocated and the whole vector copied.
+   */
+   T* insert (T* pos, const T* from, const T* to)
+   {
+      assert (_begin<=pos && pos<=_end && from<=to);
+      assert (to<=_begin || _end<=from);
+      int n = to-from;
+      int i = pos-_begin;
+      reserve (size()+n);
+      pos = _begin + i;
+      for (T *p = _end, *p2=_end+n; p!=pos;) *--p2 = *--p;
+      for (T *p2 = pos; from!=to; from++, p2++) *p2 = *from;
+      _end += n;
+      return pos;
+   }
+
+   //! Insert \c n copies of \c t before \c pos
+   /*! Returns a new iterator to the entry
+       that was \c pos before.
+
+       If \c capacity() is too low, new memory is
+       allocated and the whole vector copied.
+   */
+   T* insert (T* pos, int n, const T& t)
+   {
+      assert (_begin<=pos && pos<=_end);
+      T tCopy = t; // \c t may be an entry that is moved
+      int i = pos-_begin;
+      reserve (size()+n);
+      pos = _begin + i;
+      for (T *p = _end, *p2=_end+n; p!=pos;) *--p2 = *--p;
+      for (T *p2 = pos; p2!=pos+n; p2++) *p2 = tCopy;
+      _end += n;
+      return pos;
+   }
+};
+
+
+//! Returns, whether two vectors are equal
+/*! Equal means: Same size and the i-th element is == in both
+ */
+template<class T, int N> bool operator== (const XycSmallVector<T,N>& v1, const XycSmallVector<T,N>& v2)
+{
+   if (v1.size()!=v2.size()) return false;
+   for (const T *p1=v1.begin(), *p2=v2.begin(); p1!=v1.end(); p1++, p2++)
+      if (!(*p1==*p2)) return false;
+   return true;
+}
+
+
+//! Returns, whether two vectors are not equal
+template<class T, int N> bool operator!= (const XycSmallVector<T,N>& v1, const XycSmallVector<T,N>& v2)
+{
+  return !(v1==v2);
+}
+
+#endif
@@ -41,6 +41,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define XYCVECTOR
 
 #include <stdlib.h>
+#include <new>
+#if __cplusplus>=201103L
+#include <utility>
+#endif
 
 #ifndef assert
 #include <assert.h>
@@ -49,6 +53,99 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //! Forward declaration
 template<class T> class XycVector;
 
+//! Moves \c src to \c dst when a container reallocates its memory
+/*! \c src is destroyed afterwards. The default copies, or moves
+    with C++11. Overload this for types where moving is cheaper than
+    copying. */
+template<class T> inline void xycMoveEntry (T& dst, T& src)
+{
+#if __cplusplus>=201103L
+  dst = std::move (src);
+#else
+  dst = src;
+#endif
+}
+
+//! Vectors are moved by exchanging their memory
+template<class T> inline void xycMoveEntry (XycVector<T>& dst, XycVector<T>& src);
+
+//! Memory management for the entries of \c XycVector<T>
+/*! All memory of the containers is obtained and returned through
+    this class. It is the hook to provide other memory to the
+    containers: Specialize \c XycAllocator<T> with the same static
+    member functions for a type \c T and all \c XycVector<T> use it.
+
+    The default uses \c new[] and \c delete[] and on growth moves
+    the entries one by one with \c xycMoveEntry.
+ */
+template<class T> class XycAllocator
+{
+ public:
+   //! Memory for \c n entries
+   static T* allocate (int n) {return new T[n];}
+
+   //! Frees \c p obtained from \c allocate or \c reallocate
+   static void deallocate (T* p) {delete[] p;}
+
+   //! Memory for \c n entries with the first \c used entries moved from \c p
+   /*! \c p is freed and may be \c NULL if \c used==0. */
+   static T* reallocate (T* p, int used, int n)
+   {
+     T* q = new T[n];
+     for (int i=0; i<used; i++) xycMoveEntry (q[i], p[i]);
+     if (p!=NULL) delete[] p;
+     return q;
+   }
+};
+
+//! Memory management by \c malloc and \c realloc
+/*! This is much faster than \c XycAllocator when a vector grows,
+    since \c realloc can often extend the memory in place and
+    otherwise copies it in one piece. It may only be used for types
+    that can be copied bytewise and have a trivial destructor.
+    Entries are not initialized, i.e. their constructor is not called.
+ */
+template<class T> class XycReallocAllocator
+{
+ public:
+   //! Memory for \c n entries
+   static T* allocate (int n)
+   {
+     T* p = (T*) malloc (n*sizeof(T));
+     if (p==NULL && n>0) throw std::bad_alloc();
+     return p;
+   }
+
+   //! Frees \c p obtained from \c allocate or \c reallocate
+   static void deallocate (T* p) {free (p);}
+
+   //! Memory for \c n entries with the first \c used entries moved from \c p
+   static T* reallocate (T* p, int used, int n)
+   {
+     T* q = (T*) realloc (p, n*sizeof(T));
+     if (q==NULL && n>0) throw std::bad_alloc();
+     return q;
+   }
+};
+
+//! Declares that \c XycVector<T> manages its memory with \c realloc
+/*! See \c XycReallocAllocator for the types this is allowed for. */
+#define XYC_USE_REALLOC(T) template<> class XycAllocator<T > :public XycReallocAllocator<T > {};
+
+XYC_USE_REALLOC(char)
+XYC_USE_REALLOC(unsigned char)
+XYC_USE_REALLOC(short)
+XYC_USE_REALLOC(unsigned short)
+XYC_USE_REALLOC(int)
+XYC_USE_REALLOC(unsigned int)
+XYC_USE_REALLOC(long)
+XYC_USE_REALLOC(unsigned long)
+XYC_USE_REALLOC(float)
+XYC_USE_REALLOC(double)
+
+//! Pointers are copied bytewise as well
+template<class T> class XycAllocator<T*> :public XycReallocAllocator<T*> {};
+
 //! Performs a lexicographical comparison between v1 and v2
 /*! The result indicates, wheter \c v1<v2 (-1), \c v1==v2 (0) or
     \c v1>v2 (+1). Comparison is performed lexicographically.
@@ -83,6 +180,8 @@ template<class T> int swap (XycVector<T>& v1, XycVector<T>& v2);
     \li range checking
     \li new functions \c compact and \c resizeCompactlyWithUndefindedData
         for smaller memory usage when desired
+    \li memory is managed by \c XycAllocator<T>, which uses \c realloc
+        for elementary types and pointers
 
     Function not supported by the STL vector are marked as NONSTD.
  */
@@ -124,14 +223,15 @@ protected:
    //! Container with n initialized T() entries
    XycVector (int n)
    {
-      _begin = new T[n];
+      _begin = XycAllocator<T>::allocate (n);
       _end = _storageEnd = _begin+n;
+      for (T* p=_begin; p!=_end; p++) *p = T();
    }
 
    //! Container with n entries, initialized as t
    XycVector (int n, const T& t=T())
    {
-      _begin = new T[n];
+      _begin = XycAllocator<T>::allocate (n);
       _end = _storageEnd = _begin+n;
       for (T* p=_begin; p!=_end; p++) *p = t;
    }
@@ -141,7 +241,7 @@ protected:
    {
       int n = v2.size();
       if (n>0) {
-         _begin = new T[n];
+         _begin = XycAllocator<T>::allocate (n);
          _storageEnd = _end  = _begin+n;
          for (T *p=v2._begin, *p2=_begin; p!=v2._end; p++, p2++) *p2 = *p;
       }
@@ -151,14 +251,31 @@ protected:
    //! Copy a vector from a range of iterators including \c from, not including \c to
    XycVector (const T* from, const T* to)
    {
-      if (_begin!=_end) {
-         _begin = new T[to-from];
-         for (T *p=from, *p2=_begin; p!=to; p++, p2++) *p2 = *p;
+      if (from!=to) {
+         _begin = XycAllocator<T>::allocate (to-from);
+         T* p2 = _begin;
+         for (const T* p=from; p!=to; p++, p2++) *p2 = *p;
          _end   = _storageEnd = _begin + (to-from);
       }
       else _begin = _end = _storageEnd = NULL;
    }
 
+#if __cplusplus>=201103L
+   //! Move constructor, takes over the memory of \c v2
+   XycVector (XycVector<T>&& v2)
+     :_begin(v2._begin), _end(v2._end), _storageEnd(v2._storageEnd)
+   {
+      v2._begin = v2._end = v2._storageEnd = NULL;
+   }
+
+   //! Move assignment, exchanges the memory with \c v2
+   XycVector<T>& operator = (XycVector<T>&& v2)
+   {
+      swap (v2);
+      return *this;
+   }
+#endif
+
    //! Assignment operator (deep copy)
    XycVector<T>& operator = (const XycVector<T>& v2)
    {
@@ -168,7 +285,7 @@ protected:
    }
 
    //! Destructor, frees all elements
-   ~XycVector() {if (_begin!=NULL) delete[] _begin;}
+   ~XycVector() {if (_begin!=NULL) XycAllocator<T>::deallocate (_begin);}
 
    //! Whether there is no entry in the vector
    bool empty() const {return _begin==_end;}
@@ -236,8 +353,8 @@ protected:
    {
      T* newEnd = _begin+n;     
      if (_storageEnd<newEnd) {
-       if (_begin!=NULL) delete[] _begin;
-       _begin = new T[n];
+       if (_begin!=NULL) XycAllocator<T>::deallocate (_begin);
+       _begin = XycAllocator<T>::allocate (n);
        _end   = _storageEnd = _begin + n;       
      }     
      else _end = newEnd;
@@ -249,8 +366,8 @@ protected:
    {
      T* newEnd = _begin+n;     
      if (_storageEnd!=newEnd) {
-       if (_begin!=NULL) delete[] _begin;
-       _begin = new T[n];
+       if (_begin!=NULL) XycAllocator<T>::deallocate (_begin);
+       _begin = XycAllocator<T>::allocate (n);
        _end   = _storageEnd = _begin + n;       
      }     
      else _end = newEnd;     
@@ -269,31 +386,20 @@ protected:
       _end = nEnd;
    }
 
-   //! Like reserve but does not deallocate the old ptr and returns it instead
-   T* internal_reserve (int n)
-     {
-       if (_storageEnd<_begin+n) { // extend and reallocate
-         if (n<8) n = 8;        
-         if (n<2*(_storageEnd-_begin)) n = 2*(_storageEnd-_begin);        
-         T* newBegin = new T[n];
-         for (T* p=_begin, *p2=newBegin; p!=_end; p++, p2++) *p2 = *p;
-         T* oldBegin = _begin;         
-         _end = newBegin + (_end-_begin);
-         _begin = newBegin;
-         _storageEnd = _begin+n;
-         return oldBegin;         
-       }
-       else return NULL;       
-     }
-   
    //! Allocate memory for at least \c n entries
    /*! If \c n is smaller than the current \c capacity()
-       nothing is done.
+       nothing is done. Otherwise at least the capacity is doubled.
    */
    void reserve (int n)
    {
-     T* old = internal_reserve (n);
-     if (old!=NULL) delete[] old;     
+     if (_storageEnd<_begin+n) { // extend and reallocate
+       if (n<8) n = 8;        
+       if (n<2*(_storageEnd-_begin)) n = 2*(_storageEnd-_begin);        
+       int used = _end-_begin;
+       _begin = XycAllocator<T>::reallocate (_begin, used, n);
+       _end = _begin + used;
+       _storageEnd = _begin+n;
+     }
    }
 
    //! Make the vector empty
@@ -306,12 +412,11 @@ protected:
        if (_storageEnd>_end) {
          int n = _end-_begin; 
          T* newBegin;
-         if (n>0) {         
-           newBegin = new T[n];
-           for (T* p=_begin, *p2=newBegin; p!=_end; p++, p2++) *p2 = *p;
+         if (n>0) newBegin = XycAllocator<T>::reallocate (_begin, n, n);
+         else {
+           XycAllocator<T>::deallocate (_begin);
+           newBegin = NULL;
          }
-         else newBegin = NULL;
-         if (_begin!=NULL) delete[] _begin;
          _end = newBegin + n;
          _begin = newBegin;
          _storageEnd = _begin+n;
@@ -325,9 +430,13 @@ protected:
    }   
 
 
+   //! NONSTD: Whether \c t is an entry of the vector
+   /*! Needed when the memory is reallocated while \c t is in use. */
+   bool contains (const T& t) const {return _begin<=&t && &t<_end;}   
+
    //! Append \c t to the end of the vector
    /*! If adding an entry exceeds the vectors capacity, new memory
-       is allocated and everything copied.
+       is allocated and everything moved.
    */
    void push_back (const T& t)
    {
@@ -335,11 +444,16 @@ protected:
        *_end = t;
        _end++;
      }
+     else if (contains (t)) {
+       int i = &t-_begin;       
+       reserve (_storageEnd-_begin+1);
+       *_end = _begin[i];
+       _end++;
+     }     
      else {
-       T* old = internal_reserve (_storageEnd-_begin+1);
+       reserve (_storageEnd-_begin+1);
        *_end = t;
        _end++;
-       if (old!=NULL) delete[] old;
      }     
    }
 
@@ -385,20 +499,7 @@ protected:
    */
    T* insert (T* pos, const T& t)
    {
-      assert (_begin<=pos && pos<=_end);
-      if (_storageEnd>_end) {        
-        for (T *p = _end, *p2=_end+1; p2!=pos; p--, p2--) *p2 = *p;
-        *pos = t;
-      }
-      else {
-        T* old = internal_reserve (size()+1);
-        pos = _begin + pos - old;        
-        for (T *p = _end, *p2=_end+1; p2!=pos; p--, p2--) *p2 = *p;
-        *pos = t;
-        if (old!=NULL) delete[] old;        
-      }
-      
-      return pos;        
+      return insert (pos, 1, t);
    }
 
    //! insert entries \c *from to  *to (exclusive) before \c *pos
@@ -408,12 +509,17 @@ protected:
        If \c capacity() is too low, new memory is
        allocated and the whole vector copied.
    */
-   void insert (T* pos, const T* from, const T* to)
+   T* insert (T* pos, const T* from, const T* to)
    {
       assert (_begin<=pos && pos<=_end && from<=to);
-      reserve (size()+(to-from));
-      for (T *p = _end, *p2=_end+(to-from); p2!=pos; p--, p2--) *p2 = *p;
-      for (T *p = from, *p2 = pos; p!=to; p++, p2++) *p2 = *p;
+      assert (to<=_begin || _end<=from);
+      int n = to-from, i = pos-_begin;
+      reserve (size()+n);
+      pos = _begin+i;
+      for (T *p = _end, *p2=_end+n; p!=pos;) *--p2 = *--p;
+      for (T *p2 = pos; from!=to; from++, p2++) *p2 = *from;
+      _end += n;
+      return pos;
    }
 
 
@@ -427,19 +533,13 @@ protected:
    T* insert (T* pos, int n, const T& t)
    {
       assert (_begin<=pos && pos<=_end);
-      if (_storageEnd>=_end+n) {
-        T *p, *p2, *to=_end+n;      
-        for (p = _end, p2=to; p2!=pos; p--, p2--) *p2 = *p;
-        for (p2 = pos; p2!=to; p2++) *p2 = t;
-      }
-      else {
-        T* old = internal_reserve (size()+n);
-        pos = _begin + pos - old;                
-        T *p, *p2, *to=_end+n;      
-        for (p = _end, p2=to; p2!=pos; p--, p2--) *p2 = *p;
-        for (p2 = pos; p2!=to; p2++) *p2 = t;
-        if (old!=NULL) delete[] old;        
-      }      
+      T tCopy = t; // \c t may be an entry that is moved
+      int i = pos-_begin;      
+      reserve (size()+n);
+      pos = _begin+i;
+      for (T *p = _end, *p2=_end+n; p!=pos;) *--p2 = *--p;
+      for (T *p2 = pos; p2!=pos+n; p2++) *p2 = tCopy;
+      _end += n;
       return pos;      
    }
 
@@ -449,6 +549,8 @@ protected:
    template<class TT> friend int compare (const XycVector<TT>& v1, const XycVector<TT>& v2);   
    //! the swap function can directly access internas
    template<class TT> friend void swap (XycVector<TT>& v1, XycVector<TT>& v2);   
+   //! XycSmallVector exchanges its heap memory with an XycVector
+   template<class TT, int NN> friend class XycSmallVector;
 };
 
 
@@ -505,6 +607,12 @@ template<class T> bool operator>= (const XycVector<T>& v1, const XycVector<T>& v
   return compare (v1, v2)>=0;
 }
 
+template<class T> inline void xycMoveEntry (XycVector<T>& dst, XycVector<T>& src)
+{
+  dst.swap (src);
+}
+
+
 template<class T> void swap (XycVector<T>& v1, XycVector<T>& v2)
 {
    T* buf = v1._begin; v1._begin = v2._begin; v2._begin = buf;   
@@ -138,6 +138,12 @@ public:
     */
     void reserve (int n, int m, bool autoGrow=false);
 
+    //! Number of rows memory is reserved for (see \c reserve())
+    int rowsReserved () const {return _rowReserved;}
+
+    //! Number of columns memory is reserved for (see \c reserve())
+    int colsReserved () const {return _colReserved;}
+
     //! Set the autoGrow flag
     /*! If \c autoGrow==true an automatic reallocation of the memory
         is performed if a call to \c append() or \c insert(...) exceed
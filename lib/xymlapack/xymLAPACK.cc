@@ -37,12 +37,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //#include "xymBLAS.h"
 
 #include "clapack.h"
+#include "xymQR.h"
 
 #include <xymatrix/xymOperations.h>
 
 void xymSYGV (const XymMatrixC& A, const XymMatrixC& B, XymMatrixC& Z, XymVector& w)
     throw (XymLAPACKException)
 {
+#ifdef XYM_NO_LAPACK
+    throw XymLAPACKException ("xymSYGV needs LAPACK (compiled with XYM_NO_LAPACK)");
+#else
     checkSquare (A);
     checkSameFormat (A, B);
     
@@ -69,6 +73,47 @@ void xymSYGV (const XymMatrixC& A, const XymMatrixC& B, XymMatrixC& Z, XymVector
 
     if (info<0) throw XymLAPACKException ("Illegal parameter calling dsygv (FORTRAN)");
     if (info>0) throw XymLAPACKException ("B is not SPD");
+#endif
+}
+
+
+#ifndef XYM_NO_LAPACK
+//! Calls \c dgeqrf above \c XYM_QR_BLOCKED_MIN_COLS columns and \c dgeqr2 below
+/*! \c work holds \c min(m,n) entries for \c tau followed by \c
+    XYM_QR_BLOCK*n for LAPACK. Returns \c info. */
+static int lapackGEQR (int m, int n, double* a, int lda, double* work)
+{
+  int rDim = (m<n)?m:n;
+  int info = 0;
+  if (n>=XYM_QR_BLOCKED_MIN_COLS) {
+    int lWork = XYM_QR_BLOCK*n;
+    dgeqrf_ (&m, &n, a, &lda, work, work+rDim, &lWork, &info);
+  }
+  else dgeqr2_ (&m, &n, a, &lda, work, work+rDim, &info);
+  return info;
+}
+#endif
+
+
+int xymGEQR2WorkspaceSize (int m, int n)
+{
+#ifdef XYM_NO_LAPACK
+  return xymNativeGEQRFWorkspaceSize (m, n);
+#else
+  // The packed copy of xymGEQR2Packed, tau and LAPACK's workspace
+  int rDim = (m<n)?m:n;
+  return m*n+rDim+XYM_QR_BLOCK*n;
+#endif
+}
+
+
+bool xymIsNativeQR ()
+{
+#ifdef XYM_NO_LAPACK
+  return true;
+#else
+  return false;
+#endif
 }
 
 
@@ -79,11 +124,16 @@ void xymGEQR2 (const XymMatrixC& A, XymMatrixC& R, XymVector& work)
   int rDim;
   if (m<n) rDim = m;
   else rDim = n;
-  work.resize (rDim+n, false);  
-  int info;
+  int info = 0;
 
   if (&A!=&R) R = A;  
-  if (R.rows()>0 && R.cols()>0) dgeqr2_ (&m, &n, R.base(), (int*) R.ld(), work.base(), work.base()+rDim, &info);
+#ifdef XYM_NO_LAPACK
+  work.resize (xymNativeGEQRFWorkspaceSize (m, n), false);
+  if (R.rows()>0 && R.cols()>0) xymNativeGEQRF (m, n, R.base(), R.colOfs(), work.base());
+#else
+  work.resize (rDim+XYM_QR_BLOCK*n, false);  
+  if (R.rows()>0 && R.cols()>0) info = lapackGEQR (m, n, R.base(), R.colOfs(), work.base());
+#endif
   if (rDim<R.rows()) R.deleteLastRow (R.rows()-rDim);
   zeroLower (R);
 
@@ -97,3 +147,33 @@ void xymGEQR2 (const XymMatrixC& A, XymMatrixC& R)
   xymGEQR2 (A, R, work);
 }
 
+
+void xymGEQR2Packed (XymMatrixC& R, XymVector& work)
+{
+#ifdef XYM_NO_LAPACK
+  // The native QR does not depend on the leading dimension
+  xymGEQR2 (R, R, work);
+#else
+  int m = R.rows();
+  int n = R.cols();  
+  if (R.colOfs()==m) {
+    xymGEQR2 (R, R, work);
+    return;
+  }  
+  int rDim;
+  if (m<n) rDim = m;
+  else rDim = n;
+  work.resize (xymGEQR2WorkspaceSize (m, n), false);  
+  double* a = work.base();
+  int info = 0;
+  if (m>0 && n>0) {
+    for (int j=0; j<n; j++) for (int i=0; i<m; i++) a[j*m+i] = R(i,j);
+    info = lapackGEQR (m, n, a, m, a+m*n);
+    for (int j=0; j<n; j++) for (int i=0; i<rDim; i++) R(i,j) = a[j*m+i];
+  }  
+  if (rDim<R.rows()) R.deleteLastRow (R.rows()-rDim);
+  zeroLower (R);
+
+  if (info<0) throw XymLAPACKException ("Illegal parameter calling dgeqr2 (FORTRAN)");
+#endif
+}
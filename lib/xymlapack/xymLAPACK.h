@@ -60,12 +60,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   \code
      -llapack -lblas -lF77
   \endcode
+
+   If compiled with \c XYM_NO_LAPACK (CMake option \c XYM_USE_LAPACK
+   off) no LAPACK is needed. \c xymGEQR2 then uses the native
+   Householder QR from \c xymQR.h, which is faster for the small
+   matrices of a treemap, and \c xymSYGV throws an exception. The
+   LAPACK version is kept as a reference.
 */
 
 #include <xymatrix/xymMatrixC.h>
 #include <xymatrix/xymVector.h>
+#include <xymatrix/xymOperations.h>
 
 #include "clapack.h"
+#include "xymQR.h"
 
 #include <stdexcept>
 
@@ -110,6 +118,53 @@ void xymGEQR2 (const XymMatrixC& A, XymMatrixC& R, XymVector& work);
 /*! The workspace is allocated and deallocated. */
 void xymGEQR2 (const XymMatrixC& A, XymMatrixC& R);
 
+//! Like \c xymGEQR2 (R, R, work) but on a copy of \c R packed into \c work
+/*! The result does not depend on how much memory has been reserved
+    for \c R, whereas the BLAS called by LAPACK may round differently
+    for different leading dimensions. So a matrix reserved for the
+    largest size can be reused as scratch space without the result
+    depending on its history. The copying takes \c O(rows*cols),
+    little compared to the decomposition. With \c XYM_NO_LAPACK no
+    copy is made, since the native QR does not depend on the leading
+    dimension.
+ */
+void xymGEQR2Packed (XymMatrixC& R, XymVector& work);
+
+//! Nr of doubles \c xymGEQR2 and \c xymGEQR2Packed need in \c work for an \c m*n matrix
+/*! This is the workspace query. A workspace sized with this for the
+    largest matrix expected is never reallocated by smaller ones.
+    Above \c XYM_QR_BLOCKED_MIN_COLS columns both routines use a
+    blocked QR (\c dgeqrf or \c xymNativeGEQRF).
+ */
+int xymGEQR2WorkspaceSize (int m, int n);
+
+//! Whether \c xymGEQR2 uses the native QR of \c xymQR.h (compiled with \c XYM_NO_LAPACK)
+bool xymIsNativeQR ();
+
+//! Like \c xymGEQR2Packed but the trailing updates of a blocked QR are done by \c update
+/*! \c update has the signature of \c XymSerialLARFB and may
+    distribute the columns over several threads. Since the columns
+    are updated independently, the result is the same as with \c
+    xymGEQR2Packed. If the library does not use the native QR, \c
+    update is ignored and \c xymGEQR2Packed is called, so LAPACK
+    stays the reference.
+ */
+template<class Update>
+void xymGEQR2Packed (XymMatrixC& R, XymVector& work, const Update& update)
+{
+  int m = R.rows();
+  int n = R.cols();  
+  if (!xymIsNativeQR() || n<XYM_QR_BLOCKED_MIN_COLS) {
+    xymGEQR2Packed (R, work);
+    return;
+  }  
+  int rDim = (m<n)?m:n;
+  work.resize (xymNativeGEQRFWorkspaceSize (m, n), false);
+  if (m>0) xymNativeGEQRF (m, n, R.base(), R.colOfs(), work.base(), update);
+  if (rDim<R.rows()) R.deleteLastRow (R.rows()-rDim);
+  zeroLower (R);
+}
+
 
 
 #endif  /* XYMLAPACK_H */
@@ -0,0 +1,467 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef XYMQR_H
+#define XYMQR_H
+
+/*!\file xymQR.h 
+   \brief Native Householder QR decomposition
+   \author Udo Frese
+
+   Contains \c xymNativeGEQR2, a C++ implementation of LAPACK's \c
+   dgeqr2 used by \c xymGEQR2 when the library is compiled with \c
+   XYM_NO_LAPACK. The matrices factorized in a treemap are small
+   (mostly less than 64 columns), where the cost of calling through
+   the FORTRAN interface and the generic BLAS level 2 routines is
+   comparable to the arithmetic itself. The routine is header only
+   so it can be inlined, and where SSE2 is available (always on
+   x86-64) the reflectors are applied two rows at a time.
+*/
+
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+//! Applies the reflector \c I-tau*v*v' to the four columns starting at \c c0
+/*! All vectors have length \c len, \c v[0] is taken as 1 and the
+    columns are \c lda apart. Used by \c xymNativeGEQR2. Sharing the
+    loads of \c v between four columns and having four independent
+    dependency chains makes this the inner kernel.
+ */
+inline void xymApplyReflector4 (const double* v, int len, double tau, double* c0, int lda)
+{
+  double* c1 = c0+lda;
+  double* c2 = c1+lda;
+  double* c3 = c2+lda;
+  double s0, s1, s2, s3;
+  int r=1;
+#ifdef __SSE2__
+  __m128d a0 = _mm_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+  for (; r+1<len; r+=2) {
+    __m128d vr = _mm_loadu_pd (v+r);
+    a0 = _mm_add_pd (a0, _mm_mul_pd (vr, _mm_loadu_pd (c0+r)));
+    a1 = _mm_add_pd (a1, _mm_mul_pd (vr, _mm_loadu_pd (c1+r)));
+    a2 = _mm_add_pd (a2, _mm_mul_pd (vr, _mm_loadu_pd (c2+r)));
+    a3 = _mm_add_pd (a3, _mm_mul_pd (vr, _mm_loadu_pd (c3+r)));
+  }
+  double s[4];
+  _mm_storeu_pd (s,   _mm_add_pd (_mm_unpacklo_pd (a0, a1), _mm_unpackhi_pd (a0, a1)));
+  _mm_storeu_pd (s+2, _mm_add_pd (_mm_unpacklo_pd (a2, a3), _mm_unpackhi_pd (a2, a3)));
+  s0 = c0[0]+s[0];
+  s1 = c1[0]+s[1];
+  s2 = c2[0]+s[2];
+  s3 = c3[0]+s[3];
+#else
+  s0 = c0[0];
+  s1 = c1[0];
+  s2 = c2[0];
+  s3 = c3[0];
+#endif
+  for (; r<len; r++) {
+    s0 += v[r]*c0[r];
+    s1 += v[r]*c1[r];
+    s2 += v[r]*c2[r];
+    s3 += v[r]*c3[r];
+  }
+  s0 *= tau; s1 *= tau; s2 *= tau; s3 *= tau;
+  c0[0] -= s0; c1[0] -= s1; c2[0] -= s2; c3[0] -= s3;
+  r=1;
+#ifdef __SSE2__
+  __m128d b0 = _mm_set1_pd (s0), b1 = _mm_set1_pd (s1), b2 = _mm_set1_pd (s2), b3 = _mm_set1_pd (s3);
+  for (; r+1<len; r+=2) {
+    __m128d vr = _mm_loadu_pd (v+r);
+    _mm_storeu_pd (c0+r, _mm_sub_pd (_mm_loadu_pd (c0+r), _mm_mul_pd (b0, vr)));
+    _mm_storeu_pd (c1+r, _mm_sub_pd (_mm_loadu_pd (c1+r), _mm_mul_pd (b1, vr)));
+    _mm_storeu_pd (c2+r, _mm_sub_pd (_mm_loadu_pd (c2+r), _mm_mul_pd (b2, vr)));
+    _mm_storeu_pd (c3+r, _mm_sub_pd (_mm_loadu_pd (c3+r), _mm_mul_pd (b3, vr)));
+  }
+#endif
+  for (; r<len; r++) {
+    c0[r] -= s0*v[r];
+    c1[r] -= s1*v[r];
+    c2[r] -= s2*v[r];
+    c3[r] -= s3*v[r];
+  }
+}
+
+
+//! Computes a Householder QR decomposition of the \c m*n matrix \c a
+/*! \c a is stored column major with leading dimension \c lda. Like
+    \c dgeqr2 the routine overwrites the upper triangle of \c a with
+    \c R and the part below the diagonal with the Householder vectors
+    whose factors are stored in \c tau[0..min(m,n)-1]. A reflector
+    with \c tau=0 is the identity. Diagonal entries of \c R may be
+    negative.
+
+    Unlike the reference BLAS, the norm is not computed with scaling,
+    so entries above \c 1e150 will overflow. The result does not
+    depend on \c lda.
+ */
+inline void xymNativeGEQR2 (int m, int n, double* a, int lda, double* tau)
+{
+  int k = (m<n)?m:n;
+  for (int i=0; i<k; i++) {
+    double* v = a+i*lda+i;
+    int len = m-i;
+    // Generate the reflector H=I-tau*v*v' with H*(alpha, x)'=(beta,0)'
+    double xnorm2 = 0;
+    for (int r=1; r<len; r++) xnorm2 += v[r]*v[r];
+    if (xnorm2==0) {
+      tau[i] = 0;
+      continue;
+    }
+    double alpha = v[0];
+    double beta  = sqrt (alpha*alpha+xnorm2);
+    if (alpha>=0) beta = -beta;
+    tau[i] = (beta-alpha)/beta;
+    double scale = 1/(alpha-beta);
+    for (int r=1; r<len; r++) v[r] *= scale;
+    v[0] = beta;
+    // Apply H to the remaining columns
+    double t = tau[i];
+    int j = i+1;
+    for (; j+3<n; j+=4) xymApplyReflector4 (v, len, t, a+j*lda+i, lda);
+    for (; j<n; j++) {
+      double* c = a+j*lda+i;
+      double s = c[0];
+      for (int r=1; r<len; r++) s += v[r]*c[r];
+      s *= t;
+      c[0] -= s;
+      for (int r=1; r<len; r++) c[r] -= s*v[r];
+    }
+  }
+}
+
+
+// Blocked QR
+// ----------
+//
+// For large matrices \c xymNativeGEQRF factorizes panels of \c
+// XYM_QR_BLOCK columns with \c xymNativeGEQR2 and applies each panel's
+// reflectors at once as a block reflector \c I-V*T*V' (compact WY
+// representation, like LAPACK's \c dgeqrf, \c dlarft and \c dlarfb).
+// Then \c V stays in cache while it is applied to the trailing
+// columns. The columns of the trailing matrix are updated
+// independently of each other, so the update can be split into
+// column ranges that are processed in parallel by the caller. The
+// result does not depend on how the columns are split.
+
+//! Nr of columns of a panel in \c xymNativeGEQRF
+const int XYM_QR_BLOCK = 16;
+
+//! \c xymNativeGEQRF uses \c xymNativeGEQR2 below this number of columns
+const int XYM_QR_BLOCKED_MIN_COLS = 96;
+
+
+//! Returns \c x'*y for vectors of length \c n
+inline double xymNativeDot (const double* x, const double* y, int n)
+{
+  int i=0;
+  double sum = 0;
+#ifdef __SSE2__
+  __m128d a0 = _mm_setzero_pd(), a1 = a0;
+  for (; i+3<n; i+=4) {
+    a0 = _mm_add_pd (a0, _mm_mul_pd (_mm_loadu_pd (x+i),   _mm_loadu_pd (y+i)));
+    a1 = _mm_add_pd (a1, _mm_mul_pd (_mm_loadu_pd (x+i+2), _mm_loadu_pd (y+i+2)));
+  }
+  a0 = _mm_add_pd (a0, a1);
+  double s[2];
+  _mm_storeu_pd (s, a0);
+  sum = s[0]+s[1];
+#endif
+  for (; i<n; i++) sum += x[i]*y[i];
+  return sum;
+}
+
+
+//! Computes \c y-=alpha*x for vectors of length \c n
+inline void xymNativeSubScaled (double alpha, const double* x, double* y, int n)
+{
+  int i=0;
+#ifdef __SSE2__
+  __m128d a = _mm_set1_pd (alpha);
+  for (; i+1<n; i+=2) _mm_storeu_pd (y+i, _mm_sub_pd (_mm_loadu_pd (y+i), _mm_mul_pd (a, _mm_loadu_pd (x+i))));
+#endif
+  for (; i<n; i++) y[i] -= alpha*x[i];
+}
+
+
+//! Forms the triangular factor \c T of a block of \c k reflectors
+/*! The reflectors are stored like \c xymNativeGEQR2 leaves them, \c
+    v is the \c m*k panel with leading dimension \c ldv, the part
+    above the diagonal is ignored and the diagonal is taken as 1. The
+    product \c H_0*...*H_{k-1} equals \c I-V*T*V' with \c T upper
+    triangular. \c T is stored column major in \c t[0..k*k-1]. Like
+    LAPACK's \c dlarft with \c direct='F' and \c storev='C'.
+ */
+inline void xymNativeLARFT (int m, int k, const double* v, int ldv, const double* tau, double* t)
+{
+  for (int i=0; i<k; i++) {
+    double* ti = t+i*k;
+    for (int l=0; l<k; l++) ti[l] = 0;
+    if (tau[i]==0) continue;
+    // z = -tau_i*V(:,0..i-1)'*v_i
+    const double* vi = v+i*ldv;
+    for (int l=0; l<i; l++) {
+      const double* vl = v+l*ldv;
+      ti[l] = -tau[i]*(vl[i] + xymNativeDot (vl+i+1, vi+i+1, m-i-1));
+    }
+    // T(0..i-1,i) = T(0..i-1,0..i-1)*z, T is upper triangular
+    for (int l=0; l<i; l++) {
+      double sum = 0;
+      for (int q=l; q<i; q++) sum += t[q*k+l]*ti[q];
+      ti[l] = sum;
+    }
+    ti[i] = tau[i];
+  }
+}
+
+
+//! Computes \c s[2*q+l]=vl'*cq for \c l=0,1 and \c q=0..3 over \c len rows
+/*! The inner kernel of \c xymNativeLARFB. Each row loaded is used for
+    eight products. */
+inline void xymNativeVtC4 (const double* v0, const double* v1, int len, 
+                           const double* c0, const double* c1, const double* c2, const double* c3, double* s)
+{
+  int r=0;
+  for (int i=0; i<8; i++) s[i] = 0;
+#ifdef __SSE2__
+  __m128d a00 = _mm_setzero_pd(), a01 = a00, a10 = a00, a11 = a00;
+  __m128d a20 = a00, a21 = a00, a30 = a00, a31 = a00;
+  for (; r+1<len; r+=2) {
+    __m128d x0 = _mm_loadu_pd (v0+r), x1 = _mm_loadu_pd (v1+r), y;
+    y = _mm_loadu_pd (c0+r);
+    a00 = _mm_add_pd (a00, _mm_mul_pd (x0, y));
+    a01 = _mm_add_pd (a01, _mm_mul_pd (x1, y));
+    y = _mm_loadu_pd (c1+r);
+    a10 = _mm_add_pd (a10, _mm_mul_pd (x0, y));
+    a11 = _mm_add_pd (a11, _mm_mul_pd (x1, y));
+    y = _mm_loadu_pd (c2+r);
+    a20 = _mm_add_pd (a20, _mm_mul_pd (x0, y));
+    a21 = _mm_add_pd (a21, _mm_mul_pd (x1, y));
+    y = _mm_loadu_pd (c3+r);
+    a30 = _mm_add_pd (a30, _mm_mul_pd (x0, y));
+    a31 = _mm_add_pd (a31, _mm_mul_pd (x1, y));
+  }
+  _mm_storeu_pd (s,   _mm_add_pd (_mm_unpacklo_pd (a00, a01), _mm_unpackhi_pd (a00, a01)));
+  _mm_storeu_pd (s+2, _mm_add_pd (_mm_unpacklo_pd (a10, a11), _mm_unpackhi_pd (a10, a11)));
+  _mm_storeu_pd (s+4, _mm_add_pd (_mm_unpacklo_pd (a20, a21), _mm_unpackhi_pd (a20, a21)));
+  _mm_storeu_pd (s+6, _mm_add_pd (_mm_unpacklo_pd (a30, a31), _mm_unpackhi_pd (a30, a31)));
+#endif
+  for (; r<len; r++) {
+    s[0] += v0[r]*c0[r]; s[1] += v1[r]*c0[r];
+    s[2] += v0[r]*c1[r]; s[3] += v1[r]*c1[r];
+    s[4] += v0[r]*c2[r]; s[5] += v1[r]*c2[r];
+    s[6] += v0[r]*c3[r]; s[7] += v1[r]*c3[r];
+  }
+}
+
+
+//! Computes \c cq-=w[2*q]*v0+w[2*q+1]*v1 for \c q=0..3 over \c len rows
+inline void xymNativeSubVW4 (const double* v0, const double* v1, int len, const double* w,
+                             double* c0, double* c1, double* c2, double* c3)
+{
+  int r=0;
+#ifdef __SSE2__
+  __m128d w00 = _mm_set1_pd (w[0]), w01 = _mm_set1_pd (w[1]);
+  __m128d w10 = _mm_set1_pd (w[2]), w11 = _mm_set1_pd (w[3]);
+  __m128d w20 = _mm_set1_pd (w[4]), w21 = _mm_set1_pd (w[5]);
+  __m128d w30 = _mm_set1_pd (w[6]), w31 = _mm_set1_pd (w[7]);
+  for (; r+1<len; r+=2) {
+    __m128d x0 = _mm_loadu_pd (v0+r), x1 = _mm_loadu_pd (v1+r);
+    _mm_storeu_pd (c0+r, _mm_sub_pd (_mm_loadu_pd (c0+r), _mm_add_pd (_mm_mul_pd (w00, x0), _mm_mul_pd (w01, x1))));
+    _mm_storeu_pd (c1+r, _mm_sub_pd (_mm_loadu_pd (c1+r), _mm_add_pd (_mm_mul_pd (w10, x0), _mm_mul_pd (w11, x1))));
+    _mm_storeu_pd (c2+r, _mm_sub_pd (_mm_loadu_pd (c2+r), _mm_add_pd (_mm_mul_pd (w20, x0), _mm_mul_pd (w21, x1))));
+    _mm_storeu_pd (c3+r, _mm_sub_pd (_mm_loadu_pd (c3+r), _mm_add_pd (_mm_mul_pd (w30, x0), _mm_mul_pd (w31, x1))));
+  }
+#endif
+  for (; r<len; r++) {
+    c0[r] -= w[0]*v0[r] + w[1]*v1[r];
+    c1[r] -= w[2]*v0[r] + w[3]*v1[r];
+    c2[r] -= w[4]*v0[r] + w[5]*v1[r];
+    c3[r] -= w[6]*v0[r] + w[7]*v1[r];
+  }
+}
+
+
+//! Applies the transposed block reflector \c I-V*T'*V' to \c nCols columns \c c
+/*! \c v, \c t are as computed by \c xymNativeLARFT, \c c is an \c
+    m*nCols matrix with leading dimension \c ldc. \c w must provide
+    space for \c 4*k doubles. Every column is processed independently
+    so the result does not depend on how the columns are distributed
+    among several calls. Like LAPACK's \c dlarfb with \c side='L', \c
+    trans='T', \c direct='F' and \c storev='C'.
+
+    Four columns and two reflectors are handled together, so every
+    entry of \c V and \c c loaded from memory is used several times.
+ */
+inline void xymNativeLARFB (int m, int k, const double* v, int ldv, const double* t,
+                            double* c, int ldc, int nCols, double* w)
+{
+  double s[8];
+  int col=0;
+  for (; col+3<nCols; col+=4, c+=4*ldc) {
+    double* cq[4] = {c, c+ldc, c+2*ldc, c+3*ldc};
+    // w = V'*c, w[4*j+q] belongs to reflector j and column q
+    for (int j=0; j<k; j+=2) {
+      const double* vj = v+j*ldv;
+      // For odd k the last reflector is paired with itself
+      const double* vj1 = (j+1<k)?vj+ldv:vj;
+      int r0 = (j+1<k)?j+2:j+1;
+      xymNativeVtC4 (vj+r0, vj1+r0, m-r0, cq[0]+r0, cq[1]+r0, cq[2]+r0, cq[3]+r0, s);
+      for (int q=0; q<4; q++) {
+        if (j+1<k) {
+          w[4*j+q]     = cq[q][j] + vj[j+1]*cq[q][j+1] + s[2*q];
+          w[4*j+4+q]   = cq[q][j+1] + s[2*q+1];
+        }
+        else w[4*j+q]  = cq[q][j] + s[2*q];
+      }
+    }
+    // w = T'*w, T' is lower triangular
+    for (int j=k-1; j>=0; j--) {
+      const double* tj = t+j*k;      
+      for (int q=0; q<4; q++) {
+        double sum = 0;
+        for (int l=0; l<=j; l++) sum += tj[l]*w[4*l+q];
+        w[4*j+q] = sum;
+      }
+    }
+    // c -= V*w
+    for (int j=0; j<k; j+=2) {
+      const double* vj = v+j*ldv;
+      if (j+1<k) {
+        const double* vj1 = vj+ldv;
+        for (int q=0; q<4; q++) {
+          s[2*q]   = w[4*j+q];
+          s[2*q+1] = w[4*j+4+q];
+          cq[q][j]   -= s[2*q];
+          cq[q][j+1] -= s[2*q]*vj[j+1] + s[2*q+1];
+        }
+        xymNativeSubVW4 (vj+j+2, vj1+j+2, m-j-2, s, cq[0]+j+2, cq[1]+j+2, cq[2]+j+2, cq[3]+j+2);
+      }
+      else {
+        for (int q=0; q<4; q++) {
+          s[2*q]   = w[4*j+q];
+          s[2*q+1] = 0;
+          cq[q][j] -= s[2*q];
+        }
+        xymNativeSubVW4 (vj+j+1, vj+j+1, m-j-1, s, cq[0]+j+1, cq[1]+j+1, cq[2]+j+1, cq[3]+j+1);
+      }
+    }
+  }
+  for (; col<nCols; col++, c+=ldc) {
+    for (int j=0; j<k; j++) w[j] = c[j] + xymNativeDot (v+j*ldv+j+1, c+j+1, m-j-1);
+    for (int j=k-1; j>=0; j--) {
+      double sum = 0;
+      const double* tj = t+j*k;      
+      for (int l=0; l<=j; l++) sum += tj[l]*w[l];
+      w[j] = sum;
+    }
+    for (int j=0; j<k; j++) {
+      c[j] -= w[j];
+      xymNativeSubScaled (w[j], v+j*ldv+j+1, c+j+1, m-j-1);
+    }
+  }
+}
+
+
+//! Applies a block reflector to all trailing columns in the calling thread
+/*! Default for the \c update argument of \c xymNativeGEQRF. A parallel
+    version must provide the same \c operator() and may split the
+    columns into ranges, giving the range starting at column \c j0
+    the workspace \c w+XYM_QR_BLOCK*j0. \c w has room for that as
+    long as each range but the last has at least four columns.
+ */
+class XymSerialLARFB
+{
+ public:
+  //! Applies \c I-V*T'*V' to \c c, \c w provides \c XYM_QR_BLOCK*(nCols+3) doubles
+  void operator() (int m, int k, const double* v, int ldv, const double* t,
+                   double* c, int ldc, int nCols, double* w) const
+    {
+      xymNativeLARFB (m, k, v, ldv, t, c, ldc, nCols, w);
+    }
+};
+
+
+//! Nr of doubles \c xymNativeGEQRF needs in \c work for an \c m*n matrix
+/*! This includes \c tau, so \c work can be sized once with this and
+    reused for all smaller matrices. */
+inline int xymNativeGEQRFWorkspaceSize (int m, int n)
+{
+  int k = (m<n)?m:n;
+  if (n<XYM_QR_BLOCKED_MIN_COLS) return k;
+  return k + XYM_QR_BLOCK*XYM_QR_BLOCK + XYM_QR_BLOCK*(n+3);
+}
+
+
+//! Blocked version of \c xymNativeGEQR2 with the same result format
+/*! \c work must hold \c xymNativeGEQRFWorkspaceSize(m,n) doubles, on
+    return \c work[0..min(m,n)-1] contains \c tau. Below \c
+    XYM_QR_BLOCKED_MIN_COLS columns \c xymNativeGEQR2 is called
+    directly. The trailing updates are performed by \c update, which
+    may distribute them over several threads (see \c XymSerialLARFB).
+ */
+template<class Update>
+void xymNativeGEQRF (int m, int n, double* a, int lda, double* work, const Update& update)
+{
+  int k = (m<n)?m:n;
+  double* tau = work;
+  if (n<XYM_QR_BLOCKED_MIN_COLS) {
+    xymNativeGEQR2 (m, n, a, lda, tau);
+    return;
+  }
+  double* t = work+k;
+  double* w = t+XYM_QR_BLOCK*XYM_QR_BLOCK;
+  for (int i=0; i<k; i+=XYM_QR_BLOCK) {
+    int ib = k-i;
+    if (ib>XYM_QR_BLOCK) ib = XYM_QR_BLOCK;
+    double* panel = a+i*lda+i;
+    xymNativeGEQR2 (m-i, ib, panel, lda, tau+i);
+    if (i+ib<n) {
+      xymNativeLARFT (m-i, ib, panel, lda, tau+i, t);
+      update (m-i, ib, panel, lda, t, panel+ib*lda, lda, n-i-ib, w);
+    }
+  }
+}
+
+
+//! Overloaded, performs the trailing updates in the calling thread
+inline void xymNativeGEQRF (int m, int n, double* a, int lda, double* work)
+{
+  xymNativeGEQRF (m, n, a, lda, work, XymSerialLARFB());
+}
+
+
+#endif  /* XYMQR_H */
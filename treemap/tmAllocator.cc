@@ -0,0 +1,230 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*!\file tmAllocator.cc 
+   \brief Implementation of class \c TmAllocator
+   \author Udo Frese
+
+  Contains the implementation of class \c TmAllocator, the memory pool
+  of a \c TmTreemap.
+*/
+#include "tmAllocator.h"
+
+TmAllocator::TmAllocator ()
+  :slab(), slabBytes(0), slabPos(NULL), slabEnd(NULL), bytesInUse(0), isContiguous(false), threadBuffer()
+{
+  for (int c=0; c<NR_OF_SIZE_CLASSES; c++) freeList[c] = NULL;  
+  setNrOfThreads (1);  
+}
+
+
+TmAllocator::~TmAllocator ()
+{
+  assert (bytesInUse==0);  
+  for (int i=0; i<(int) slab.size(); i++) delete[] slab[i];
+}
+
+
+void* TmAllocator::allocate (size_t size)
+{
+  int blockSize = blockSizeFor (size);
+  if (blockSize==0) return allocateOnHeap (size);
+  int c = blockSize/GRANULARITY - 1;
+  char* block;
+  if (freeList[c]!=NULL && !isContiguous) {
+    block = (char*) freeList[c];
+    freeList[c] = freeList[c]->next;
+  }
+  else {
+    // The rest of the old slab is wasted, at most one block
+    if (slabEnd-slabPos<blockSize) reserveContiguous (SLAB_SIZE);
+    block = slabPos;
+    slabPos += blockSize;
+  }
+  bytesInUse += blockSize;  
+  Header* h = (Header*) block;
+  h->owner = this;
+  h->sizeClass = c;
+  h->size = size;  
+  return block + HEADER_SIZE;  
+}
+
+
+void TmAllocator::reserveContiguous (int bytes)
+{
+  if (slabEnd-slabPos>=bytes) return;
+  int size = SLAB_SIZE;
+  if (size<bytes) size = bytes;  
+  slabPos = new char[size];
+  slabEnd = slabPos + size;
+  slab.push_back (slabPos);
+  slabBytes += size;  
+}
+
+
+int TmAllocator::blockSize (const void* p)
+{
+  const Header* h = (const Header*) (((const char*) p) - HEADER_SIZE);
+  if (h->owner==NULL) return 0;
+  else return (h->sizeClass+1)*GRANULARITY;
+}
+
+
+int TmAllocator::blockSizeFor (size_t size)
+{
+  int c = (HEADER_SIZE+size+GRANULARITY-1)/GRANULARITY - 1;
+  if (c>=NR_OF_SIZE_CLASSES) return 0;
+  else return (c+1)*GRANULARITY;
+}
+
+
+
+int TmAllocator::sizeOf (const void* p)
+{
+  const Header* h = (const Header*) (((const char*) p) - HEADER_SIZE);
+  return h->size;  
+}
+
+
+void* TmAllocator::allocateOnHeap (size_t size)
+{
+  char* block = new char[HEADER_SIZE+size];
+  Header* h = (Header*) block;
+  h->owner = NULL;
+  h->sizeClass = -1;
+  h->size = size;  
+  return block + HEADER_SIZE;
+}
+
+
+void TmAllocator::deallocate (void* p)
+{
+  if (p==NULL) return;
+  char* block = ((char*) p) - HEADER_SIZE;  
+  Header* h = (Header*) block;
+  TmAllocator* owner = h->owner;  
+  if (owner==NULL) delete[] block;
+  else {
+    int c = h->sizeClass;    
+    FreeBlock* fb = (FreeBlock*) block;
+    fb->next = owner->freeList[c];
+    owner->freeList[c] = fb;
+    owner->bytesInUse -= (c+1)*GRANULARITY;    
+  }
+}
+
+
+void TmAllocator::setNrOfThreads (int n)
+{
+  if (n<1) n = 1;
+  clearBuffers ();
+  threadBuffer.resize (n);
+}
+
+
+void TmAllocator::clearBuffers ()
+{
+  for (int i=0; i<(int) threadBuffer.size(); i++) {
+    long int nrOfAllocations = threadBuffer[i].nrOfAllocations + 
+      threadBuffer[i].floats.nrOfAllocations + threadBuffer[i].featureLists.nrOfAllocations;    
+    long int nrOfMixedPrecisionFallbacks = threadBuffer[i].nrOfMixedPrecisionFallbacks;    
+    threadBuffer[i] = ThreadBuffers();
+    threadBuffer[i].nrOfAllocations = nrOfAllocations;    
+    threadBuffer[i].nrOfMixedPrecisionFallbacks = nrOfMixedPrecisionFallbacks;    
+  }  
+}
+
+
+long int TmAllocator::nrOfAllocations () const
+{
+  long int n = 0;
+  for (int i=0; i<(int) threadBuffer.size(); i++) 
+    n += threadBuffer[i].nrOfAllocations + threadBuffer[i].floats.nrOfAllocations + threadBuffer[i].featureLists.nrOfAllocations;
+  return n;  
+}
+
+
+long int TmAllocator::nrOfMixedPrecisionFallbacks () const
+{
+  long int n = 0;
+  for (int i=0; i<(int) threadBuffer.size(); i++) n += threadBuffer[i].nrOfMixedPrecisionFallbacks;
+  return n;  
+}
+
+
+int TmAllocator::memory () const
+{
+  int mem = sizeof(TmAllocator);
+  mem += slab.capacity()*sizeof(char*);
+  mem += slabBytes - bytesInUse;
+  for (int i=0; i<(int) threadBuffer.size(); i++) mem += threadBuffer[i].memory();
+  return mem;  
+}
+
+
+void TmAllocator::ThreadBuffers::reserve (int n, int rows, int columns, int nrOfFeatures)
+{
+  if (column.capacity()<columns) {
+    column.reserve (columns);
+    nrOfAllocations++;
+  }  
+  if (columnOfFeature.size()<nrOfFeatures) {
+    if (columnOfFeature.capacity()<nrOfFeatures) nrOfAllocations++;
+    columnOfFeature.resize (nrOfFeatures, -1);
+  }  
+  if (featureList.capacity()<n) {
+    featureList.reserve (n);
+    nrOfAllocations++;
+  }  
+  if (gaussian.feature.capacity()<n) {
+    gaussian.feature.reserve (n);
+    nrOfAllocations++;
+  }  
+  XymMatrixC& R = gaussian.R;  
+  if (R.rowsReserved()<rows || R.colsReserved()<n+1) {
+    int newRows = R.rowsReserved(), newCols = R.colsReserved();
+    if (newRows<rows) newRows = rows;
+    if (newCols<n+1) newCols = n+1;
+    R.clear();
+    R.reserve (newRows, newCols, true);
+    nrOfAllocations++;
+  }
+}
+
+
+int TmAllocator::ThreadBuffers::memory () const
+{
+  return sizeof(ThreadBuffers) - sizeof(floats) - sizeof(featureLists) + floats.memory() + featureLists.memory() 
+    + gaussian.memory() - sizeof(TmGaussian) + featureList.memory()
+    + column.capacity()*sizeof(int) + columnOfFeature.capacity()*sizeof(int);  
+}
@@ -0,0 +1,384 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TMALLOCATOR_H
+#define TMALLOCATOR_H
+
+
+/*!\file tmAllocator.h
+   \brief Class \c TmAllocator, the memory pool of a \c TmTreemap
+   \author Udo Frese
+
+  Contains the class \c TmAllocator, a slab allocator for the nodes of
+  a \c TmTreemap, and \c TmBufferCache, free lists of buffers for the
+  Gaussians of the nodes.
+*/
+
+#include "tmTypes.h"
+#include "tmExtendedFeatureId.h"
+#include "tmGaussian.h"
+#include <stddef.h>
+
+//! Free lists of \c XycVector buffers in size classes
+/*! \c TmNode::updateGaussian computes every Gaussian into new
+    buffers and afterwards frees the old ones, which usually have
+    nearly the same size. So instead of freeing, the old buffers are
+    kept here and taken by the next update of similar size.
+
+    Size class \c c=8*e+m contains buffers of capacity \c (8+m)<<e,
+    so a buffer taken from the cache is at most 1/4 larger than
+    requested. Every class keeps up to \c NR_OF_SLOTS buffers; more
+    are freed.
+ */
+template<class T> class TmBufferCache
+{
+ public:
+  //! Number of size classes (capacities up to \c INT_MAX)
+  enum {NR_OF_CLASSES = 8*28};
+  //! Number of buffers kept per size class
+  enum {NR_OF_SLOTS = 2};
+
+  //! Empty cache
+  TmBufferCache () :nrOfAllocations(0) {for (int c=0; c<NR_OF_CLASSES; c++) nrOfBuffers[c] = 0;}
+
+  //! Number of buffers \c acquire had to allocate on the heap
+  long int nrOfAllocations;  
+
+  //! Replaces the storage of \c v by a buffer for \c n elements
+  /*! The old content of \c v is freed, the new content is
+      undefined. \c v.size()==n afterwards. */
+  void acquire (XycVector<T>& v, int n)
+    {
+      if (n<8) {
+        if (v.capacity()<n) nrOfAllocations++;
+        v.resizeWithUndefinedData (n);
+        return;        
+      }
+      int c = classAtLeast (n);
+      for (int c2=c; c2<=c+1 && c2<NR_OF_CLASSES; c2++)
+        if (nrOfBuffers[c2]>0) {
+          nrOfBuffers[c2]--;
+          v.swap (slot[c2][nrOfBuffers[c2]]);
+          XycVector<T> empty;
+          slot[c2][nrOfBuffers[c2]].swap (empty);
+          v.resizeWithUndefinedData (n);
+          return;          
+        }
+      v.resizeCompactlyWithUndefindedData (capacityOfClass (c));
+      v.resizeWithUndefinedData (n);
+      nrOfAllocations++;      
+    }
+
+  //! Makes \c v a buffer for \c n elements with undefined content
+  /*! The storage of \c v is kept if it has a capacity \c acquire
+      could return, otherwise it is exchanged through the cache. */
+  void fit (XycVector<T>& v, int n)
+    {
+      int cap = v.capacity();
+      if (n<=cap && cap<=maxCapacity (n)) v.resizeWithUndefinedData (n);
+      else {
+        release (v);
+        acquire (v, n);
+      }
+    }
+
+  //! Same for an \c XycSmallVector
+  /*! Up to \c N elements are stored inline, otherwise the heap
+      memory of \c v is exchanged through the cache as above. */
+  template<int N> void fit (XycSmallVector<T,N>& v, int n)
+    {
+      XycVector<T> buf;
+      if (!v.isInline()) v.swap (buf);
+      if (n<=N) release (buf);
+      else {
+        fit (buf, n);
+        v.swap (buf);
+      }
+      v.resizeWithUndefinedData (n);
+    }
+
+  //! Moves the storage of \c v into the cache, leaving \c v empty
+  void release (XycVector<T>& v)
+    {
+      int c = classAtMost (v.capacity());
+      if (c>=0 && nrOfBuffers[c]<NR_OF_SLOTS) {
+        slot[c][nrOfBuffers[c]].swap (v);
+        nrOfBuffers[c]++;        
+      }
+      XycVector<T> empty;
+      v.swap (empty);
+    }
+
+  //! Frees all buffers
+  void clear ()
+    {
+      for (int c=0; c<NR_OF_CLASSES; c++) {
+        for (int i=0; i<nrOfBuffers[c]; i++) {
+          XycVector<T> empty;
+          slot[c][i].swap (empty);
+        }        
+        nrOfBuffers[c] = 0;        
+      }
+    }
+
+  //! Memory consumption in bytes
+  int memory () const
+    {
+      int mem = sizeof(TmBufferCache);
+      for (int c=0; c<NR_OF_CLASSES; c++)
+        for (int i=0; i<nrOfBuffers[c]; i++) mem += slot[c][i].capacity()*sizeof(T);
+      return mem;      
+    }  
+
+  //! Capacity of the buffers in size class \c c
+  static int capacityOfClass (int c) {return (8+c%8)<<(c/8);}
+
+  //! Smallest class with capacity \c >=n
+  static int classAtLeast (int n)
+    {
+      int e = 0;
+      while ((15<<e)<n) e++;
+      int m = 0;
+      while (((8+m)<<e)<n) m++;
+      return 8*e+m;      
+    }  
+
+  //! Largest capacity \c acquire returns for \c n elements
+  static int maxCapacity (int n)
+    {
+      if (n<8) return 8;
+      int c = classAtLeast (n)+1;
+      if (c>=NR_OF_CLASSES) return n;
+      return capacityOfClass (c);      
+    }  
+
+  //! Largest class with capacity \c <=n or \c -1 if \c n<8
+  static int classAtMost (int n)
+    {
+      if (n<8) return -1;
+      int e = 0;
+      while ((16<<e)<=n) e++;
+      int m = 7;
+      while (((8+m)<<e)>n) m--;
+      return 8*e+m;      
+    }  
+
+ protected:
+  //! \c slot[c][0..nrOfBuffers[c]-1] are the buffers of class \c c
+  XycVector<T> slot[NR_OF_CLASSES][NR_OF_SLOTS];
+
+  //! Number of buffers in every class
+  int nrOfBuffers[NR_OF_CLASSES];
+};
+
+
+//! Memory pool of a \c TmTreemap
+/*! Nodes are allocated from slabs with free lists for every size
+    class of 16 bytes (\c TmNode::operator \c new). Every block starts
+    with a header telling to which allocator it belongs, so \c
+    deallocate can return the block without knowing the allocator and
+    nodes allocated on the heap (e.g. by \c TmNode::duplicate) can be
+    mixed with nodes from the pool. The slabs are freed when the
+    allocator is destroyed, so all nodes must have been deleted before.
+
+    Furthermore the allocator holds \c ThreadBuffers for every
+    thread, the scratch memory of \c TmNode::updateGaussian.
+
+    In contiguous mode (\c setContiguous) blocks are taken one after
+    the other from the slab instead of the free lists. This is used by
+    \c TmTreemap::compactNodes to lay out subtrees in DFS order.
+
+    Nodes are only allocated and deleted by the calling thread, the
+    buffer caches only by their own thread. So there is no locking.
+ */
+class TmAllocator
+{
+ public:
+  //! Empty pool for one thread
+  TmAllocator ();
+
+  //! Frees all slabs and cached buffers
+  ~TmAllocator ();  
+
+  //! Allocates \c size bytes from the pool
+  void* allocate (size_t size);  
+
+  //! Allocates \c size bytes on the heap, but with a header so \c deallocate can free it
+  static void* allocateOnHeap (size_t size);  
+
+  //! Frees \c p allocated by \c allocate or \c allocateOnHeap
+  static void deallocate (void* p);  
+
+  //! Size of the block in the pool that holds \c p or \c 0 if \c p is on the heap
+  /*! The block of the next object allocated contiguously starts at
+      \c (char*)p+blockSize(p). */
+  static int blockSize (const void* p);  
+
+  //! Size of the block \c allocate uses for \c size bytes or \c 0 if it uses the heap
+  static int blockSizeFor (size_t size);  
+
+  //! Number of bytes \c p has been allocated with
+  static int sizeOf (const void* p);  
+
+  //! In contiguous mode \c allocate ignores the free lists
+  void setContiguous (bool on) {isContiguous = on;}  
+
+  //! Ensures the next \c bytes bytes can be allocated contiguously
+  /*! Starts a new slab (larger than usual if needed) if the current
+      one has not enough space left. */
+  void reserveContiguous (int bytes);  
+
+  //! Sets the number of threads having their own buffer caches
+  void setNrOfThreads (int n);  
+
+  //! Scratch memory of \c TmNode::updateGaussian for one thread
+  /*! The new Gaussian of a node is computed in \c gaussian and then
+      compressed into the node's buffers, which are exchanged via the
+      caches only when they have the wrong size. So once all buffers
+      have grown large enough an update does not allocate memory. */
+  class ThreadBuffers 
+    {
+    public:
+      ThreadBuffers () :floats(), featureLists(), gaussian(), featureList(), column(), columnOfFeature(),
+        nrOfAllocations(0), nrOfMixedPrecisionFallbacks(0) {}
+      
+      //! Cache for \c TmGaussian::RCompressed
+      TmBufferCache<float> floats;
+
+      //! Cache for \c TmGaussian::feature
+      TmBufferCache<TmExtendedFeatureId> featureLists;
+
+      //! Scratch Gaussian, only \c R and \c feature are used
+      TmGaussian gaussian;
+
+      //! Scratch feature list
+      TmExtendedFeatureList featureList;      
+
+      //! Scratch column map for \c TmGaussian::multiplyTriangular
+      XycVector<int> column;      
+
+      //! Scratch index from feature id to column, see \c TmGaussian::indexColumns
+      /*! All entries are -1 between two uses. */
+      XycVector<int> columnOfFeature;      
+
+      //! Number of times \c gaussian, \c featureList, \c column or \c columnOfFeature had to grow (see \c reserve)
+      long int nrOfAllocations;      
+
+      //! Number of nodes recomputed in double by \c TmNode::updateGaussian (\c TmTreemap::mixedPrecisionDiagonalRatio)
+      long int nrOfMixedPrecisionFallbacks;      
+
+      //! Makes the scratch memory large enough for \c n features, \c rows rows and \c columns mapped columns
+      /*! \c gaussian.R grows to the maximum size requested so far,
+          so different shapes do not lead to reallocation. \c
+          columnOfFeature grows to \c nrOfFeatures entries. */
+      void reserve (int n, int rows, int columns=0, int nrOfFeatures=0);      
+
+      //! Memory consumption in bytes
+      int memory () const;      
+    };  
+
+  //! Scratch memory for thread \c thread
+  ThreadBuffers& threadBuffers (int thread) {return threadBuffer[thread];}  
+
+  //! Total number of heap allocations in \c ThreadBuffers (for benchmarking)
+  long int nrOfAllocations () const;  
+
+  //! Total number of \c ThreadBuffers::nrOfMixedPrecisionFallbacks
+  long int nrOfMixedPrecisionFallbacks () const;  
+
+  //! Frees all cached buffers, but keeps the slabs
+  void clearBuffers ();  
+
+  //! Memory consumption in bytes, not counting blocks in use
+  /*! The blocks in use are counted by the nodes themselves. */
+  int memory () const;  
+
+ protected:
+  //! Granularity of block sizes and alignment of blocks
+  enum {GRANULARITY = 16};
+  //! Number of size classes, larger blocks are allocated on the heap
+  enum {NR_OF_SIZE_CLASSES = 64};  
+  //! Size of a slab
+  enum {SLAB_SIZE = 64*1024};  
+  
+  //! Stored in front of every block
+  class Header 
+    {
+    public:
+      //! Pool the block has been allocated from or \c NULL for the heap
+      TmAllocator* owner;
+      //! Size class of the block or \c -1 for the heap
+      int sizeClass;      
+      //! Number of bytes requested
+      int size;      
+    };
+  //! Size of the header rounded up to \c GRANULARITY
+  enum {HEADER_SIZE = ((sizeof(Header)+GRANULARITY-1)/GRANULARITY)*GRANULARITY};  
+
+  //! A free block, linked through its own memory
+  class FreeBlock 
+    {
+    public:
+      FreeBlock* next;      
+    };  
+
+  //! List of free blocks for every size class
+  FreeBlock* freeList[NR_OF_SIZE_CLASSES];  
+
+  //! All slabs allocated
+  XycVector<char*> slab;
+
+  //! Sum of the size of all slabs
+  int slabBytes;  
+
+  //! Unused part of the last slab (\c slabPos..slabEnd)
+  char *slabPos, *slabEnd;  
+
+  //! Bytes in blocks given out by \c allocate
+  int bytesInUse;  
+
+  //! See \c setContiguous
+  bool isContiguous;  
+
+  //! Scratch memory of every thread
+  XycVector<ThreadBuffers> threadBuffer;  
+
+ private:
+  //! Not implemented, nodes belong to exactly one pool
+  TmAllocator (const TmAllocator&);
+  //! Not implemented, nodes belong to exactly one pool
+  TmAllocator& operator= (const TmAllocator&);  
+};
+
+
+#endif
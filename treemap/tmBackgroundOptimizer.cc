@@ -0,0 +1,315 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!\file tmBackgroundOptimizer.cc 
+   \brief Implementation of \c TmBackgroundOptimizer
+   \author Udo Frese
+
+  Contains the implementation of class \c TmBackgroundOptimizer which
+  performs the HTP optimization of a treemap in a separate thread.
+*/
+#include "tmBackgroundOptimizer.h"
+#include <stdexcept>
+
+TmBackgroundOptimizer::TmBackgroundOptimizer (TmTreemap* tree)
+  :maxNrOfRuns (100), tree(tree), snapshot(), lca(), moves(), runStart(), optimal(),
+   hasWork(false), hasResult(false), shutdown(false)
+{
+  snapshot.optimizer.create (&snapshot, tree->optimizer.nrOfMovesPerStep, tree->optimizer.maxNrOfUnsuccessfulMoves);
+  snapshot.optimizer.mayJoin = false;
+  snapshot.optimizer.moveLog = &moves;  
+  snapshot.isGaussianValidValid = false; // Gaussians are not copied
+  pthread_mutex_init (&mutex, NULL);
+  pthread_cond_init (&wakeUp, NULL);
+  pthread_cond_init (&finished, NULL);  
+  if (pthread_create (&thread, NULL, &threadMain, this)!=0) 
+    throw runtime_error ("Could not create thread for TmBackgroundOptimizer");
+}
+
+
+TmBackgroundOptimizer::~TmBackgroundOptimizer ()
+{
+  pthread_mutex_lock (&mutex);
+  shutdown = true;
+  pthread_cond_signal (&wakeUp);  
+  pthread_mutex_unlock (&mutex);
+  pthread_join (thread, NULL);
+  clearSnapshot ();  
+  pthread_cond_destroy (&finished);
+  pthread_cond_destroy (&wakeUp);
+  pthread_mutex_destroy (&mutex);  
+}
+
+
+void TmBackgroundOptimizer::synchronize ()
+{
+  pthread_mutex_lock (&mutex);
+  bool isBusy = hasWork;
+  pthread_mutex_unlock (&mutex);
+  if (isBusy) return;
+  if (hasResult) apply ();
+  start ();
+}
+
+
+void TmBackgroundOptimizer::finish ()
+{
+  waitUntilIdle ();
+  if (hasResult) apply ();
+}
+
+
+void TmBackgroundOptimizer::discard ()
+{
+  waitUntilIdle ();
+  hasResult = false;  
+  lca.clear();  
+  clearSnapshot ();  
+}
+
+
+void TmBackgroundOptimizer::waitUntilIdle ()
+{
+  pthread_mutex_lock (&mutex);
+  while (hasWork) pthread_cond_wait (&finished, &mutex);
+  pthread_mutex_unlock (&mutex);
+}
+
+
+int TmBackgroundOptimizer::memory () const
+{
+  int mem = sizeof (TmBackgroundOptimizer);
+  mem += snapshot.memory () - sizeof (TmTreemap);
+  mem += moves.capacity() * sizeof (TmTreemap::MoveIndices);
+  mem += (runStart.capacity() + optimal.capacity()) * sizeof (int);
+  return mem;  
+}
+
+
+void TmBackgroundOptimizer::start ()
+{
+  TmOptimizationQueue& queue = tree->optimizer.optimizationQueue;
+  if (queue.empty() || tree->root==NULL) return;  
+  tree->updateFeaturePassed ();
+  // Nodes of the last round are reused, so copying needs no allocation
+  if (snapshot.node.size()<tree->node.size()) snapshot.node.resize (tree->node.size(), NULL);
+  for (int i=0; i<(int) snapshot.node.size(); i++) 
+    if (snapshot.node[i]!=NULL && tree->getNode(i)==NULL) {
+      delete snapshot.node[i];
+      snapshot.node[i] = NULL;      
+    }
+  snapshot.feature = tree->feature;  
+  for (int i=0; i<TmTreemap::MAX_FEATURE_BLOCK_SIZE; i++) snapshot.firstUnusedFeature[i] = tree->firstUnusedFeature[i];
+  snapshot.unusedNodes   = tree->unusedNodes;
+  snapshot.stat.nrOfNodes = tree->stat.nrOfNodes;  
+  snapshot.optimizer.optimizationQueue.clear();
+  snapshot.optimizer.lcaIndex = -1;
+  snapshot.optimizer.maxNrOfUnsuccessfulMoves = tree->optimizer.maxNrOfUnsuccessfulMoves;  
+  snapshot.optimizer.prioritizeCriticalPath   = tree->optimizer.prioritizeCriticalPath;
+  lca.clear();  
+  while (!queue.empty()) {
+    TmNode* n = tree->getNode (queue.front());
+    queue.pop_front ();
+    if (n==NULL || n->isFlag (TmNode::IS_OPTIMIZED)) continue;
+    n->setFlag (TmNode::IS_OPTIMIZED);
+    lca.push_back (n->index);    
+    snapshot.optimizer.optimizationQueue.push (n->index, tree->optimizer.priority (n));
+  }
+  snapshot.root = copyStructure (tree->root, NULL);  
+  // Let the copied features refer to the nodes of the snapshot
+  for (int i=0; i<(int) snapshot.feature.size(); i++) {
+    TmNode*& mn = snapshot.feature[i].marginalizationNode;
+    if (mn!=NULL) mn = snapshot.node[mn->index];    
+  }  
+  // In the snapshot these nodes are waiting in the queue
+  for (int i=0; i<(int) lca.size(); i++) snapshot.node[lca[i]]->resetFlag (TmNode::IS_OPTIMIZED);
+  moves.clear();
+  runStart.clear();
+  optimal.clear();  
+
+  pthread_mutex_lock (&mutex);
+  hasWork = true;
+  pthread_cond_signal (&wakeUp);
+  pthread_mutex_unlock (&mutex);
+}
+
+
+bool TmBackgroundOptimizer::getMove (const TmTreemap::MoveIndices& mi, TmTreemap::Move& move) const
+{
+  TmNode* subtree  = tree->getNode (mi.subtreeIndex);
+  TmNode* above    = tree->getNode (mi.aboveIndex);
+  TmNode* oldAbove = tree->getNode (mi.oldAboveIndex);
+  if (subtree==NULL || above==NULL || oldAbove==NULL || subtree->parent==NULL) return false;
+  if (above->isAncestor (subtree) || !subtree->isFlag (TmNode::CAN_BE_MOVED)) return false;
+  move = TmTreemap::Move (subtree, above);
+  return move.oldAbove==oldAbove;
+}
+
+
+void TmBackgroundOptimizer::apply ()
+{
+  hasResult = false;
+  bool hasFailed = false;
+  XycVector<TmTreemap::Move> done;  
+  for (int r=0; r+1<(int) runStart.size(); r++) {
+    bool isValid = true;
+    done.clear();
+    for (int i=runStart[r]; i<runStart[r+1]; i++) {
+      TmTreemap::Move move;
+      if (!getMove (moves[i], move)) {
+        isValid = false;
+        break;
+      }
+      move.doIt ();
+      done.push_back (move);
+    }
+    if (!isValid) {
+      for (int i=(int) done.size()-1; i>=0; i--) {
+        done[i].subtree->moveTo (done[i].oldAbove, false);
+        done[i].subtree->makeChildNr (done[i].whichChild);
+      }
+      hasFailed = true;
+    }
+  }
+
+  // Nodes left in the snapshot's queue have to be optimized again. An
+  // index may have been reused for a leaf in the meantime.
+  TmOptimizationQueue& queue = snapshot.optimizer.optimizationQueue;  
+  for (int i=0; i<(int) queue.size(); i++) {
+    TmNode* n = tree->getNode (queue[i]);
+    if (n!=NULL && !n->isLeaf()) n->setToBeOptimized ();
+  }
+  if (hasFailed) 
+    for (int i=0; i<(int) lca.size(); i++) {
+      TmNode* n = tree->getNode (lca[i]);
+      if (n!=NULL && !n->isLeaf()) n->setToBeOptimized ();
+    }
+  lca.clear();  
+  
+  // Sparsification is left to the application thread
+  for (int i=0; i<(int) optimal.size(); i++) {
+    TmNode* n = tree->getNode (optimal[i]);
+    if (n!=NULL && n->isFlag (TmNode::IS_OPTIMIZED)) tree->checkForSparsification (n);
+  }
+  
+  XycVector<TmTreemap::TreemapStatistics::HTPEntry>& htp = snapshot.stat.htp;  
+  for (int i=0; i<(int) htp.size(); i++) {
+    if (i>=(int) tree->stat.htp.size()) tree->stat.htp.resize (i+1);
+    tree->stat.htp[i].success   += htp[i].success;
+    tree->stat.htp[i].noSuccess += htp[i].noSuccess;
+  }
+  htp.clear();  
+  tree->optimizer.report += snapshot.optimizer.getAndClearReport ();
+  tree->updateFeaturePassed ();  
+}
+
+
+TmNode* TmBackgroundOptimizer::copyStructure (const TmNode* src, TmNode* parent)
+{
+  TmNode* n = snapshot.node[src->index];
+  if (n==NULL) {
+    n = new TmNode;
+    n->index = src->index;
+    n->tree  = &snapshot;
+    snapshot.node[n->index] = n;  
+  }  
+  n->parent                    = parent;
+  n->updateCost                = src->updateCost;
+  n->worstCaseUpdateCost       = src->worstCaseUpdateCost;
+  n->featurePassed             = src->featurePassed;
+  n->linearizationPointFeature = src->linearizationPointFeature;
+  n->firstFeaturePassed        = src->firstFeaturePassed;
+  n->status                    = src->status;
+  if (src->isLeaf()) {
+    n->child[0] = n->child[1] = NULL;
+    n->gaussian.feature                   = src->gaussian.feature;
+    n->gaussian.linearizationPointFeature = src->gaussian.linearizationPointFeature;
+#if ASSERT_LEVEL>=2
+    // The snapshot does not copy the frozen leaves, so for the feature
+    // counts checked in \c TmTreemap::assertIt a frozen node must
+    // look like the leaf obtained by joining its subtree.
+    if (src->isFrozen()) tree->computeFeaturesInvolvedBelow ((TmNode*) src, n->gaussian.feature);
+#endif
+  }
+  else {
+    n->child[0] = copyStructure (src->child[0], n);
+    n->child[1] = copyStructure (src->child[1], n);
+  }  
+  return n;  
+}
+
+
+void TmBackgroundOptimizer::clearSnapshot ()
+{
+  for (int i=0; i<(int) snapshot.node.size(); i++) {
+    delete snapshot.node[i];
+    snapshot.node[i] = NULL;    
+  }
+  snapshot.root = NULL;  
+}
+
+
+void TmBackgroundOptimizer::optimize ()
+{
+  TmTreemap::Optimizer& opt = snapshot.optimizer;  
+  for (int i=0; i<maxNrOfRuns && !opt.optimizationQueue.empty(); i++) {
+    TmNode* n = snapshot.getNode (opt.optimizationQueue.front());
+    runStart.push_back (moves.size());
+    opt.oneKLRun ();
+    if (opt.lcaIndex<0 && n!=NULL && n->isFlag (TmNode::IS_OPTIMIZED)) optimal.push_back (n->index);
+  }  
+  runStart.push_back (moves.size());
+}
+
+
+void TmBackgroundOptimizer::threadLoop ()
+{
+  pthread_mutex_lock (&mutex);
+  while (true) {
+    while (!hasWork && !shutdown) pthread_cond_wait (&wakeUp, &mutex);
+    if (shutdown) break;
+    pthread_mutex_unlock (&mutex);
+    optimize ();
+    pthread_mutex_lock (&mutex);
+    hasWork   = false;
+    hasResult = true;
+    pthread_cond_broadcast (&finished);    
+  }
+  pthread_mutex_unlock (&mutex);
+}
+
+
+void* TmBackgroundOptimizer::threadMain (void* arg)
+{
+  ((TmBackgroundOptimizer*) arg)->threadLoop ();
+  return NULL;  
+}
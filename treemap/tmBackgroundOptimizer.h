@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TMBACKGROUNDOPTIMIZER_H
+#define TMBACKGROUNDOPTIMIZER_H
+
+
+/*!\file tmBackgroundOptimizer.h
+   \brief Class \c TmBackgroundOptimizer running the HTP optimization in a separate thread
+
+   \author Udo Frese
+*/
+
+#include "tmTreemap.h"
+#include <pthread.h>
+
+//! Runs the HTP/KL optimization of a \c TmTreemap in a background thread
+/*! The optimizer works in rounds. At the start of a round the
+    application thread takes the next node from \c
+    TmTreemap::Optimizer::optimizationQueue and copies the structure of
+    its subtree into \c snapshot. That is the nodes with their \c
+    featurePassed lists, costs and flags and the leaves' feature lists
+    but not the Gaussians. The background thread then performs KL runs
+    (\c TmTreemap::Optimizer::oneKLRun) on \c snapshot and records the
+    moves made permanent. The next time the application reaches a safe
+    point (\c synchronize) it applies these moves to the tree.
+
+    In the meantime the application may have changed the tree. So
+    before applying a move it is checked that both nodes still exist
+    and the node moved still has the same sibling as in the
+    snapshot. If not, the KL run is undone and the remaining result
+    is dropped. The tree is valid in any case, just less well
+    optimized. Joining leaves is not done in the background, because
+    it needs the Gaussians. The application thread still does this when
+    adding leaves.
+
+    All member functions must be called from the application thread.
+*/
+class TmBackgroundOptimizer 
+{
+ public:
+  //! Creates the background thread optimizing \c tree
+  TmBackgroundOptimizer (TmTreemap* tree);
+
+  //! Drops a running round and joins the background thread
+  ~TmBackgroundOptimizer ();
+
+  //! Exchanges results with the background thread at a safe point
+  /*! If the background thread is still busy nothing is done, so the
+      call never blocks. Otherwise the moves found in the last round
+      are applied to \c tree and a new round is started for the next
+      node in \c tree->optimizer.optimizationQueue.
+  */
+  void synchronize ();
+
+  //! Waits for the background thread and applies its result
+  void finish ();  
+
+  //! Waits for the background thread and drops its result
+  /*! Used before the tree is cleared or overwritten. */
+  void discard ();  
+
+  //! Index of the node optimized in the current round or -1
+  /*! The node has \c TmNode::IS_OPTIMIZED set while being optimized
+      but is not in the optimization queue. */
+  const XycVector<int>& nodesBeingOptimized () const {return lca;}  
+
+  //! Maximal number of KL runs in one round
+  int maxNrOfRuns;  
+
+  //! Memory consumption in bytes
+  int memory () const;  
+
+ protected:
+  //! The tree being optimized
+  TmTreemap* tree;  
+
+  //! Copy of the structure of \c tree as of the start of the round
+  /*! Node and feature indices are the same as in \c tree. The nodes
+      are kept between rounds. \c TmFeature::marginalizationNode in
+      \c snapshot.feature may point to nodes of \c tree and is only
+      overwritten. */
+  TmTreemap snapshot;  
+
+  //! Nodes taken from \c tree->optimizer.optimizationQueue for the current round
+  XycVector<int> lca;  
+
+  //! Moves made permanent by the background thread
+  XycVector<TmTreemap::MoveIndices> moves;
+
+  //! The \c i-th KL run made \c moves[runStart[i]..runStart[i+1]-1] 
+  XycVector<int> runStart;  
+
+  //! Nodes the background thread found to be optimal
+  XycVector<int> optimal;  
+
+  //! Set when a round is started, reset when it is finished
+  bool hasWork;
+
+  //! Set when a round is finished and the result is not yet applied
+  bool hasResult;  
+
+  //! Set to stop the background thread
+  bool shutdown;  
+
+  //! Protects \c hasWork, \c hasResult and \c shutdown
+  pthread_mutex_t mutex;
+
+  //! Signalled when a round is started or the thread shall stop
+  pthread_cond_t wakeUp;
+
+  //! Signalled when a round is finished
+  pthread_cond_t finished;  
+
+  //! The background thread
+  pthread_t thread;  
+
+  //! Starts a round for the next node in the optimization queue
+  void start ();
+
+  //! Applies \c moves to \c tree
+  void apply ();
+
+  //! Waits until the background thread is idle
+  void waitUntilIdle ();  
+
+  //! Recursively copies the structure of \c src into \c snapshot
+  /*! Reuses the node with the same index in \c snapshot if there is one. */
+  TmNode* copyStructure (const TmNode* src, TmNode* parent);
+
+  //! Deletes all nodes of \c snapshot
+  void clearSnapshot ();  
+
+  //! Converts \c mi into a move in \c tree
+  /*! Returns \c false if the move is not possible any more or
+      the tree has changed around it since the snapshot. */
+  bool getMove (const TmTreemap::MoveIndices& mi, TmTreemap::Move& move) const;  
+
+  //! Performs the KL runs on \c snapshot (background thread)
+  void optimize ();  
+
+  //! Main loop of the background thread
+  void threadLoop ();  
+
+  //! Entry point for \c pthread_create
+  static void* threadMain (void* arg);  
+
+ private:
+  //! The optimizer cannot be copied
+  TmBackgroundOptimizer (const TmBackgroundOptimizer&);
+  TmBackgroundOptimizer& operator= (const TmBackgroundOptimizer&);  
+};
+
+
+#endif
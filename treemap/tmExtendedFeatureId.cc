@@ -261,3 +261,12 @@ int nrOfIntersecting (const TmExtendedFeatureList& a, const TmExtendedFeatureLis
   }
   return ctr;  
 }
+
+
+void renumber (TmExtendedFeatureList& list, const TmFeatureList& newId)
+{
+  for (int i=0; i<(int) list.size(); i++) {
+    list[i].id = newId[list[i].id];
+    assert (list[i].id>=0);
+  }
+}
@@ -79,10 +79,18 @@ class TmExtendedFeatureId
     }  
 };
 
+//! Feature ids are plain data, so lists grow by \c realloc
+XYC_USE_REALLOC(TmExtendedFeatureId)
+
 //! A list of features with corresponding counters
 /*! The list is sorted by ascenting \c .id unless noted otherwise.
+
+    Up to 8 entries are stored inside the list without heap memory.
+    This covers the leaves of the 2D drivers (at most 6 features)
+    and many of the temporary lists used in the optimization. A
+    larger inline capacity would be wasted on every inner node.
  */
-typedef XycVector<TmExtendedFeatureId> TmExtendedFeatureList;
+typedef XycSmallVector<TmExtendedFeatureId, 8> TmExtendedFeatureList;
 
 //! Returns whether \c id is contained in \c list.
 bool isElement (const TmExtendedFeatureList& list, TmFeatureId id);
@@ -112,6 +120,10 @@ bool isIntersectionEmpty (const TmExtendedFeatureList& a, const TmExtendedFeatur
 /*! \c a and \c b may be unsorted. */
 int nrOfIntersecting (const TmExtendedFeatureList& a, const TmExtendedFeatureList& b);
 
+//! Replaces every id \c i in \c list by \c newId[i]
+/*! See \c TmTreemap::renumberFeatures. */
+void renumber (TmExtendedFeatureList& list, const TmFeatureList& newId);
+
 
 //! Function to convert a landmark id to a string name consisting of noncapital letters.
 /*! The name is stored into \c txt (with 0 termination) and the length
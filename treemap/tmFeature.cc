@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*!\file tmFeature.cc
+   \brief Implementation of \c TmFeatureArray
+   \author Udo Frese
+*/
+
+#include "tmFeature.h"
+
+// Features \c f[i+PREFETCH_DISTANCE] are prefetched when gathering \c f[i]
+#define PREFETCH_DISTANCE 8
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch (p)
+#else
+#define PREFETCH(p)
+#endif
+
+TmFeatureArray::TmFeatureArray ()
+  :est(), marginalizationNode(), multiPurposeField()
+{}
+
+
+void TmFeatureArray::resize (int n)
+{
+  est.resize (n, tmNan);
+  marginalizationNode.resize (n, NULL);
+  multiPurposeField.resize (n, 0);
+}
+
+
+void TmFeatureArray::reserve (int n)
+{
+  est.reserve (n);
+  marginalizationNode.reserve (n);
+  multiPurposeField.reserve (n);
+}
+
+
+void TmFeatureArray::clear ()
+{
+  est.clear ();
+  marginalizationNode.clear ();
+  multiPurposeField.clear ();
+}
+
+
+void TmFeatureArray::renumber (const TmFeatureList& newId, int n)
+{
+  // Features are only moved down, so this works in place
+  for (int i=0; i<size(); i++) {
+    int j = newId[i];
+    if (j<0) continue;
+    assert (j<=i);
+    est[j]                 = est[i];
+    marginalizationNode[j] = marginalizationNode[i];
+    multiPurposeField[j]   = multiPurposeField[i];
+  }
+  est.resize (n);
+  marginalizationNode.resize (n);
+  multiPurposeField.resize (n);
+}
+
+
+int TmFeatureArray::memory () const
+{
+  return est.memory() + marginalizationNode.memory() + multiPurposeField.memory();
+}
+
+
+void TmFeatureArray::gatherEstimates (const TmExtendedFeatureId* f, int n, float* v) const
+{
+  const float* e = est.begin();
+  int i = 0;
+  for (; i<n-PREFETCH_DISTANCE; i++) {
+    PREFETCH (e + f[i+PREFETCH_DISTANCE].id);
+    v[i] = e[f[i].id];
+  }
+  for (; i<n; i++) v[i] = e[f[i].id];
+}
+
+
+void TmFeatureArray::gatherEstimatesReversed (const TmExtendedFeatureId* f, int n, float* v) const
+{
+  const float* e = est.begin();
+  int i = 0;
+  for (; i<n-PREFETCH_DISTANCE; i++) {
+    PREFETCH (e + f[n-1-i-PREFETCH_DISTANCE].id);
+    v[i] = e[f[n-1-i].id];
+  }
+  for (; i<n; i++) v[i] = e[f[n-1-i].id];
+}
+
+
+void TmFeatureArray::scatterEstimatesReversed (const TmExtendedFeatureId* f, int n, const float* v)
+{
+  float* e = est.begin();
+  for (int i=0; i<n; i++) e[f[n-1-i].id] = v[i];
+}
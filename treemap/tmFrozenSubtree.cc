@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*!\file tmFrozenSubtree.cc 
+   \brief Implementation of class \c TmFrozenSubtree
+   \author Udo Frese
+
+  Contains the implementation of class \c TmFrozenSubtree, the packed
+  nodes below a \c TmNode that will not change any more.
+*/
+#include "tmFrozenSubtree.h"
+#include "tmNode.h"
+#include "tmFeature.h"
+#include <string.h>
+#include <new>
+
+
+//! Stores \c v in groups of 7 bits at \c p, setting bit 7 if more follow
+static void putVarint (unsigned int v, unsigned char*& p)
+{
+  while (v>=128) {
+    *p++ = (unsigned char) (v | 128);
+    v >>= 7;
+  }
+  *p++ = (unsigned char) v;
+}
+
+
+//! Reads a number stored by \c putVarint at \c p
+static unsigned int getVarint (const unsigned char*& p)
+{
+  unsigned int v = 0;
+  int shift = 0;
+  while (*p & 128) {
+    v |= (unsigned int) (*p++ & 127) << shift;
+    shift += 7;
+  }
+  v |= (unsigned int) *p++ << shift;
+  return v;
+}
+
+
+//! Bytes \c putVarint needs for \c v
+static int varintSize (unsigned int v)
+{
+  int bytes = 1;
+  for (; v>=128; v >>= 7) bytes++;
+  return bytes;
+}
+
+
+//! Maps differences of small magnitude to small unsigned numbers (0,-1,1,-2,...)
+static unsigned int zigzag (int d)
+{
+  return ((unsigned int) d << 1) ^ (unsigned int) (d>>31);
+}
+
+
+//! Inverse of \c zigzag
+static int unzigzag (unsigned int u)
+{
+  return (int) (u>>1) ^ -(int) (u&1);
+}
+
+
+int TmFrozenNode::size (const TmExtendedFeatureList& fl, bool isLeaf)
+{
+  int n = fl.size();  
+  int bytes = sizeof (TmFrozenNode) + TmGaussian::rCompressedSize (n+1)*sizeof(float);
+  int last = 0;
+  for (int i=0; i<n; i++) {
+    bytes += varintSize (zigzag (fl[i].id-last));
+    last = fl[i].id;
+    if (isLeaf) bytes += varintSize (fl[i].count);
+  }
+  return (bytes+7) & ~7;  // keep the following header 8 byte aligned
+}
+
+
+const unsigned char* TmFrozenNode::encodedFeatures () const
+{
+  return (const unsigned char*) (RCompressed() + TmGaussian::rCompressedSize (n+1));
+}
+
+
+void TmFrozenNode::encodeFeatures (const TmExtendedFeatureList& fl, bool isLeaf, unsigned char*& p)
+{
+  int last = 0;
+  for (int i=0; i<(int) fl.size(); i++) {
+    putVarint (zigzag (fl[i].id-last), p);
+    last = fl[i].id;
+    if (isLeaf) putVarint (fl[i].count, p);
+  }
+}
+
+
+void TmFrozenNode::getFeatures (TmExtendedFeatureList& fl) const
+{
+  fl.resizeWithUndefinedData (n);
+  const unsigned char* p = encodedFeatures ();
+  int id = 0;
+  for (int i=0; i<n; i++) {
+    id += unzigzag (getVarint (p));
+    fl[i].id = id;
+    fl[i].count = isLeaf() ? (int) getVarint (p) : 0;
+  }
+}
+
+
+void TmFrozenNode::getGaussian (TmGaussian& g) const
+{
+  g.clear ();
+  g.freeQuantized ();  
+  g.isTriangular = true;
+  getFeatures (g.feature);
+  int rSize = TmGaussian::rCompressedSize (n+1);  
+  g.RCompressed.resizeWithUndefinedData (rSize);
+  memcpy (g.RCompressed.begin(), RCompressed(), rSize*sizeof(float));
+  g.linearizationPointFeature = linearizationPointFeature;
+  g.linearizationPoint        = linearizationPoint;
+}
+
+
+TmFrozenSubtree::TmFrozenSubtree (const TmFrozenSubtree& f)
+  :block(NULL)
+{
+  *this = f;
+}
+
+
+TmFrozenSubtree& TmFrozenSubtree::operator= (const TmFrozenSubtree& f)
+{
+  if (&f==this) return *this;
+  clear ();
+  if (!f.empty()) {
+    block = (char*) malloc (f.memory());
+    if (block==NULL) throw std::bad_alloc();    
+    memcpy (block, f.block, f.memory());
+  }
+  return *this;  
+}
+
+
+void TmFrozenSubtree::clear ()
+{
+  free (block);
+  block = NULL;  
+}
+
+
+void TmFrozenSubtree::create (const TmNode* s)
+{
+  assert (!s->isLeaf());  
+  clear ();  
+  int size = sizeof (Header), nrOfNodes = 0;
+  sizeBelow (s, size, nrOfNodes);
+  block = (char*) malloc (size);
+  if (block==NULL) throw std::bad_alloc();    
+  Header* h = (Header*) block;
+  h->nrOfNodes = nrOfNodes;
+  h->size      = size;  
+  char* p = block + sizeof(Header);
+  storeBelow (s, p);
+  assert (p==block+size);  
+}
+
+
+void TmFrozenSubtree::sizeBelow (const TmNode* n, int& size, int& nrOfNodes)
+{
+  if (n->isFrozen()) {
+    size += n->frozen.memory() - sizeof(Header);
+    nrOfNodes += n->frozen.nrOfNodes();
+  }  
+  else if (!n->isLeaf()) 
+    for (int k=0; k<2; k++) {
+      const TmNode* c = n->child[k];      
+      size += TmFrozenNode::size (c->gaussian.feature, c->isLeaf() && !c->isFrozen());
+      nrOfNodes++;
+      sizeBelow (n->child[k], size, nrOfNodes);
+    }  
+}
+
+
+void TmFrozenSubtree::storeBelow (const TmNode* n, char*& p)
+{
+  if (n->isFrozen()) {
+    int size = n->frozen.memory() - sizeof(Header);
+    memcpy (p, n->frozen.begin(), size);
+    p += size;    
+  }  
+  else if (!n->isLeaf()) 
+    for (int k=0; k<2; k++) {
+      storeNode (n->child[k], p);
+      storeBelow (n->child[k], p);
+    }  
+}
+
+
+void TmFrozenSubtree::storeNode (const TmNode* n, char*& p)
+{
+  const TmGaussian& g = n->gaussian;  
+  assert (g.isCompressed());  
+  TmFrozenNode h;
+  h.status = n->status;
+  // A frozen node is stored as the inner node it has been
+  if (n->isFrozen()) h.status |= TmNode::CAN_BE_INTEGRATED;  
+  else if (n->isLeaf()) h.status |= TmFrozenNode::IS_LEAF;
+  h.firstFeaturePassed        = n->firstFeaturePassed;
+  h.linearizationPointFeature = g.linearizationPointFeature;
+  h.linearizationPoint        = g.linearizationPoint;
+  if (g.isQuantized()) {
+    XycVector<float> dequantized;
+    g.dequantizeR (dequantized);
+    storeNode (h, g.feature, dequantized.begin(), p);
+  }
+  else storeNode (h, g.feature, g.RCompressed.begin(), p);
+}
+
+
+void TmFrozenSubtree::storeNode (const TmFrozenNode& h, const TmExtendedFeatureList& fl, const float* r, char*& p)
+{
+  TmFrozenNode* fn = (TmFrozenNode*) p;
+  *fn = h;
+  fn->n     = fl.size();
+  fn->bytes = TmFrozenNode::size (fl, fn->isLeaf());
+  int rSize = TmGaussian::rCompressedSize (fn->n+1);  
+  memcpy ((float*) fn->RCompressed(), r, rSize*sizeof(float));
+  unsigned char* f = (unsigned char*) (fn->RCompressed()+rSize);
+  TmFrozenNode::encodeFeatures (fl, fn->isLeaf(), f);
+  p += fn->bytes;  
+  memset (f, 0, p-(char*) f);
+}
+
+
+void TmFrozenSubtree::renumber (const TmFeatureList& newId)
+{
+  if (empty()) return;
+  TmExtendedFeatureList fl;  
+  int size = sizeof (Header);
+  for (const TmFrozenNode* fn=begin(); fn!=end(); fn=fn->next()) {
+    fn->getFeatures (fl);
+    ::renumber (fl, newId);
+    size += TmFrozenNode::size (fl, fn->isLeaf());
+  }
+  TmFrozenSubtree f;
+  f.block = (char*) malloc (size);
+  if (f.block==NULL) throw std::bad_alloc();    
+  Header* h = (Header*) f.block;
+  h->nrOfNodes = nrOfNodes();
+  h->size      = size;  
+  char* p = f.block + sizeof(Header);
+  for (const TmFrozenNode* fn=begin(); fn!=end(); fn=fn->next()) {
+    fn->getFeatures (fl);
+    ::renumber (fl, newId);
+    storeNode (*fn, fl, fn->RCompressed(), p);
+  }
+  assert (p==f.block+size);  
+  swap (f);  
+}
+
+
+void TmFrozenSubtree::estimate (TmFeatureArray& feature, XycVector<float>& workspace, TmExtendedFeatureList& fl) const
+{
+  for (const TmFrozenNode* fn=begin(); fn!=end(); fn=fn->next()) {
+    int fFP = fn->firstFeaturePassed;
+    if (fFP==0) continue;
+    fn->getFeatures (fl);
+    // Same as \c TmNode::estimateMarginalized
+    workspace.resize (fn->n+5);
+    float* v = workspace.begin();
+    *v = 1;
+    v++;
+    const TmExtendedFeatureId* f = fl.begin();
+    int nPassed = fn->n - fFP;
+    feature.gatherEstimatesReversed (f+fFP, nPassed, v);
+    v += nPassed;    
+    TmGaussian::meanCompressed (fn->RCompressed(), fn->n+1, workspace.begin(), fFP);
+    feature.scatterEstimatesReversed (f, fFP, v);    
+  }  
+}
@@ -0,0 +1,225 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef TMFROZENSUBTREE_H
+#define TMFROZENSUBTREE_H
+
+/*!\file tmFrozenSubtree.h 
+   \brief Class \c TmFrozenSubtree
+   \author Udo Frese
+
+  Contains the class \c TmFrozenSubtree, a packed representation of
+  the nodes below a \c TmNode that will not change any more.
+*/
+
+#include "tmTypes.h"
+#include "tmExtendedFeatureId.h"
+
+class TmNode;
+class TmGaussian;
+class TmFeatureArray;
+
+
+//! A node of a \c TmFrozenSubtree
+/*! Keeps only what is needed for estimation and for rebuilding the
+    \c TmNode: the columns of the Gaussian (\c TmGaussian::feature),
+    \c TmNode::firstFeaturePassed and \c TmGaussian::RCompressed. The
+    header is directly followed by the \c TmGaussian::rCompressedSize
+    (n+1) floats of \c RCompressed and then by the feature ids.
+    Everything else of the node (\c TmNode::featurePassed, costs,
+    \c TmNode::linearizationPointFeature) can be computed from this
+    and the node's children.
+
+    The ids are stored as the difference to the previous id (the
+    first to 0) in a variable length code of 7 bits per byte, since
+    ids in a node are mostly sorted and close to each other. Mostly
+    one byte is needed instead of the eight of a \c TmExtendedFeatureId.
+    Counts are stored the same way for leaves only. For an inner node
+    they are the counts of \c TmNode::featurePassed plus the counts of
+    the features the children pass (see \c TmGaussian::multiplyTriangular)
+    and are recomputed by \c TmTreemap::thawSubtree.
+ */
+class TmFrozenNode
+{
+ public:
+  //! Flag in \c status marking a node that has been a leaf
+  enum {IS_LEAF=1<<30};
+
+  //! \c TmNode::status, or'ed with \c IS_LEAF
+  int status;
+  //! Number of features in the Gaussian
+  int n;
+  //! Bytes used by the node, i.e. the offset to the next node
+  int bytes;  
+  //! \c TmNode::firstFeaturePassed
+  int firstFeaturePassed;
+  //! \c TmGaussian::linearizationPointFeature
+  int linearizationPointFeature;
+  //! \c TmGaussian::linearizationPoint
+  double linearizationPoint;
+
+  //! Whether the node has been a leaf
+  bool isLeaf () const {return (status & IS_LEAF)!=0;}
+
+  //! \c TmGaussian::RCompressed
+  const float* RCompressed () const {return (const float*) (this+1);}  
+
+  //! Decodes \c TmGaussian::feature into \c fl
+  /*! The counts are 0 for an inner node. */
+  void getFeatures (TmExtendedFeatureList& fl) const;  
+
+  //! The node following \c this in the packed memory
+  const TmFrozenNode* next () const {return (const TmFrozenNode*) (((const char*) this) + bytes);}
+
+  //! Stores the Gaussian of \c this compressed in \c g
+  /*! The counts are 0 for an inner node. */
+  void getGaussian (TmGaussian& g) const;  
+
+  //! Bytes needed for a node with features \c fl
+  /*! Counts are stored if \c isLeaf. Rounded up, so the next node's
+      header is aligned. */
+  static int size (const TmExtendedFeatureList& fl, bool isLeaf);
+
+ protected:
+  friend class TmFrozenSubtree;
+
+  //! The encoded feature ids
+  const unsigned char* encodedFeatures () const;
+
+  //! Encodes \c fl at \c p, with counts if \c isLeaf, and advances \c p
+  static void encodeFeatures (const TmExtendedFeatureList& fl, bool isLeaf, unsigned char*& p);  
+};
+
+
+//! The nodes below a \c TmNode packed into a single block of memory
+/*! A subtree where all Gaussians are valid, that is optimized and
+    that may be integrated (\c TmNode::CAN_BE_INTEGRATED) will
+    usually never change again. Still every node costs a full \c
+    TmNode with its \c TmNode::featurePassed list, costs, flags and
+    a \c TmGaussian with its own buffers.
+
+    \c TmTreemap::freezeSubtrees therefore deletes the nodes below
+    such a subtree's root and stores them here, in pre-order, as
+    \c TmFrozenNode, which needs less than half the memory. The root
+    keeps its \c TmNode and looks like a leaf to the rest of the
+    algorithm. Estimation runs through the packed nodes in order (\c
+    estimate), so only changes to the structure require rebuilding the
+    nodes by \c TmTreemap::thawSubtree.
+
+    Copying \c TmFrozenSubtree copies the block, so copying a \c
+    TmNode with its copy constructor works as before.
+ */
+class TmFrozenSubtree
+{
+ public:
+  //! Empty, i.e. nothing is frozen
+  TmFrozenSubtree () :block(NULL) {}
+
+  //! Copies the block of \c f
+  TmFrozenSubtree (const TmFrozenSubtree& f);
+
+  //! Copies the block of \c f
+  TmFrozenSubtree& operator= (const TmFrozenSubtree& f);
+
+  ~TmFrozenSubtree () {clear();}  
+
+  //! Packs the nodes below (excluding) \c s
+  /*! Nodes that are frozen themselves are stored as inner nodes
+      followed by their frozen nodes. Quantized Gaussians are stored
+      dequantized. The nodes are not changed. */
+  void create (const TmNode* s);  
+
+  //! Frees the block
+  void clear ();
+
+  //! Exchanges the blocks of \c this and \c f
+  void swap (TmFrozenSubtree& f) {char* b = block; block = f.block; f.block = b;}  
+
+  //! Whether nothing is frozen
+  bool empty () const {return block==NULL;}
+
+  //! Number of nodes stored
+  int nrOfNodes () const {return block==NULL ? 0 : header()->nrOfNodes;}
+  
+  //! First node
+  const TmFrozenNode* begin () const {return (const TmFrozenNode*) (block+sizeof(Header));}
+
+  //! One after the last node
+  const TmFrozenNode* end () const {return (const TmFrozenNode*) (block+(block==NULL ? sizeof(Header) : header()->size));}
+
+  //! Estimates all features marginalized out at the nodes stored
+  /*! The estimates of the features passed to the parent of the
+      subtree's root must already be in \c feature. \c workspace is
+      used as in \c TmNode::estimateMarginalized, \c fl receives
+      the decoded features. */
+  void estimate (TmFeatureArray& feature, XycVector<float>& workspace, TmExtendedFeatureList& fl) const;  
+
+  //! Replaces every feature id \c i by \c newId[i]
+  /*! The ids are encoded relative to each other, so the block is
+      rebuilt (see \c TmTreemap::renumberFeatures). */
+  void renumber (const TmFeatureList& newId);  
+
+  //! Heap memory (Bytes) used
+  int memory () const {return block==NULL ? 0 : header()->size;}  
+
+ protected:
+  //! Start of the block
+  struct Header 
+  {
+    //! Number of nodes
+    int nrOfNodes;
+    //! Size of the block in Bytes including the header
+    int size;
+  };
+
+  //! Header of \c block
+  const Header* header () const {return (const Header*) block;}
+  
+  //! \c Header followed by the nodes, \c NULL if empty
+  char* block;
+
+  //! Bytes and number of nodes needed to store the nodes below \c n
+  static void sizeBelow (const TmNode* n, int& size, int& nrOfNodes);
+
+  //! Stores the nodes below \c n at \c p and advances \c p
+  static void storeBelow (const TmNode* n, char*& p);
+
+  //! Stores \c n as one node at \c p and advances \c p
+  static void storeNode (const TmNode* n, char*& p);  
+
+  //! Stores a node with features \c fl and \c RCompressed \c r at \c p and advances \c p
+  /*! The other members are taken from \c h, except \c n and \c bytes. */
+  static void storeNode (const TmFrozenNode& h, const TmExtendedFeatureList& fl, const float* r, char*& p);  
+};
+
+
+#endif
@@ -39,15 +39,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "tmGaussian.h"
 #include "tmExtendedFeatureId.h"
+#include "tmThreadPool.h"
 #include <xymlapack/xymLAPACK.h>
+#include <float.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 TmGaussian::TmGaussian()
-  :isTriangular (false), R(), RCompressed(), feature(), linearizationPointFeature(-1), linearizationPoint(0)
+  :isTriangular (false), R(), RCompressed(), RQuantized(), RScale(), feature(), linearizationPointFeature(-1), linearizationPoint(0)
 {}
 
 
 TmGaussian::TmGaussian (const TmExtendedFeatureList& feature, int rowsReserved)
-  :isTriangular(false), R(), RCompressed(), feature(feature), linearizationPointFeature(-1), linearizationPoint(0)
+  :isTriangular(false), R(), RCompressed(), RQuantized(), RScale(), feature(feature), linearizationPointFeature(-1), linearizationPoint(0)
 {
   R.reserve (rowsReserved, feature.size()+1);
   R.create  (0, feature.size()+1);  
@@ -55,7 +60,7 @@ TmGaussian::TmGaussian (const TmExtendedFeatureList& feature, int rowsReserved)
 
 
 TmGaussian::TmGaussian (const char* features)
-  :isTriangular (false), R(), RCompressed(), feature(), linearizationPointFeature(-1), linearizationPoint(0)
+  :isTriangular (false), R(), RCompressed(), RQuantized(), RScale(), feature(), linearizationPointFeature(-1), linearizationPoint(0)
 {
   TmExtendedFeatureList fl;  
   if (stringToExtendedFeatureList (fl, features, false)) create (fl, 0);
@@ -70,6 +75,8 @@ void TmGaussian::create (const TmExtendedFeatureList& feature, int rowsReserved)
   R.reserve (rowsReserved, feature.size()+1);
   R.create  (0, feature.size()+1);
   RCompressed.clear();  
+  RQuantized.clear();
+  RScale.clear();  
   linearizationPointFeature = -1;
   linearizationPoint = 0;  
 }
@@ -81,6 +88,8 @@ void TmGaussian::create (const XymMatrixVC& R, const TmExtendedFeatureList& feat
   this->isTriangular = isTriangular;
   this->R = R;
   RCompressed.clear();  
+  RQuantized.clear();
+  RScale.clear();  
   linearizationPointFeature = -1;
   linearizationPoint = 0;  
 }
@@ -102,12 +111,80 @@ void TmGaussian::triangularize ()
 
 void TmGaussian::triangularize (XymVector& workspace)
 {
-  xymGEQR2 (R, R, workspace);
+  xymGEQR2Packed (R, workspace);
   isTriangular = true;  
 }
 
 
-void TmGaussian::multiply (const TmGaussian& gaussian, int fromFeature)
+//! Task applying a block reflector to a range of columns for \c TmParallelLARFB
+class TmLARFBTask : public TmThreadPool::Task
+{
+public:
+  int m, k, ldv, ldc, nCols;
+  const double* v;
+  const double* t;
+  double* c;
+  double* w;  
+
+  virtual void run (int thread) 
+    {
+      xymNativeLARFB (m, k, v, ldv, t, c, ldc, nCols, w);
+    }
+};
+
+
+//! Trailing update of \c xymNativeGEQRF distributing the columns over a \c TmThreadPool
+/*! The columns are split into at most \c MAX_TASKS ranges of at least
+    \c MIN_COLS columns (a multiple of 4, see \c XymSerialLARFB). */
+class TmParallelLARFB
+{
+public:
+  enum {MAX_TASKS=16, MIN_COLS=16};  
+
+  TmParallelLARFB (TmThreadPool* pool, int thread) :pool(pool), thread(thread) {}
+
+  void operator() (int m, int k, const double* v, int ldv, const double* t,
+                   double* c, int ldc, int nCols, double* w) const
+    {
+      int nrOfTasks = min (pool->nrOfThreads(), (int) MAX_TASKS);
+      int chunk = ((nCols+nrOfTasks-1)/nrOfTasks+3)/4*4;
+      if (chunk<MIN_COLS) chunk = MIN_COLS;
+      TmLARFBTask task[MAX_TASKS];
+      TmThreadPool::Group group;
+      int n = 0;      
+      for (int j0=0; j0<nCols; j0+=chunk, n++) {
+        TmLARFBTask& tk = task[n];
+        tk.m     = m;
+        tk.k     = k;
+        tk.v     = v;
+        tk.ldv   = ldv;
+        tk.t     = t;
+        tk.c     = c+j0*ldc;
+        tk.ldc   = ldc;
+        tk.nCols = min (chunk, nCols-j0);
+        tk.w     = w+XYM_QR_BLOCK*j0;
+        // The calling thread does the last range itself
+        if (j0+chunk<nCols) pool->spawn (&tk, group, thread);
+        else tk.run (thread);        
+      }
+      pool->wait (group, thread);
+    }
+
+protected:
+  TmThreadPool* pool;
+  int thread;  
+};
+
+
+void TmGaussian::triangularize (XymVector& workspace, TmThreadPool* pool, int thread)
+{
+  if (pool==NULL) xymGEQR2Packed (R, workspace);
+  else xymGEQR2Packed (R, workspace, TmParallelLARFB (pool, thread));
+  isTriangular = true;  
+}
+
+
+void TmGaussian::multiply (const TmGaussian& gaussian, int fromFeature, const XycVector<int>* columnOfFeature)
 {
   assert (R.isValid());  
   int n = gaussian.rows();
@@ -118,17 +195,19 @@ void TmGaussian::multiply (const TmGaussian& gaussian, int fromFeature)
   // that the overall solution is indefinite.
   int base = R.rows();  
   R.appendRow (n, true);
+  // A quantized Gaussian is converted back to the format of \c RCompressed
+  XycVector<float> dequantized;
+  const float* rc = gaussian.RCompressed.begin();
+  if (gaussian.isQuantized()) {
+    gaussian.dequantizeR (dequantized);
+    rc = dequantized.begin();
+  }
 
   for (int j=fromFeature; j<gaussian.cols(); j++) {
     // search which to which column to copy gaussian.R.col(j)
-    int dstJ=-1;
+    int dstJ;
     if (j<(int) gaussian.feature.size()) {
-      int srcFeature = gaussian.feature[j].id;      
-      for (int i=0; i<(int) feature.size(); i++) 
-        if (srcFeature==feature[i].id) {
-          dstJ = i;
-          break;
-        }
+      dstJ = columnOf (gaussian.feature[j].id, columnOfFeature);
       assert (dstJ>=0);
       feature[dstJ].count += gaussian.feature[j].count;    
     }
@@ -136,11 +215,11 @@ void TmGaussian::multiply (const TmGaussian& gaussian, int fromFeature)
     
 
     // now add gaussian.R.col(j)[fromFeature..] to R.col(dstCol)
-    if (!gaussian.RCompressed.empty()) {
+    if (gaussian.isCompressed()) {
       const float *srcP;
       int srcRowInc;      
       double *dstP, *dstPE;
-      srcP  = &gaussian.RCompressedAt (fromFeature, j);
+      srcP  = rc + gaussian.RCompressedIdx (fromFeature, j);
       srcRowInc = n-fromFeature-1;      
       R.loopCol (dstJ, dstP, dstPE);
       dstP += base;
@@ -167,100 +246,495 @@ void TmGaussian::multiply (const TmGaussian& gaussian, int fromFeature)
   }
 }
 
-void TmGaussian::meanCompressed (float* x, int upToFeature)
+void TmGaussian::createTriangular (const TmExtendedFeatureList& feature)
 {
-  assert (isTriangular && !RCompressed.empty());
-  if (upToFeature==0) return;  
+  this->feature = feature;
+  isTriangular = true;  
+  R.create (feature.size()+1, feature.size()+1);
+  RCompressed.clear();
+  RQuantized.clear();
+  RScale.clear();  
+  linearizationPointFeature = -1;
+  linearizationPoint = 0;  
+}
+
+
+void TmGaussian::multiplyTriangular (const TmGaussian& gaussian, int fromFeature, XymVector& workspace)
+{
+  XycVector<int> dstCol;
+  multiplyTriangular (gaussian, fromFeature, workspace, dstCol);
+}
+
+
+void TmGaussian::indexColumns (const TmExtendedFeatureList& feature, XycVector<int>& columnOfFeature)
+{
+  for (int i=0; i<(int) feature.size(); i++) {
+    int id = feature[i].id;
+    if (id>=(int) columnOfFeature.size()) columnOfFeature.resize (id+1, -1);
+    if (columnOfFeature[id]<0) columnOfFeature[id] = i;
+  }
+}
+
+
+void TmGaussian::unindexColumns (const TmExtendedFeatureList& feature, XycVector<int>& columnOfFeature)
+{
+  for (int i=0; i<(int) feature.size(); i++) columnOfFeature[feature[i].id] = -1;
+}
+
+
+void TmGaussian::mapColumns (const TmGaussian& gaussian, int fromFeature, XycVector<int>& dstCol, const XycVector<int>* columnOfFeature)
+{
+  int n = cols();
+  int srcN = gaussian.cols();
+  dstCol.resizeWithUndefinedData (srcN);  
+  for (int j=fromFeature; j<srcN; j++) {
+    int dstJ;
+    if (j<(int) gaussian.feature.size()) {
+      dstJ = columnOf (gaussian.feature[j].id, columnOfFeature);
+      assert (dstJ>=0);
+      feature[dstJ].count += gaussian.feature[j].count;    
+    }
+    else dstJ = n-1;
+    dstCol[j] = dstJ;    
+  }
+}
+
+
+//! Scatters row \c i of \c gaussian into \c w using the column map \c dstCol
+/*! Column \c j of \c this is added to \c w[step*j], so \c step=-1
+    and \c w pointing to the last entry stores the row reversed. \c
+    rc is \c gaussian.RCompressed or its dequantized version if \c
+    gaussian is compressed. Returns the first column that received a
+    nonzero entry or \c n if none. Used by \c
+    TmGaussian::multiplyTriangular and \c
+    TmGaussian::multiplyTriangularCompressed. */
+static int scatterRow (const TmGaussian& gaussian, const float* rc, int i, int fromFeature, const int* dstCol, double* w, int step, int n)
+{
+  int srcN = gaussian.cols();
+  int lead = n;    
+  if (gaussian.isCompressed()) {
+    const float* srcP = rc + gaussian.RCompressedIdx (i, srcN-1);
+    for (int j=srcN-1; j>=i; j--) {
+      if (*srcP!=0) {
+        int dstJ = dstCol[j];          
+        w[step*dstJ] += *srcP;
+        if (dstJ<lead) lead = dstJ;          
+      }
+      srcP++;        
+    }
+  }
+  else {
+    for (int j=fromFeature; j<srcN; j++) {
+      double v = gaussian.R(i,j);        
+      if (v!=0) {
+        int dstJ = dstCol[j];          
+        w[step*dstJ] += v;
+        if (dstJ<lead) lead = dstJ;          
+      }
+    }
+  }
+  return lead;  
+}
+
+
+//! Applies the rotation \c (c,s) to \c len entries of the float row \c t and the double row \c w
+/*! Computes \c t=c*t+s*w and \c w=c*w-s*t in double. Used by \c
+    TmGaussian::multiplyTriangularCompressed, with SSE2 four entries
+    are converted and rotated at once. */
+static void rotateFloatRow (float* t, double* w, int len, double c, double s)
+{
+  int j=0;
+#ifdef __SSE2__
+  __m128d c2 = _mm_set1_pd (c), s2 = _mm_set1_pd (s);
+  for (; j+4<=len; j+=4) {
+    __m128 a4 = _mm_loadu_ps (t+j);
+    __m128d a0 = _mm_cvtps_pd (a4), a1 = _mm_cvtps_pd (_mm_movehl_ps (a4, a4));
+    __m128d b0 = _mm_loadu_pd (w+j), b1 = _mm_loadu_pd (w+j+2);
+    __m128 t0 = _mm_cvtpd_ps (_mm_add_pd (_mm_mul_pd (c2, a0), _mm_mul_pd (s2, b0)));
+    __m128 t1 = _mm_cvtpd_ps (_mm_add_pd (_mm_mul_pd (c2, a1), _mm_mul_pd (s2, b1)));
+    _mm_storeu_ps (t+j, _mm_movelh_ps (t0, t1));
+    _mm_storeu_pd (w+j,   _mm_sub_pd (_mm_mul_pd (c2, b0), _mm_mul_pd (s2, a0)));
+    _mm_storeu_pd (w+j+2, _mm_sub_pd (_mm_mul_pd (c2, b1), _mm_mul_pd (s2, a1)));
+  }
+#endif
+  for (; j<len; j++) {
+    double a = t[j], b = w[j];
+    t[j] = (float) (c*a + s*b);
+    w[j] = c*b - s*a;
+  }
+}
+
+
+void TmGaussian::multiplyTriangular (const TmGaussian& gaussian, int fromFeature, XymVector& workspace, XycVector<int>& columnWorkspace,
+                                     const XycVector<int>* columnOfFeature)
+{
+  assert (isTriangular && R.isValid() && R.rows()==R.cols());
+  int n = R.cols();
+  int srcRows = gaussian.rows();
+  if (srcRows<=fromFeature) return;
+  // A quantized Gaussian is converted back to the format of \c RCompressed
+  XycVector<float> dequantized;
+  const float* rc = gaussian.RCompressed.begin();
+  if (gaussian.isQuantized()) {
+    gaussian.dequantizeR (dequantized);
+    rc = dequantized.begin();
+  }
+  
+  XycVector<int>& dstCol = columnWorkspace;  
+  mapColumns (gaussian, fromFeature, dstCol, columnOfFeature);
+
+  // The rotations work on rows of R, so we copy the triangle into a
+  // row major n*n matrix \c t in \c workspace followed by the row \c w
+  // being rotated in.
+  workspace.resize (n*n+n, false);
+  double* t = workspace.base();
+  double* w = t + n*n;
+  for (int j=0; j<n; j++) {
+    double* rP = R.base() + j*R.colOfs();    
+    for (int k=0; k<=j; k++) t[k*n+j] = rP[k];
+    w[j] = 0;    
+  }
+  for (int i=fromFeature; i<srcRows; i++) {
+    int lead = scatterRow (gaussian, rc, i, fromFeature, dstCol.begin(), w, 1, n);
+
+    // Rotate \c w into \c t row by row from \c lead on
+    for (int k=lead; k<n; k++) {
+      if (w[k]==0) continue;
+      double* tk = t + k*n;      
+      if (tk[k]==0) {
+        // Row k is still empty (rotations always leave a nonzero diagonal)
+        for (int j=k; j<n; j++) {
+          tk[j] = w[j];
+          w[j] = 0;
+        }
+        break;        
+      }
+      double r = sqrt (tk[k]*tk[k] + w[k]*w[k]);
+      double c = tk[k]/r, s = w[k]/r;
+      tk[k] = r;
+      w[k] = 0;
+      for (int j=k+1; j<n; j++) {
+        double a = tk[j], b = w[j];
+        tk[j] = c*a + s*b;
+        w[j]  = c*b - s*a;
+      }
+    }
+  }
+
+  // Copy back
+  for (int j=0; j<n; j++) {
+    double* rP = R.base() + j*R.colOfs();    
+    for (int k=0; k<=j; k++) rP[k] = t[k*n+j];
+  }
+}
+
+
+void TmGaussian::createTriangularCompressed (const TmExtendedFeatureList& feature)
+{
+  this->feature = feature;
+  isTriangular = true;  
+  R.clear();
   int n = feature.size()+1;  
-  float* xP = x;
-  float* rP = &RCompressedAt (upToFeature-1, n-1); // first entry of \c RCompressed used
-  float* xDest  = x+n-upToFeature; // First x entry we will compute (feature[upToFeature-1])
-  float* xDestE = x+n; // One after the last x entry we will compute (feature[0])
+  resizeCompressed (RCompressed, rCompressedSize (n));
+  float* rc = RCompressed.begin();
+  float* rcEnd = RCompressed.end();
+  while (rc!=rcEnd) *(rc++) = 0;
+  freeQuantized ();  
+  linearizationPointFeature = -1;
+  linearizationPoint = 0;  
+}
 
-#ifdef USESSE
-#error asdlkasjd
-  for (float* xx=xDest; xx!=xDestE; xx++) *xx = 0;
-  xDestE[0] = xDestE[1] = xDestE[2] = xDestE[3] = 0; // We have to clear 3 floats after  
-  // We clear everything uncomputed so we don't have to care about adding only parts of an xmms registers  
-  // eax = %0 = xDestE, ebx = %1 = xP, ecx = %2 = rp, edx = %3 = xDest
-  asm volatile (
-                "\n\t"
-    
-                "movl %0, %%eax                    \n\t"
-                "movl %2, %%ecx                    \n\t"
-                "movl %3, %%edx                    \n\t"
-                "cmp %%eax, %%edx                  \n\t"
-                "jae .end                          \n\t"
-".align 16  \n\t"
-".loopCol:  \n\t"
-                "xorps %%xmm1,%%xmm1               \n\t"
-                "movl %1, %%ebx                    \n\t"
-".loopRow:  \n\t"
-                "movups (%%ebx), %%xmm2            \n\t"   // fetch *xP
-                "movups (%%ecx), %%xmm3            \n\t"   // fetch *rP
-                "prefetcht0 32(%%ecx)                \n\t"
-                "add $16, %%ebx                    \n\t"
-                "add $16, %%ecx                    \n\t"      
-                "mulps %%xmm3, %%xmm2              \n\t"   // multiply 
-                "subps %%xmm2, %%xmm1              \n\t"   // accumulate
-                "cmp %%edx, %%ebx                  \n\t"
-                "jb .loopRow                       \n\t"
-                "sub %%edx, %%ebx                  \n\t"   // xP has exceeded xDest
-                "sub %%ebx, %%ecx                  \n\t"   // so correct rP as if we had exactly hit xDest
-                
-
-                "movaps %%xmm1, %%xmm2             \n\t"   // now sum up all 4 floats in xmm1
-                "shufps $0x0E, %%xmm2, %%xmm2      \n\t"   // float 2-->0, float 3-->1
-                "addps %%xmm2,  %%xmm1             \n\t"
-                "movaps %%xmm1, %%xmm2             \n\t"
-                "shufps $0x01, %%xmm2, %%xmm2      \n\t" // (2+3) from 1-->0
-                "addps %%xmm2, %%xmm1              \n\t"
-                "divss (%%ecx), %%xmm1             \n\t" 
-                "movss %%xmm1, (%%edx)             \n\t"
-                "add $4, %%ecx                     \n\t"
-                "add $4, %%edx                     \n\t"
-                "cmp %%eax, %%edx                  \n\t"
-                "jb .loopCol                       \n\t"
-".end: \n\t"
-                : : "m" (xDestE), // %0 = xDestE
-                  "m" (xP),       // %1 = xP
-                  "m" (rP),       // %2 = rP
-                  "m" (xDest)     // %3 = xDest
-                : "%eax", "%ebx", "%ecx", "%edx", "memory"//, "%xmm1", "%xmm2", "%xmm3", gcc 4.1 does not know these any more, thats strange
-                );  
 
-#if ASSERT_LEVEL>=1
-  // Check whether everything is correct
+void TmGaussian::multiplyTriangularCompressed (const TmGaussian& gaussian, int fromFeature, XymVector& workspace, XycVector<int>& columnWorkspace,
+                                               const XycVector<int>* columnOfFeature)
+{
+  assert (isTriangular && !RCompressed.empty() && &gaussian!=this);
+  int n = cols();
+  int srcRows = gaussian.rows();
+  if (srcRows<=fromFeature) return;
+  XycVector<float> dequantized;
+  const float* rc = gaussian.RCompressed.begin();
+  if (gaussian.isQuantized()) {
+    gaussian.dequantizeR (dequantized);
+    rc = dequantized.begin();
+  }
+  
+  XycVector<int>& dstCol = columnWorkspace;  
+  mapColumns (gaussian, fromFeature, dstCol, columnOfFeature);
+
+  // \c w holds the row being rotated in reversed like the rows of
+  // \c RCompressed, so entry \c (k,j) of the triangle corresponds to
+  // \c w[n-1-j] and both are traversed forward.
+  workspace.resize (n, false);
+  double* w = workspace.base();
+  for (int j=0; j<n; j++) w[j] = 0;
+  float* t = RCompressed.begin();  
+  for (int i=fromFeature; i<srcRows; i++) {
+    int lead = scatterRow (gaussian, rc, i, fromFeature, dstCol.begin(), w+n-1, -1, n);
+
+    // Rotate \c w into the triangle as in \c multiplyTriangular
+    for (int k=lead; k<n; k++) {
+      int len = n-1-k;      
+      // A pivot not representable in float is dropped, so a row of
+      // the triangle is empty iff its diagonal is 0
+      if (fabs (w[len])<FLT_MIN) {
+        w[len] = 0;
+        continue;
+      }
+      float* tk = t + RCompressedIdx (k, n-1);
+      if (tk[len]==0) {
+        for (int j=0; j<=len; j++) {
+          tk[j] = (float) w[j];
+          w[j] = 0;
+        }
+        break;        
+      }
+      double d = tk[len];      
+      double r = sqrt (d*d + w[len]*w[len]);
+      double c = d/r, s = w[len]/r;
+      tk[len] = (float) r;
+      w[len] = 0;
+      rotateFloatRow (tk, w, len, c, s);
+    }
+  }
+}
+
+
+double TmGaussian::diagonalRatio (int upToFeature) const
+{
+  assert (isTriangular);
+  int n = cols();
+  if (upToFeature<0 || upToFeature>n-1) upToFeature = n-1;  
+  double minD = 0, maxD = 0;
+  for (int k=0; k<n-1; k++) {
+    double d;
+    if (isQuantized()) d = RScale[3*(n-k-1)+1];
+    else if (isCompressed()) d = RCompressed[RCompressedIdx (k, k)];
+    else if (k<R.rows()) d = R(k,k);
+    else d = 0;
+    d = fabs (d);
+    if (d>maxD) maxD = d;
+    if (k<upToFeature && d!=0 && (minD==0 || d<minD)) minD = d;
+  }
+  if (minD==0) return 1;
+  else return minD/maxD;  
+}
+
+
+// SIMD kernels for meanCompressed
+// ---------------------------------
+//
+// All kernels perform the same computation as the scalar reference
+// \c meanCompressedScalar: For each destination x entry the dot
+// product of the already known prefix of \c x with the corresponding
+// row of \c RCompressed is computed and divided by the diagonal
+// entry. They only differ in the order of summation and hence agree
+// up to float rounding. The kernels never access memory outside the
+// row and the prefix of \c x, remainders are handled by a scalar
+// loop (SSE2, AVX2) or by masked loads (AVX-512).
+//
+// The variant is chosen once at program start by \c meanCompressedKernel
+// from what the CPU supports, so a Release build with \c USESSE runs
+// on any x86-64 machine and uses AVX-512 where available.
+
+//! Signature of a backsubstitution kernel used by \c TmGaussian::meanCompressed
+/*! Computes \c x[k] for \c xDest<=x+k<xDestE with \c rP pointing to
+    the row belonging to \c xDest in \c RCompressed. */
+typedef void (*TmMeanCompressedKernel) (const float* rP, float* x, float* xDest, float* xDestE);
+
+//! Scalar reference implementation of the backsubstitution in \c TmGaussian::meanCompressed
+static void meanCompressedScalar (const float* rP, float* x, float* xDest, float* xDestE)
+{
   while (xDest!=xDestE) {
     // Handle i-th line of R. Compute x_i (estimate for feature[i] stored in x[n-i-1]) such that (R*x)_i=0
     float sum = 0;
-    xP = x;    
+    float* xP = x;    
     while (xP!=xDest) {
       sum += *rP * *xP;
       rP++;
       xP++;
     }
-    float result = -sum / *rP; 
-    assert (fabs(result - *xDest)<1E-3);    
+    *xDest = -sum / *rP; 
     rP++;
     xDest++;
   }
+}
+
+
+#if defined(USESSE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TM_MEANCOMPRESSED_SIMD
+#include <immintrin.h>
+
+//! SSE2 version of \c meanCompressedScalar
+__attribute__((target("sse2")))
+static void meanCompressedSSE2 (const float* rP, float* x, float* xDest, float* xDestE)
+{
+  while (xDest!=xDestE) {
+    int k = xDest-x;
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    int i=0;
+    for (; i+8<=k; i+=8) {
+      acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_loadu_ps (rP+i),   _mm_loadu_ps (x+i)));
+      acc1 = _mm_add_ps (acc1, _mm_mul_ps (_mm_loadu_ps (rP+i+4), _mm_loadu_ps (x+i+4)));
+    }
+    if (i+4<=k) {
+      acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_loadu_ps (rP+i), _mm_loadu_ps (x+i)));
+      i+=4;
+    }
+    acc0 = _mm_add_ps (acc0, acc1);
+    acc0 = _mm_add_ps (acc0, _mm_movehl_ps (acc0, acc0));
+    acc0 = _mm_add_ss (acc0, _mm_shuffle_ps (acc0, acc0, 0x01));
+    float sum = _mm_cvtss_f32 (acc0);
+    for (; i<k; i++) sum += rP[i]*x[i];
+    *xDest = -sum / rP[k];
+    rP += k+1;
+    xDest++;
+  }
+}
+
+
+//! AVX2/FMA version of \c meanCompressedScalar
+__attribute__((target("avx2,fma")))
+static void meanCompressedAVX2 (const float* rP, float* x, float* xDest, float* xDestE)
+{
+  while (xDest!=xDestE) {
+    int k = xDest-x;
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    int i=0;
+    for (; i+16<=k; i+=16) {
+      acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (rP+i),   _mm256_loadu_ps (x+i),   acc0);
+      acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (rP+i+8), _mm256_loadu_ps (x+i+8), acc1);
+    }
+    if (i+8<=k) {
+      acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (rP+i), _mm256_loadu_ps (x+i), acc0);
+      i+=8;
+    }
+    acc0 = _mm256_add_ps (acc0, acc1);
+    __m128 s = _mm_add_ps (_mm256_castps256_ps128 (acc0), _mm256_extractf128_ps (acc0, 1));
+    s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+    s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 0x01));
+    float sum = _mm_cvtss_f32 (s);
+    for (; i<k; i++) sum += rP[i]*x[i];
+    *xDest = -sum / rP[k];
+    rP += k+1;
+    xDest++;
+  }
+}
+
+
+//! AVX-512 version of \c meanCompressedScalar
+__attribute__((target("avx512f")))
+static void meanCompressedAVX512 (const float* rP, float* x, float* xDest, float* xDestE)
+{
+  while (xDest!=xDestE) {
+    int k = xDest-x;
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    int i=0;
+    for (; i+32<=k; i+=32) {
+      acc0 = _mm512_fmadd_ps (_mm512_loadu_ps (rP+i),    _mm512_loadu_ps (x+i),    acc0);
+      acc1 = _mm512_fmadd_ps (_mm512_loadu_ps (rP+i+16), _mm512_loadu_ps (x+i+16), acc1);
+    }
+    if (i+16<=k) {
+      acc0 = _mm512_fmadd_ps (_mm512_loadu_ps (rP+i), _mm512_loadu_ps (x+i), acc0);
+      i+=16;
+    }
+    if (i<k) {
+      __mmask16 m = (__mmask16) ((1u<<(k-i))-1);
+      acc1 = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (m, rP+i), _mm512_maskz_loadu_ps (m, x+i), acc1);
+    }
+    float sum = _mm512_reduce_add_ps (_mm512_add_ps (acc0, acc1));
+    *xDest = -sum / rP[k];
+    rP += k+1;
+    xDest++;
+  }
+}
+
+
+//! Selects the fastest kernel supported by the CPU we are running on
+static TmMeanCompressedKernel selectMeanCompressedKernel ()
+{
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512f")) return &meanCompressedAVX512;
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) return &meanCompressedAVX2;
+  if (__builtin_cpu_supports ("sse2")) return &meanCompressedSSE2;
+  return &meanCompressedScalar;
+}
+
+//! Kernel used by \c TmGaussian::meanCompressed, fixed during static initialization
+static const TmMeanCompressedKernel meanCompressedKernel = selectMeanCompressedKernel();
 #endif
-#else
+
+
+//! Version of \c meanCompressedScalar for \c TmGaussian::RQuantized
+/*! \c qP points to the row of \c xDest in \c RQuantized, \c info
+    to its entries in \c TmGaussian::RScale. */
+static void meanQuantizedScalar (const short* qP, const float* info, float* x, float* xDest, float* xDestE)
+{
+  while (xDest!=xDestE) {
+    // x[0] is the homogenous 1 and its entry stored in \c info[2]
+    double sum = 0; // quantized products are large, so accumulate them in double
+    float* xP = x+1;    
+    qP++;
+    while (xP!=xDest) {
+      sum += *qP * *xP;
+      qP++;
+      xP++;
+    }
+    *xDest = -(sum*info[0] + info[2]) / info[1]; 
+    qP++;
+    info += 3;    
+    xDest++;
+  }
+}
+
+
+void TmGaussian::meanCompressed (float* x, int upToFeature)
+{
+  assert (isTriangular && isCompressed());
+  if (upToFeature==0) return;  
+  int n = feature.size()+1;  
+  if (isQuantized()) {
+    float* xDest  = x+n-upToFeature;
+    float* xDestE = x+n;
+    xDestE[0] = xDestE[1] = xDestE[2] = xDestE[3] = 0;
+    meanQuantizedScalar (&RQuantized[RCompressedIdx (upToFeature-1, n-1)], &RScale[3*(n-upToFeature)], x, xDest, xDestE);
+    return;    
+  }
+  meanCompressed (RCompressed.begin(), n, x, upToFeature);
+}
+
+
+void TmGaussian::meanCompressed (const float* RCompressed, int n, float* x, int upToFeature)
+{
+  if (upToFeature==0) return;  
+  const float* rP = RCompressed + (n-upToFeature)*(n-upToFeature+1)/2; // R(upToFeature-1,n-1), first entry used
+  float* xDest  = x+n-upToFeature; // First x entry we will compute (feature[upToFeature-1])
+  float* xDestE = x+n; // One after the last x entry we will compute (feature[0])
+
+#ifdef TM_MEANCOMPRESSED_SIMD
+  xDestE[0] = xDestE[1] = xDestE[2] = xDestE[3] = 0; // We promise to clear 4 floats after
+  meanCompressedKernel (rP, x, xDest, xDestE);
+
+#if ASSERT_LEVEL>=1
+  // Check whether everything is correct
   while (xDest!=xDestE) {
     // Handle i-th line of R. Compute x_i (estimate for feature[i] stored in x[n-i-1]) such that (R*x)_i=0
     float sum = 0;
-    xP = x;    
+    float* xP = x;    
     while (xP!=xDest) {
       sum += *rP * *xP;
       rP++;
       xP++;
     }
-    *xDest = -sum / *rP; 
+    float result = -sum / *rP; 
+    assert (fabs(result - *xDest)<=1E-3*(1+fabs(result)));    
     rP++;
     xDest++;
   }
 #endif
+#else
+  meanCompressedScalar (rP, x, xDest, xDestE);
+#endif
 }
 
 
@@ -319,6 +793,8 @@ void TmGaussian::assertIt () const
 {
   assertFinite ();
   assert (RCompressed.empty() || RCompressed.size()==rCompressedSize(feature.size()+1));  
+  assert (RQuantized.empty() || (RCompressed.empty() && RQuantized.size()==rCompressedSize(feature.size()+1) &&
+                                 RScale.size()==3*((int) feature.size()+1)));  
   if (R.isValid() && !RCompressed.empty()) {
     for (int i=0; i<R.cols(); i++) for (int j=0; j<R.cols(); j++) {      
       if (i<=j) {
@@ -367,8 +843,10 @@ int TmGaussian::memory () const
 {
   int mem = sizeof (TmGaussian);
   mem += R.memoryUsage();  // sizeof(XymMatrixVC) is included in \c sizeof(TmGaussian)
-  mem += feature.capacity() * sizeof(TmExtendedFeatureId);
+  mem += feature.memory();
   mem += RCompressed.capacity() * sizeof(float);  
+  mem += RQuantized.capacity() * sizeof(short);  
+  mem += RScale.capacity() * sizeof(float);  
   return mem;  
 }
 
@@ -381,6 +859,10 @@ void TmGaussian::transferFrom (TmGaussian& g2)
   feature.swap (g2.feature);
   RCompressed.clear();
   RCompressed.swap (g2.RCompressed);  
+  RQuantized.clear();
+  RQuantized.swap (g2.RQuantized);  
+  RScale.clear();
+  RScale.swap (g2.RScale);  
   linearizationPointFeature = g2.linearizationPointFeature;
   linearizationPoint = g2.linearizationPoint;    
 }
@@ -389,12 +871,129 @@ void TmGaussian::transferFrom (TmGaussian& g2)
 void TmGaussian::compress ()
 {
   assert (R.isValid() && isTriangular);
+  compressR (RCompressed);  
+  freeQuantized ();  
+#if ASSERT_LEVEL>=2
+  assertIt ();  
+#endif
+  R.clear();  
+}
+
+
+void TmGaussian::compressTo (TmGaussian& g) const
+{
+  assert (R.isValid() && isTriangular && &g!=this);
+  g.isTriangular = true;
+  g.R.clear();
+  g.feature = feature;
+  compressR (g.RCompressed);
+  g.freeQuantized ();
+  g.linearizationPointFeature = linearizationPointFeature;
+  g.linearizationPoint = linearizationPoint;
+#if ASSERT_LEVEL>=2
+  g.assertIt ();  
+#endif
+}
+
+
+void TmGaussian::resizeCompressed (XycVector<float>& result, int rSize)
+{
+  // Use a buffer provided by the caller (see \c TmBufferCache) if large enough
+  if (result.capacity()>=rSize) result.resizeWithUndefinedData (rSize);
+  else {
+    result.clear();
+    result.resizeCompactlyWithUndefindedData (rSize);  
+  }
+}
+
+
+//! Triangularizes the \c N columns of \c R and writes the result as \c RCompressed to \c rc
+/*! Fixed size kernel of \c TmGaussian::triangularizeTo. The rows of
+    \c R are rotated one after another into a row major triangle \c
+    t on the stack by Givens rotations as in \c
+    TmGaussian::multiplyTriangular. With \c N known at compile time
+    the loops over columns have constant bounds and are unrolled. */
+template<int N>
+static void fixedTriangularizeCompressed (const XymMatrixC& R, float* rc)
+{
+  double t[N][N];
+  double w[N];
+  for (int k=0; k<N; k++) for (int j=0; j<N; j++) t[k][j] = 0;
+  int m = R.rows(), ld = R.colOfs();
+  for (int i=0; i<m; i++) {
+    const double* rP = R.base()+i;
+    int lead = N;
+    for (int j=N-1; j>=0; j--) {
+      w[j] = rP[j*ld];
+      if (w[j]!=0) lead = j;
+    }
+    for (int k=lead; k<N; k++) {
+      if (w[k]==0) continue;
+      if (t[k][k]==0) {
+        // Row k is still empty (rotations always leave a nonzero diagonal)
+        for (int j=k; j<N; j++) t[k][j] = w[j];
+        break;        
+      }
+      double r = sqrt (t[k][k]*t[k][k] + w[k]*w[k]);
+      double c = t[k][k]/r, s = w[k]/r;
+      t[k][k] = r;
+      for (int j=k+1; j<N; j++) {
+        double a = t[k][j], b = w[j];
+        t[k][j] = c*a + s*b;
+        w[j]    = c*b - s*a;
+      }
+    }
+  }
+  for (int i=N-1; i>=0; i--) 
+    for (int j=N-1; j>=i; j--) *(rc++) = (float) t[i][j];
+  rc[0] = rc[1] = rc[2] = 0;
+}
+
+
+void TmGaussian::triangularizeTo (TmGaussian& g, XymVector& workspace, TmThreadPool* pool, int thread)
+{
+  assert (R.isValid() && &g!=this);
+  int n = R.cols();  
+  if (n>MAX_FIXED_COLS) {
+    triangularize (workspace, pool, thread);
+    compressTo (g);
+    return;
+  }  
+  g.isTriangular = true;
+  g.R.clear();
+  g.feature = feature;
+  resizeCompressed (g.RCompressed, rCompressedSize (n));
+  float* rc = g.RCompressed.begin();  
+  switch (n) {
+  case  1: fixedTriangularizeCompressed< 1> (R, rc); break;
+  case  2: fixedTriangularizeCompressed< 2> (R, rc); break;
+  case  3: fixedTriangularizeCompressed< 3> (R, rc); break;
+  case  4: fixedTriangularizeCompressed< 4> (R, rc); break;
+  case  5: fixedTriangularizeCompressed< 5> (R, rc); break;
+  case  6: fixedTriangularizeCompressed< 6> (R, rc); break;
+  case  7: fixedTriangularizeCompressed< 7> (R, rc); break;
+  case  8: fixedTriangularizeCompressed< 8> (R, rc); break;
+  case  9: fixedTriangularizeCompressed< 9> (R, rc); break;
+  case 10: fixedTriangularizeCompressed<10> (R, rc); break;
+  case 11: fixedTriangularizeCompressed<11> (R, rc); break;
+  case 12: fixedTriangularizeCompressed<12> (R, rc); break;
+  }
+  g.freeQuantized ();
+  g.linearizationPointFeature = linearizationPointFeature;
+  g.linearizationPoint = linearizationPoint;
+#if ASSERT_LEVEL>=2
+  g.assertIt ();  
+#endif
+}
+
+
+void TmGaussian::compressR (XycVector<float>& result) const
+{
+  assert (R.isValid());
   int m = R.rows(), n = R.cols();
   // We extend the matrix with 0s to a full triangle
-  RCompressed.clear();
-  int rSize = rCompressedSize(n);  
-  RCompressed.resizeCompactlyWithUndefindedData (rSize);  
-  float* rc = RCompressed.begin();
+  resizeCompressed (result, rCompressedSize(n));
+  float* rc = result.begin();
   int incr = R.colOfs();
   int nm1Incr = incr*(n-1);  
   for (int i=n-1;i>=0;i--) {
@@ -425,10 +1024,71 @@ void TmGaussian::compress ()
   *rc = 0; rc++;
   *rc = 0; rc++;
   // This is to avoid the SSE routines accessing NaN memory. This is questionable  
+}
+
+
+
+
+void TmGaussian::quantize ()
+{
+  assert (isTriangular && !RCompressed.empty());
+  int n = feature.size()+1;
+  RQuantized.resizeCompactlyWithUndefindedData (RCompressed.size());
+  RScale.resizeCompactlyWithUndefindedData (3*n);
+  for (int r=0; r<n; r++) {
+    // Row \c r in storage order is row \c n-r-1 of R. Entry \c 0
+    // belongs to the homogenous column and entry \c r is the diagonal.
+    const float* rP = RCompressed.begin() + r*(r+1)/2;
+    short* qP = RQuantized.begin() + r*(r+1)/2;
+    float maxAbs = 0;
+    for (int j=1; j<r; j++) if (fabs(rP[j])>maxAbs) maxAbs = fabs(rP[j]);
+    float scale = maxAbs/32767;
+    for (int j=1; j<r; j++) {
+      if (scale==0) qP[j] = 0;
+      else {
+        float q = floor (rP[j]/scale + 0.5);
+        if (q>32767) q = 32767;
+        else if (q<-32767) q = -32767;
+        qP[j] = (short) q;
+      }      
+    }
+    qP[0] = qP[r] = 0;
+    RScale[3*r]   = scale;
+    RScale[3*r+1] = rP[r];
+    RScale[3*r+2] = (r>0) ? rP[0] : 0;
+  }
+  for (int i=n*(n+1)/2; i<RQuantized.size(); i++) RQuantized[i] = 0;
+  // Give the memory back
+  XycVector<float> noCompressed;
+  RCompressed.swap (noCompressed);  
 #if ASSERT_LEVEL>=2
   assertIt ();  
 #endif
-  R.clear();  
 }
 
 
+void TmGaussian::freeQuantized ()
+{
+  if (!isQuantized()) return;
+  XycVector<short> noQuantized;
+  XycVector<float> noScale;
+  RQuantized.swap (noQuantized);
+  RScale.swap (noScale);    
+}
+
+
+void TmGaussian::dequantizeR (XycVector<float>& result) const
+{
+  assert (isQuantized());
+  int n = feature.size()+1;
+  result.resizeWithUndefinedData (RQuantized.size());
+  for (int r=0; r<n; r++) {
+    const short* qP = RQuantized.begin() + r*(r+1)/2;
+    float* rP = result.begin() + r*(r+1)/2;
+    float scale = RScale[3*r];    
+    for (int j=1; j<r; j++) rP[j] = qP[j]*scale;
+    if (r>0) rP[0] = RScale[3*r+2];
+    rP[r] = RScale[3*r+1];
+  }
+  for (int i=n*(n+1)/2; i<result.size(); i++) result[i] = 0;
+}
@@ -46,6 +46,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tmTypes.h"
 #include "tmExtendedFeatureId.h"
 
+class TmThreadPool;
+
 //! An n-dimensional Gaussian. All statistical information is stored in these objecs.
 /*! We use homogenous coordinates adding a 1 as last entry to the
     vector. This way information matrix, information vector and
@@ -189,10 +191,22 @@ class TmGaussian
 
   //! Overloaded
   /*! If a workspace is provided, it is passed to \c xymGEQR2 and
-      allocation and deallocation can be avoided.
+      allocation and deallocation can be avoided. The result does not
+      depend on the memory reserved for \c R (\c xymGEQR2Packed).
   */
   void triangularize (XymVector& workspace);  
 
+  //! Overloaded, large Gaussians are factorized by several threads of \c pool
+  /*! \c thread is the number of the calling thread and \c pool may
+      be \c NULL. With at least \c XYM_QR_BLOCKED_MIN_COLS columns a
+      blocked QR is used and its trailing updates are split into
+      column ranges processed in parallel. The result is bitwise
+      identical to \c triangularize(workspace). If the xymlapack
+      library uses LAPACK (see \c xymIsNativeQR) everything is done
+      in the calling thread.
+  */
+  void triangularize (XymVector& workspace, TmThreadPool* pool, int thread);  
+
   /*! Multiplies \c this Gaussian by a marginalized distribution from
       another Gaussian overwriting \c this. \c gaussian must be in
       triangular form. Features \c gaussian.feature[0..fromFeature-1]
@@ -207,8 +221,120 @@ class TmGaussian
       in \c gaussian.feature are added to the counter in \c this->feature.
       This corresponds to the fact that the information from gaussian has
       been integrated into \c this.
+
+      If \c columnOfFeature is not \c NULL it must be an index of \c
+      feature built by \c indexColumns and is used to find the
+      columns of \c this corresponding to the columns of \c gaussian.
   */
-  void multiply (const TmGaussian& gaussian, int fromFeature=0);  
+  void multiply (const TmGaussian& gaussian, int fromFeature=0, const XycVector<int>* columnOfFeature=NULL);  
+
+  //! Creates a triangular Gaussian without information for \c multiplyTriangular
+  /*! \c R is set to a zero \c n*n matrix with \c n=feature.size()+1
+      and \c isTriangular to true. 
+   */
+  void createTriangular (const TmExtendedFeatureList& feature);
+
+  //! Same as \c multiply but keeps \c this triangular
+  /*! Instead of stacking the rows of \c gaussian below \c R and
+      triangularizing the whole matrix afterwards, every row is
+      rotated into the triangle \c R by Givens rotations. This
+      exploits that the rows of a triangular \c gaussian start at
+      increasing columns and that most entries of a row are known to
+      be 0 after mapping its columns to the columns of \c this. So
+      rotations are only applied from the first nonzero column of a
+      row on and zero entries are skipped. A row hitting a still empty
+      row of \c R is just copied there. Thus merging the (already
+      triangular) Gaussians of two children costs only a fraction of
+      the flops of a QR decomposition of the stacked matrix.
+
+      \c this must be triangular with \c R being \c cols()*cols(),
+      e.g. created by \c createTriangular. The rows of \c R
+      corresponding to features not yet determined stay 0. \c gaussian
+      can be compressed or not. If it is not triangular all its rows
+      are rotated in. \c workspace is used to hold the row being
+      rotated in.
+   */
+  void multiplyTriangular (const TmGaussian& gaussian, int fromFeature, XymVector& workspace);
+
+  //! Same as above using \c columnWorkspace for mapping columns, so nothing is allocated
+  /*! \c columnOfFeature is used as in \c multiply. */
+  void multiplyTriangular (const TmGaussian& gaussian, int fromFeature, XymVector& workspace, XycVector<int>& columnWorkspace,
+                           const XycVector<int>* columnOfFeature=NULL);
+
+  //! Same as \c createTriangular but with the triangle stored as \c RCompressed
+  /*! \c RCompressed is set to 0 reusing its memory if large enough
+      and \c R is cleared. Used with \c multiplyTriangularCompressed.
+   */
+  void createTriangularCompressed (const TmExtendedFeatureList& feature);
+
+  //! Mixed precision variant of \c multiplyTriangular working on \c RCompressed
+  /*! \c this must have been created by \c
+      createTriangularCompressed. The rows of \c gaussian are rotated
+      into the float triangle \c RCompressed, so the triangle is read
+      and written in half the bytes of the double triangle of \c
+      multiplyTriangular and no \c compressTo is needed
+      afterwards. The row being rotated in (in \c workspace) and the
+      rotations are computed in double, so only the entries of the
+      triangle are rounded to float, after every rotation instead of
+      once at the end. Whether this is accurate enough can be checked
+      by \c diagonalRatio (\c TmTreemap::mixedPrecisionDiagonalRatio).
+   */
+  void multiplyTriangularCompressed (const TmGaussian& gaussian, int fromFeature, XymVector& workspace, XycVector<int>& columnWorkspace,
+                                     const XycVector<int>* columnOfFeature=NULL);
+
+  //! Ratio of the smallest nonzero diagonal entry of the first \c upToFeature rows to the largest diagonal entry
+  /*! The homogenous column is not included and \c upToFeature<0
+      means all rows. This is a cheap lower bound on the inverse
+      condition of the part of the triangle used for backsubstitution
+      when the features \c upToFeature.. are given, i.e. passed to
+      the parent in \c TmNode. These rows are excluded, since they
+      are often rank deficient, e.g. for relative measurements
+      only. Returns 1 if there is no nonzero diagonal entry. \c this
+      must be triangular, compressed or not.
+   */
+  double diagonalRatio (int upToFeature=-1) const;
+
+  //! Sets \c columnOfFeature[feature[i].id]=i for all \c i
+  /*! Such an index lets \c multiply, \c multiplyTriangular and \c
+      multiplyTriangularCompressed find the column corresponding to a
+      column of the Gaussian multiplied in by a lookup instead of
+      searching \c feature, i.e. in O(n) instead of O(n*n). It is
+      built once for \c feature and then used for all Gaussians
+      multiplied in, e.g. both children in \c TmNode::updateGaussian.
+      \c columnOfFeature grows as needed with new entries set to
+      -1. For duplicate features the first column is used like when
+      searching.
+   */
+  static void indexColumns (const TmExtendedFeatureList& feature, XycVector<int>& columnOfFeature);
+
+  //! Resets the entries set by \c indexColumns to -1
+  /*! So the same \c columnOfFeature can be used for the next
+      feature list without clearing all of it. */
+  static void unindexColumns (const TmExtendedFeatureList& feature, XycVector<int>& columnOfFeature);
+
+  //! Column of \c this corresponding to feature \c id
+  /*! Uses \c columnOfFeature (see \c indexColumns) if not \c NULL
+      and searches \c feature otherwise. Returns -1 if \c id is not
+      a feature of \c this.
+   */
+  int columnOf (int id, const XycVector<int>* columnOfFeature) const
+    {
+      if (columnOfFeature!=NULL) {
+        if (id<(int) columnOfFeature->size()) return (*columnOfFeature)[id];
+        else return -1;
+      }
+      for (int i=0; i<(int) feature.size(); i++) 
+        if (feature[i].id==id) return i;
+      return -1;
+    }
+
+  //! Finds for every column \c j>=fromFeature of \c gaussian the corresponding column \c dstCol[j] of \c this
+  /*! The homogenous column is mapped to the homogenous column and
+      the counters of \c gaussian.feature are added to \c feature.
+      Used by \c multiplyTriangular and \c multiplyTriangularCompressed,
+      \c columnOfFeature as in \c columnOf.
+   */
+  void mapColumns (const TmGaussian& gaussian, int fromFeature, XycVector<int>& dstCol, const XycVector<int>* columnOfFeature);
 
   
   /*! Computes the Gaussians mean and stores it into \c x. If \c
@@ -234,19 +360,77 @@ class TmGaussian
       conditioned in reverse order. Then there follows empty space
       which is filled by \c meanCompressed for the features \c
       features[0..upToFeature-1] in reverse order. After that there
-      must be 4 float entries available which are filled with 0s. This
-      is necesary to allow the SSE optimized version to access four floats
-      regardless of where in the vector.
+      must be 4 float entries available which are filled with 0s. 
+
+      If compiled with \c USESSE on x86 an SSE2, AVX2 or AVX-512
+      kernel is used, chosen at program start from what the CPU
+      supports. The result agrees with the scalar version up to float
+      rounding.
+
+      If the Gaussian is quantized (\c quantize) the entries are
+      converted back to float while computing.
    */
-  void meanCompressed (float* x, int upToFeature);  
+  void meanCompressed (float* x, int upToFeature);
+
+  //! Same as \c meanCompressed but for an \c RCompressed array of a Gaussian with \c n columns
+  /*! Used for the nodes of a \c TmFrozenSubtree, that have no \c
+      TmGaussian. \c RCompressed must not be quantized. */
+  static void meanCompressed (const float* RCompressed, int n, float* x, int upToFeature);
 
 
   /*! Removes all information. \c isValid will return false. */
   void clear();
 
   //! Computes \c RCompressed from \c R and clears \c R.
-  /*! See \c RCompressed. */
-  void compress ();  
+  /*! See \c RCompressed. The memory of \c RCompressed is reused if
+      it is large enough. */
+  void compress ();
+
+  //! Stores the compressed form of \c this in \c g
+  /*! The memory of \c g.feature and \c g.RCompressed is reused if
+      large enough. Unlike \c compress, \c R is kept, so \c this can
+      be used as scratch space for computing Gaussians
+      (\c TmNode::updateGaussian). */
+  void compressTo (TmGaussian& g) const;
+
+  //! Same as \c triangularize(workspace,pool,thread) followed by \c compressTo(g)
+  /*! Gaussians with at most \c MAX_FIXED_COLS columns, i.e. all
+      leaves of the pose graph and most landmark leaves, are
+      triangularized by a kernel specialized for their number of
+      columns. It rotates the rows of \c R one by one into a
+      triangle on the stack and writes \c g.RCompressed directly,
+      leaving \c R unchanged. Larger Gaussians are triangularized in
+      \c R.
+  */
+  void triangularizeTo (TmGaussian& g, XymVector& workspace, TmThreadPool* pool, int thread);  
+
+  //! Gaussians up to this many columns are handled by the fixed size kernels of \c triangularizeTo
+  enum {MAX_FIXED_COLS=12};  
+
+  //! Writes \c R in the format of \c RCompressed into \c result
+  /*! Used by \c compress and \c compressTo. */
+  void compressR (XycVector<float>& result) const;  
+
+  //! Sets the size of \c result to \c rSize reusing its buffer if large enough
+  static void resizeCompressed (XycVector<float>& result, int rSize);
+
+  //! Converts \c RCompressed into \c RQuantized and frees \c RCompressed
+  /*! Halves the memory needed at the cost of a bounded error, see \c
+      RQuantized. The Gaussian can still be used in the same way, only
+      slightly slower. \c compressTo stores unquantized values again. */
+  void quantize ();
+
+  //! Writes \c RQuantized in the format of \c RCompressed into \c result
+  void dequantizeR (XycVector<float>& result) const;  
+
+  //! Whether \c R is stored as \c RCompressed or \c RQuantized
+  bool isCompressed () const {return !RCompressed.empty() || !RQuantized.empty();}
+
+  //! Whether \c R is stored as \c RQuantized
+  bool isQuantized () const {return !RQuantized.empty();}
+
+  //! Frees \c RQuantized and \c RScale after \c RCompressed has been set
+  void freeQuantized ();  
 
   //! Asserts internal consistency
   void assertIt () const;  
@@ -277,7 +461,7 @@ class TmGaussian
       may rather be trapezoidal.
   */
   int rows() const {
-    if (RCompressed.empty()) return R.rows();
+    if (!isCompressed()) return R.rows();
     else return feature.size()+1; // RCompressed is a full triangle    
   }
 
@@ -331,6 +515,28 @@ class TmGaussian
    */
   XycVector<float> RCompressed;  
 
+  //! Quantized version of \c RCompressed
+  /*! Stores the off-diagonal entries of \c RCompressed as 16 bit
+      integers with a scale factor for every row, i.e. 
+
+      R(i,j)   = RQuantized[RCompressedIdx(i,j)]*RScale[3*(n-i-1)]  for i<j<n-1
+      R(i,i)   = RScale[3*(n-i-1)+1]
+      R(i,n-1) = RScale[3*(n-i-1)+2]
+
+      The scale is chosen such that the largest quantized entry of
+      the row becomes 32767. So the error of an entry is at most
+      1/65534 of the largest one in its row. The diagonal and the
+      homogenous column, which is typically much larger than the
+      rest, are kept exactly.
+
+      Only one of \c RCompressed and \c RQuantized is used at a time.
+      See \c TmTreemap::quantizeGaussiansAfter.
+   */
+  XycVector<short> RQuantized;
+
+  //! Scale and diagonal of every row of \c RQuantized
+  XycVector<float> RScale;  
+
   //! Accessing row \c i, column \c j in R stored in a compressed way
   const float& RCompressedAt (int i, int j) const
     {
@@ -40,13 +40,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "tmNode.h"
 #include "tmTreemap.h"
+#include "tmThreadPool.h"
 #include <algorithm>
 
 
 TmNode::TmNode ()
   : index (-1), tree (NULL), parent(0), updateCost(0), worstCaseUpdateCost (0), 
     featurePassed(), linearizationPointFeature(-1),
-    gaussian(), firstFeaturePassed(-1), status (0) 
+    gaussian(), firstFeaturePassed(-1), estimateStamp (-1), gaussianStamp (-1), status (0) 
 {
   child[0] = child[1] = NULL;
 }
@@ -61,9 +62,17 @@ TmNode* TmNode::duplicate () const
 }
 
 
+TmNode* TmNode::duplicate (TmAllocator& allocator) const
+{
+  return new (allocator) TmNode (*this);
+}
+
+
 void TmNode::resetFlagEverywhere (int flag)
 {
   resetFlag (flag);
+  // The nodes below will be recomputed, so they must exist again
+  if (isFrozen() && (flag & (IS_FEATURE_PASSED_VALID | IS_GAUSSIAN_VALID))!=0) tree->thawSubtree (this);
   if (!isLeaf()) {
     child[0]->resetFlagEverywhere (flag);
     child[1]->resetFlagEverywhere (flag);
@@ -95,7 +104,8 @@ int TmNode::mergeFeatureLists ()
   const TmExtendedFeatureId* fBEnd = b.end();
   TmExtendedFeatureId* result = featurePassed.begin();
   int lpF = linearizationPointFeature;  
-  TmFeature* tF = tree->feature.begin();  
+  const int* tC = tree->feature.multiPurposeFields();
+  TmNode** tM = tree->feature.marginalizationNodes();  
 
   if (fA==fAEnd) goto fAEmpty;
   if (fB==fBEnd) goto fBEmpty;  
@@ -106,23 +116,23 @@ int TmNode::mergeFeatureLists ()
     n++;      
     if (bId<aId) { // only in 'b'
       int bCount = fB->count;
-      if (bId==lpF || bCount<tF[bId].totalCountOfExistingFeature()) {
+      if (bId==lpF || bCount<TmFeature::totalCountOfExistingFeature (tC[bId])) {
         result->id    = bId;
         result->count = bCount;        
         result++;
       }
-      else tF[bId].marginalizationNode = this;        
+      else tM[bId] = this;        
       fB++;
       if (fB==fBEnd) goto fBEmpty;
     }
     else if (bId==aId) { // in both
       int countSum = fA->count + fB->count;
-      if (bId==lpF || countSum<tF[bId].totalCountOfExistingFeature()) {
+      if (bId==lpF || countSum<TmFeature::totalCountOfExistingFeature (tC[bId])) {
         result->id    = bId;
         result->count = countSum;
         result++;
       }
-      else tF[bId].marginalizationNode = this;      
+      else tM[bId] = this;      
       fB++;
       fA++;
       if (fB==fBEnd) goto fBEmpty;
@@ -130,12 +140,12 @@ int TmNode::mergeFeatureLists ()
     }
     else { // only in 'a'
       int aCount = fA->count;      
-      if (aId==lpF || aCount<tF[aId].totalCountOfExistingFeature()) {
+      if (aId==lpF || aCount<TmFeature::totalCountOfExistingFeature (tC[aId])) {
         result->id    = aId;
         result->count = aCount;        
         result++;
       }
-      else tF[aId].marginalizationNode = this;        
+      else tM[aId] = this;        
       fA++;
       if (fA==fAEnd) goto fAEmpty;
     }
@@ -148,12 +158,12 @@ int TmNode::mergeFeatureLists ()
     n++;    
     int bId = fB->id;    
     int bCount = fB->count;    
-    if (bId==lpF || bCount<tF[bId].totalCountOfExistingFeature()) {
+    if (bId==lpF || bCount<TmFeature::totalCountOfExistingFeature (tC[bId])) {
       result->id    = bId;
       result->count = bCount;      
       result++;
     }
-    else tF[bId].marginalizationNode = this;        
+    else tM[bId] = this;        
     fB++;
   }
   featurePassed.eraseAfter (result);
@@ -165,12 +175,12 @@ int TmNode::mergeFeatureLists ()
     n++;    
     int aId = fA->id;    
     int aCount = fA->count;    
-    if (aId==lpF || aCount<tF[aId].totalCountOfExistingFeature()) {
+    if (aId==lpF || aCount<TmFeature::totalCountOfExistingFeature (tC[aId])) {
       result->id = aId;
       result->count = aCount;      
       result++;
     }
-    else tF[aId].marginalizationNode = this;        
+    else tM[aId] = this;        
     fA++;
   }
   featurePassed.eraseAfter (result);
@@ -219,6 +229,7 @@ int TmNode::mergeFeatureLists ()
 void TmNode::updateFeaturePassed ()
 {
   if (isFlag(IS_FEATURE_PASSED_VALID)) return;
+  if (isFrozen()) tree->thawSubtree (this);  
   int n;  
   featurePassed.clear(); 
   if (isLeaf()) {
@@ -284,48 +295,128 @@ void TmNode::updateGaussian ()
 {
   if (isFlag(IS_GAUSSIAN_VALID)) return;  
   updateFeaturePassed ();
+  double cost = 0;
+  long int nrOfUpdates = 0;  
+  updateGaussian (0, cost, nrOfUpdates);
+  tree->stat.accumulatedUpdateCost += cost;
+  tree->stat.nrOfGaussianUpdates += nrOfUpdates;  
+}
+
+
+//! Task for \c TmThreadPool updating the Gaussians below a node
+class TmUpdateGaussianTask : public TmThreadPool::Task
+{
+ public:
+  TmUpdateGaussianTask (TmNode* node)
+    :node(node), cost(0), nrOfUpdates(0)
+    {}  
+  
+  virtual void run (int thread) 
+    {
+      node->updateGaussian (thread, cost, nrOfUpdates);
+    }  
+
+  //! Root of the subtree to be updated
+  TmNode* node;  
+  //! Cost and nr of Gaussians updated, see \c TmNode::updateGaussian
+  double cost;
+  long int nrOfUpdates;  
+};
+
+
+void TmNode::updateGaussian (int thread, double& cost, long int& nrOfUpdates)
+{
+  if (isFlag(IS_GAUSSIAN_VALID)) return;  
+  assert (isFlag(IS_FEATURE_PASSED_VALID) && !isFrozen());  
   if (isLeaf()) {
-    TmExtendedFeatureList fl;
-    fl.reserve (gaussian.feature.size());
+    // The new Gaussian is computed in the thread's scratch memory
+    // and then compressed into \c gaussian reusing its buffers
+    TmAllocator::ThreadBuffers& buffers = tree->allocator.threadBuffers (thread);
+    TmExtendedFeatureList& fl = buffers.featureList;
+    TmGaussian& myGaussian = buffers.gaussian;
+    buffers.reserve (gaussian.feature.size(), gaussian.rows());
+    fl.clear();    
     addMarginalizedFeatures (fl, gaussian.feature);
     firstFeaturePassed = fl.size();    
     for (int i=0; i<(int) featurePassed.size(); i++)
       fl.push_back (TmExtendedFeatureId (featurePassed[i].id, 0));
-    TmGaussian myGaussian (fl, gaussian.rows());
+    myGaussian.create (fl, gaussian.rows());
     myGaussian.multiply (gaussian, 0);
     myGaussian.setLinearizationPoint (linearizationPointFeature, 0); // TODO 0 is wrong
-    myGaussian.triangularize (tree->workspace);
-    myGaussian.compress ();
-    gaussian.transferFrom (myGaussian);
+    buffers.featureLists.fit (gaussian.feature, fl.size());
+    buffers.floats.fit (gaussian.RCompressed, TmGaussian::rCompressedSize (myGaussian.R.cols()));    
+    myGaussian.triangularizeTo (gaussian, tree->workspaceOfThread (thread), tree->threadPool, thread);
   }  
   else {
-        // update recursively
-    child[0]->updateGaussian ();
-    child[1]->updateGaussian ();
-
-    TmExtendedFeatureList fl;
-    fl.reserve (child[0]->featurePassed.size()+child[1]->featurePassed.size());
+    // update recursively, in parallel if worthwhile
+    double cost0 = 0, cost1 = 0;
+    long int nrOfUpdates0 = 0, nrOfUpdates1 = 0;    
+    TmThreadPool* pool = tree->threadPool;    
+    if (pool!=NULL && updateCost>=tree->parallelUpdateThreshold &&
+        !child[0]->isFlag(IS_GAUSSIAN_VALID) && !child[1]->isFlag(IS_GAUSSIAN_VALID)) {
+      TmUpdateGaussianTask task (child[0]);
+      TmThreadPool::Group group;
+      pool->spawn (&task, group, thread);
+      child[1]->updateGaussian (thread, cost1, nrOfUpdates1);
+      pool->wait (group, thread);
+      cost0 = task.cost;
+      nrOfUpdates0 = task.nrOfUpdates;      
+    }
+    else {
+      child[0]->updateGaussian (thread, cost0, nrOfUpdates0);
+      child[1]->updateGaussian (thread, cost1, nrOfUpdates1);
+    }
+    cost += cost0;
+    cost += cost1;
+    nrOfUpdates += nrOfUpdates0 + nrOfUpdates1;    
+
+    // The children used the scratch memory as well, so it is taken only now
+    TmAllocator::ThreadBuffers& buffers = tree->allocator.threadBuffers (thread);
+    TmExtendedFeatureList& fl = buffers.featureList;
+    TmGaussian& myGaussian = buffers.gaussian;
+    int n = child[0]->featurePassed.size()+child[1]->featurePassed.size();    
+    buffers.reserve (n, n+1, max (child[0]->gaussian.cols(), child[1]->gaussian.cols()), tree->feature.size());
+    fl.clear();    
     addMarginalizedFeatures (fl, child[0]->featurePassed);
     addMarginalizedFeatures (fl, child[1]->featurePassed);
     firstFeaturePassed = fl.size();    
     for (int i=0; i<(int) featurePassed.size(); i++)
       fl.push_back (featurePassed[i]);
-    TmGaussian myGaussian( fl, child[0]->gaussian.rows() + child[1]->gaussian.rows());
-    myGaussian.multiply (child[0]->gaussian, child[0]->firstFeaturePassed);
-    // TODO we should rotate here
-    myGaussian.multiply (child[1]->gaussian, child[1]->firstFeaturePassed);    
-    // TODO we should rotate here
-    myGaussian.setLinearizationPoint (linearizationPointFeature, 0); // TODO 0 is wrong
-    myGaussian.triangularize (tree->workspace);    
-    myGaussian.compress ();
-    gaussian.transferFrom (myGaussian);
+    // Both children are triangular, so we rotate their rows into
+    // a triangle instead of stacking them and doing a full QR. The
+    // columns of both are mapped by the same index of \c fl.
+    XymVector& workspace = tree->workspaceOfThread (thread);
+    const XycVector<int>* index = &buffers.columnOfFeature;
+    TmGaussian::indexColumns (fl, buffers.columnOfFeature);
+    buffers.featureLists.fit (gaussian.feature, fl.size());
+    buffers.floats.fit (gaussian.RCompressed, TmGaussian::rCompressedSize (fl.size()+1));
+    bool done = false;
+    if (tree->mixedPrecisionDiagonalRatio>=0) {
+      // Rotate directly into the node's float triangle, see \c TmTreemap::mixedPrecisionDiagonalRatio
+      gaussian.createTriangularCompressed (fl);
+      gaussian.multiplyTriangularCompressed (child[0]->gaussian, child[0]->firstFeaturePassed, workspace, buffers.column, index);
+      gaussian.multiplyTriangularCompressed (child[1]->gaussian, child[1]->firstFeaturePassed, workspace, buffers.column, index);
+      gaussian.setLinearizationPoint (linearizationPointFeature, 0); // TODO 0 is wrong
+      done = gaussian.diagonalRatio (firstFeaturePassed)>=tree->mixedPrecisionDiagonalRatio;
+      if (!done) buffers.nrOfMixedPrecisionFallbacks++;
+    }
+    if (!done) {
+      myGaussian.createTriangular (fl);
+      myGaussian.multiplyTriangular (child[0]->gaussian, child[0]->firstFeaturePassed, workspace, buffers.column, index);
+      myGaussian.multiplyTriangular (child[1]->gaussian, child[1]->firstFeaturePassed, workspace, buffers.column, index);
+      myGaussian.setLinearizationPoint (linearizationPointFeature, 0); // TODO 0 is wrong
+      myGaussian.compressTo (gaussian);
+    }
+    TmGaussian::unindexColumns (fl, buffers.columnOfFeature);
   }
 #if ASSERT_LEVEL>=1
   gaussian.assertIt ();  
 #endif
-  tree->stat.accumulatedUpdateCost += updateCost;
-  tree->stat.nrOfGaussianUpdates++;  
+  cost += updateCost;
+  nrOfUpdates++;  
+  gaussianStamp = tree->estimateStamp;  
   setFlag (IS_GAUSSIAN_VALID);  
+  resetFlag (IS_ESTIMATE_VALID | IS_SUBTREE_ESTIMATE_VALID);  
 }
 
 
@@ -381,18 +472,7 @@ void TmNode::estimate ()
 {
   assert (isFlag(IS_GAUSSIAN_VALID));
   if (isFlag (DONT_UPDATE_ESTIMATE)) return;  
-  XymVector& v = tree->workspace;  
-  v.resize (gaussian.feature.size());
-  // Fill lower part of v with estimates for features already passed
-  for (int i=firstFeaturePassed; i<v.size(); i++)  
-    v[i] = tree->feature[gaussian.feature[i].id].est;
-  // We should rotate here
-  // Compute estimate for upper part as conditioned mean
-  gaussian.mean (v, firstFeaturePassed);
-  for (int i=0; i<firstFeaturePassed; i++) {    
-    tree->feature[gaussian.feature[i].id].est = v[i];
-    assert (finite(v[i]));
-  }  
+  estimateMarginalized (0);
   if (!isLeaf()) {
     child[0]->estimate ();
     child[1]->estimate ();
@@ -400,35 +480,153 @@ void TmNode::estimate ()
 }
 
 
+void TmNode::estimateMarginalized (int thread)
+{
+  if (!gaussian.isCompressed()) {
+    XymVector& v = tree->workspaceOfThread (thread);  
+    v.resize (gaussian.feature.size());
+    // Fill lower part of v with estimates for features already passed
+    for (int i=firstFeaturePassed; i<v.size(); i++)  
+      v[i] = tree->feature[gaussian.feature[i].id].est;
+    // We should rotate here
+    // Compute estimate for upper part as conditioned mean
+    gaussian.mean (v, firstFeaturePassed);
+    for (int i=0; i<firstFeaturePassed; i++) {    
+      tree->feature[gaussian.feature[i].id].est = v[i];
+      assert (finite(v[i]));
+    }
+  }
+  else {
+    XycVector<float>& workspaceFloat = tree->workspaceFloatOfThread (thread);  
+    workspaceFloat.resize (gaussian.feature.size()+5);  // We need 5 as additional space for the SSE implementation
+    // Fill v with estimates for features already passed in reverse order
+    float* v  = workspaceFloat.begin();
+    *v = 1; // homogenous 1
+    v++;    
+    const TmExtendedFeatureId* f = gaussian.feature.begin();
+    int nPassed = gaussian.feature.size() - firstFeaturePassed;
+    tree->feature.gatherEstimatesReversed (f+firstFeaturePassed, nPassed, v);
+    v += nPassed;    
+    // Compute mean of remaining features conditioned on the one stored in v
+    gaussian.meanCompressed (workspaceFloat.begin(), firstFeaturePassed);
+    // Store the result in the feature estimates
+    tree->feature.scatterEstimatesReversed (f, firstFeaturePassed, v);
+  }
+  if (isFrozen()) frozen.estimate (tree->feature, tree->workspaceFloatOfThread (thread), tree->allocator.threadBuffers (thread).featureList);  
+  estimateStamp = tree->estimateStamp;
+  if (tree->incrementalEstimateEpsilon>=0) {
+    // Remember from what we computed the estimate
+    int n = gaussian.feature.size() - firstFeaturePassed;
+    estimateInput.resize (n);
+    const TmExtendedFeatureId* f = gaussian.feature.begin() + firstFeaturePassed;
+    tree->feature.gatherEstimates (f, n, estimateInput.begin());
+    setFlag (IS_ESTIMATE_VALID);
+  }
+  else {
+    estimateInput.clear();
+    resetFlag (IS_ESTIMATE_VALID);
+  }
+  resetFlag (IS_SUBTREE_ESTIMATE_VALID);  
+}
+
+
+bool TmNode::hasEstimateInputChanged (float epsilon) const
+{
+  int n = gaussian.feature.size() - firstFeaturePassed;
+  if ((int) estimateInput.size()!=n) return true;
+  const TmExtendedFeatureId* f = gaussian.feature.begin() + firstFeaturePassed;
+  const float* est = tree->feature.estimates();  
+  for (int i=0; i<n; i++) 
+    if (!(fabs (est[f[i].id] - estimateInput[i])<=epsilon)) return true;
+  return false;  
+}
+
+
+void TmNode::estimateFromRoot ()
+{
+  assert (isFlag(IS_GAUSSIAN_VALID));
+  if (estimateStamp==tree->estimateStamp) return;
+  if (parent!=NULL) {
+    parent->estimateFromRoot ();
+    // The subtrees of the ancestors are not consistent any more
+    parent->resetFlagUpToRoot (IS_SUBTREE_ESTIMATE_VALID);
+  }
+  estimateMarginalized (0);
+}
+
+
 void TmNode::estimateUsingRCompressed ()
 {
-  if (isFlag (DONT_UPDATE_ESTIMATE)) return;  
-  tree->workspaceFloat.resize (gaussian.feature.size()+5);  // We need 5 as additional space for the SSE implementation
-  // Fill v with estimates for features already passed in reverse order
-  float* v  = tree->workspaceFloat.begin();
-  float* vE = v + gaussian.feature.size() + 1;  
-  *v = 1; // homogenous 1
-  v++;    
-  TmExtendedFeatureId* srcP  = gaussian.feature.end() -1;
-  TmExtendedFeatureId* srcPE = gaussian.feature.begin() + firstFeaturePassed-1;
-  while (srcP!=srcPE) {
-    *v = tree->feature[srcP->id].est;
-    srcP--;
-    v++;
-  }
-  // Compute mean of remaining features conditioned on the one stored in v
-  gaussian.meanCompressed (tree->workspaceFloat.begin(), firstFeaturePassed);
-  // Store the result in the feature estimates
-  while (v!=vE) {
-    tree->feature[srcP->id].est = *v;
-    srcP--;
-    v++;
+  long int nrOfEstimates = 0;  
+  estimateUsingRCompressed (0, tree->parallelEstimationDepth(), nrOfEstimates);
+  tree->stat.nrOfEstimates += nrOfEstimates;
+  tree->stat.nrOfNodesNotEstimated = tree->stat.nrOfNodes - nrOfEstimates;  
+}
+
+
+//! Task for \c TmThreadPool estimating the features below a node
+class TmEstimateTask : public TmThreadPool::Task
+{
+ public:
+  TmEstimateTask (TmNode* node, int forkDepth)
+    :node(node), forkDepth(forkDepth), nrOfEstimates(0), isConsistent(false)
+    {}  
+  
+  virtual void run (int thread) 
+    {
+      isConsistent = node->estimateUsingRCompressed (thread, forkDepth, nrOfEstimates);
+    }  
+
+  //! Root of the subtree to be estimated
+  TmNode* node;  
+  //! See \c TmNode::estimateUsingRCompressed
+  int forkDepth;  
+  //! Nr of nodes estimated and return value, see \c TmNode::estimateUsingRCompressed
+  long int nrOfEstimates;
+  bool isConsistent;  
+};
+
+
+bool TmNode::estimateUsingRCompressed (int thread, int forkDepth, long int& nrOfEstimates)
+{
+  if (isFlag (DONT_UPDATE_ESTIMATE)) return false;  
+  float epsilon = tree->incrementalEstimateEpsilon;  
+  bool isSkipped = epsilon>=0 && isFlag (IS_ESTIMATE_VALID) && !hasEstimateInputChanged (epsilon);
+  if (isSkipped) {
+    // The estimates here are still good enough
+    estimateStamp = tree->estimateStamp;    
+    if (isFlag (IS_SUBTREE_ESTIMATE_VALID)) return false;
+  }
+  else {
+    estimateMarginalized (thread);
+    nrOfEstimates++;    
   }  
   // Go recursively down
+  bool isConsistent = true;  
   if (!isLeaf()) {
-    child[0]->estimateUsingRCompressed ();
-    child[1]->estimateUsingRCompressed ();
+    TmThreadPool* pool = tree->threadPool;    
+    long int nrOfEstimates0 = 0, nrOfEstimates1 = 0;
+    bool isConsistent0, isConsistent1;    
+    if (pool!=NULL && forkDepth>0 &&
+        !child[0]->isFlag (DONT_UPDATE_ESTIMATE) && !child[1]->isFlag (DONT_UPDATE_ESTIMATE)) {
+      TmEstimateTask task (child[0], forkDepth-1);
+      TmThreadPool::Group group;
+      pool->spawn (&task, group, thread);
+      isConsistent1 = child[1]->estimateUsingRCompressed (thread, forkDepth-1, nrOfEstimates1);
+      pool->wait (group, thread);
+      isConsistent0 = task.isConsistent;
+      nrOfEstimates0 = task.nrOfEstimates;      
+    }
+    else {
+      isConsistent0 = child[0]->estimateUsingRCompressed (thread, forkDepth-1, nrOfEstimates0);
+      isConsistent1 = child[1]->estimateUsingRCompressed (thread, forkDepth-1, nrOfEstimates1);
+    }
+    nrOfEstimates += nrOfEstimates0 + nrOfEstimates1;
+    isConsistent = isConsistent0 && isConsistent1;    
   }  
+  if (isSkipped || epsilon<0 || !isConsistent) return false;
+  setFlag (IS_SUBTREE_ESTIMATE_VALID);
+  return true;  
 }
 
 
@@ -453,10 +651,10 @@ void TmNode::beforeChange ()
   // invalidate all old marginalization nodes, subtract from totalCount
   for (int i=0; i<(int) this->gaussian.feature.size(); i++) {
     TmFeatureId id = this->gaussian.feature[i].id;
-    TmFeature& feat = tree->feature[id];
+    TmFeature feat = tree->feature[id];
     feat.addTotalCount (-this->gaussian.feature[i].count);
     if (feat.marginalizationNode!=NULL) {
-      feat.marginalizationNode->resetFlagUpToRoot (IS_FEATURE_PASSED_VALID | IS_GAUSSIAN_VALID);
+      tree->thawMarginalizationNode (id)->resetFlagUpToRoot (IS_FEATURE_PASSED_VALID | IS_GAUSSIAN_VALID);
       feat.marginalizationNode=NULL;
     }    
   }
@@ -471,10 +669,10 @@ void TmNode::afterChange ()
   for (int i=0; i<(int) this->gaussian.feature.size(); i++) {
     TmFeatureId id = this->gaussian.feature[i].id;
     if (id>=(int) tree->feature.size()) tree->feature.resize (id+1);    
-    TmFeature& feat = tree->feature[id];
+    TmFeature feat = tree->feature[id];
     feat.addTotalCount (this->gaussian.feature[i].count);    
     if (feat.marginalizationNode!=NULL) {
-      feat.marginalizationNode->resetFlagUpToRoot (IS_FEATURE_PASSED_VALID | IS_GAUSSIAN_VALID);
+      tree->thawMarginalizationNode (id)->resetFlagUpToRoot (IS_FEATURE_PASSED_VALID | IS_GAUSSIAN_VALID);
       feat.marginalizationNode = NULL;
     }    
   }  
@@ -493,6 +691,12 @@ void TmNode::afterChange ()
 
 int TmNode::rowsBelow () const
 {
+  if (isFrozen()) {
+    int rows = 0;
+    for (const TmFrozenNode* fn=frozen.begin(); fn!=frozen.end(); fn=fn->next()) 
+      if (fn->isLeaf()) rows += fn->n+1;
+    return rows;    
+  }  
   if (isLeaf()) return gaussian.rows();
   else return child[0]->rowsBelow () + child[1]->rowsBelow ();
 }
@@ -516,10 +720,13 @@ void TmNode::assertIt () const
   assert (tree->node[index]==this);
   assertInTree ();  
   if (isLeaf()) {
+    if (isFrozen()) 
+      assert (isFlag(IS_FEATURE_PASSED_VALID) && isFlag(IS_GAUSSIAN_VALID) && !isFlag(CAN_BE_INTEGRATED));
   }
   else {
     assert (child[0]->parent==this);
     assert (child[1]->parent==this);    
+    assert (!isFrozen());    
   }
   if (isFlag(IS_FEATURE_PASSED_VALID)) {
     if (!isLeaf()) {
@@ -541,7 +748,7 @@ void TmNode::assertIt () const
   }
   if (tree->isGaussianValidValid && isFlag(IS_GAUSSIAN_VALID)) {
     assert (gaussian.isTriangular);
-    assert (gaussian.R.isValid() || !gaussian.RCompressed.empty());    
+    assert (gaussian.R.isValid() || gaussian.isCompressed());    
     if (gaussian.R.isValid()) {      
       assert (gaussian.R.cols()==(int) gaussian.feature.size()+1);
       assert (gaussian.R.rows()<=(int) gaussian.feature.size()+1);    
@@ -726,7 +933,7 @@ void TmNode::setToBeOptimized ()
 {
   if (isFlag(IS_OPTIMIZED)) {
     resetFlag (IS_OPTIMIZED);
-    tree->optimizer.optimizationQueue.push_back (this->index);    
+    tree->optimizer.optimizationQueue.push (index, tree->optimizer.priority (this));    
   }
 }
 
@@ -775,6 +982,7 @@ void TmNode::recursiveAssertFlag (int flag)
 
 void TmNode::recursiveAddLeavesInvolving (TmFeatureId id, XycVector<TmNode*>& node, int& ctr) 
 {
+  if (isFrozen()) tree->thawSubtree (this);  
   if (isLeaf()) {
 //    if (isElement (gaussian.feature, id)) node.push_back (this);
     bool first = true;    
@@ -808,6 +1016,7 @@ void  TmNode::assertInTree () const
 
 void TmNode::recursivelyIdentifyFeature (int from, int to)
 {
+  if (isFrozen()) tree->thawSubtree (this);  
   if (isLeaf()) {
     for (int i=0; i<(int) gaussian.feature.size(); i++) {      
       if (gaussian.feature[i].id==from) {
@@ -827,7 +1036,9 @@ void TmNode::recursivelyIdentifyFeature (int from, int to)
 int TmNode::memory() const
 {
   int mem = sizeof (TmNode);
-  mem += featurePassed.capacity() * sizeof(TmExtendedFeatureId);
+  mem += featurePassed.memory();
+  mem += estimateInput.capacity() * sizeof(float);
+  mem += frozen.memory();  
   mem += gaussian.memory() - sizeof(TmGaussian); // TmGaussian itself is included in sizeof(*this);  
   return mem;  
 }
@@ -44,6 +44,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tmTypes.h"
 #include "tmGaussian.h"
 #include "tmExtendedFeatureId.h"
+#include "tmAllocator.h"
+#include "tmFrozenSubtree.h"
 #include <limits.h>
 
 
@@ -69,12 +71,29 @@ class TmNode
   */
   virtual ~TmNode();
 
+  //! Allocates a node from the pool of a \c TmTreemap
+  /*! Used as \c new \c (tree->allocator) \c TmNode for all nodes
+      added to the tree. */
+  static void* operator new (size_t size, TmAllocator& allocator) {return allocator.allocate (size);}
+
+  //! Allocates a node on the heap
+  static void* operator new (size_t size) {return TmAllocator::allocateOnHeap (size);}
+
+  //! Frees a node, no matter how it was allocated
+  static void operator delete (void* p) {TmAllocator::deallocate (p);}
+
+  //! Called if the constructor after \c new \c (allocator) throws
+  static void operator delete (void* p, TmAllocator&) {TmAllocator::deallocate (p);}
 
   //! Returns a polymorphic shallow copy of \c this
   /*! Must be overloaded by any derived class. Calls the copy
       constructor of the same class.
   */
   virtual TmNode* duplicate () const;  
+
+  //! Like \c duplicate but allocates the copy by \c new \c (allocator)
+  /*! Must be overloaded by any derived class as well. */
+  virtual TmNode* duplicate (TmAllocator& allocator) const;  
   
 
   //! A consecutive index for identifying nodes
@@ -154,6 +173,41 @@ class TmNode
   /*! See \c gaussian. */
   int firstFeaturePassed;
 
+  //! Value of \c tree->estimateStamp when the estimates of the features marginalized here were computed
+  /*! If equal to \c tree->estimateStamp, the estimates of the
+      features marginalized out at this node and at all its ancestors
+      are up to date, so \c estimateFromRoot can stop here.
+   */
+  int estimateStamp;
+
+  //! Value of \c tree->estimateStamp when \c gaussian was last computed
+  /*! Used by \c TmTreemap::canBeQuantized to find nodes whose
+      Gaussian has not been changed for a long time. */
+  int gaussianStamp;  
+
+  //! Estimates of \c featurePassed from which the estimates here were computed
+  /*! Only maintained if \c tree->incrementalEstimateEpsilon>=0. Then
+      \c estimateUsingRCompressed compares them to the current
+      estimates to decide whether the node can be skipped. Stored in
+      the order of \c gaussian.feature[firstFeaturePassed..].
+   */
+  XycVector<float> estimateInput;  
+
+  //! The nodes below \c this if they have been frozen
+  /*! See \c TmTreemap::freezeSubtrees. Then \c child[0] and \c
+      child[1] are \c NULL, so the node looks like a leaf with \c
+      gaussian as original distribution, and \c
+      TmFeature::marginalizationNode of all features marginalized out
+      below points to \c this. \c estimateMarginalized also estimates
+      these features. The node is not \c CAN_BE_INTEGRATED, so it is
+      never joined, and any routine that needs the nodes below calls
+      \c TmTreemap::thawSubtree first.
+   */
+  TmFrozenSubtree frozen;
+
+  //! Whether the nodes below are stored in \c frozen
+  bool isFrozen () const {return !frozen.empty();}  
+
   //! Different status bits
   /*! All validity flags follow the flow of information in the
       tree. If something is invalid at a node then it is invalid at
@@ -161,7 +215,8 @@ class TmNode
   */
   enum NodeFlags {IS_FEATURE_PASSED_VALID=1, IS_GAUSSIAN_VALID=2, 
                   IS_OPTIMIZED=4, DONT_UPDATE_ESTIMATE=8,
-                  CAN_BE_MOVED=16, CAN_BE_INTEGRATED=32};  
+                  CAN_BE_MOVED=16, CAN_BE_INTEGRATED=32,
+                  IS_ESTIMATE_VALID=64, IS_SUBTREE_ESTIMATE_VALID=128};  
 
   /*! \var IS_FEATURE_PASSED_VALID 
    
@@ -207,6 +262,22 @@ class TmNode
       get completely rid of this node. If this is done, the Gaussian is fixed
       forever and cannot be recomputed with new linearizations points. 
   */
+  /*! \var IS_ESTIMATE_VALID
+
+      whether the estimates of the features marginalized out at this
+      node have been computed from the current \c gaussian and the
+      estimates stored in \c estimateInput. Only used for incremental
+      estimation (\c TmTreemap::incrementalEstimateEpsilon) and reset
+      whenever the Gaussian is recomputed.
+  */
+  /*! \var IS_SUBTREE_ESTIMATE_VALID
+
+      whether \c IS_ESTIMATE_VALID holds for all nodes below and all
+      of them have been estimated in the same run as this node without
+      being skipped. Then the whole subtree can be skipped if the
+      estimates in \c estimateInput did not change. Being set at a
+      node implies being set at its children.
+  */
 
       
   //! Different status bits or'ed
@@ -245,7 +316,7 @@ class TmNode
 
   //! Indicates that this node has to be optimized later on.
   /*! If \c IS_OPTIMIZED is not set nothing is done. If it is set, it is
-      reset and \c this added to the end of \c tree->optimizationQueue.
+      reset and \c this added to \c tree->optimizer.optimizationQueue.
    */
   void setToBeOptimized ();
 
@@ -289,9 +360,29 @@ class TmNode
       node then defines no \c .linearizationPointFeature and cannot be
       rotated further. This rotation is performed by \c
       TmTreemap::rotateGaussian.
+
+      If \c tree has a thread pool (\c TmTreemap::setNrOfThreads),
+      independent subtrees are updated in parallel. See the overloaded
+      version.
   */
   void updateGaussian ();
 
+  //! Recursive subroutine of \c updateGaussian () executed by thread \c thread
+  /*! \c .featurePassed must be valid. Uses the workspace of \c
+      thread (\c TmTreemap::workspaceOfThread). If the Gaussians of
+      both children are invalid and \c updateCost is at least \c
+      TmTreemap::parallelUpdateThreshold, the first child is spawned
+      as a task to \c TmTreemap::threadPool while the second child is
+      updated by this thread.
+
+      The cost and number of Gaussians updated are added to \c cost
+      and \c nrOfUpdates. The sums are formed along the tree, so the
+      result does not depend on which thread did what. As every node
+      is computed only from its children the Gaussians are bitwise
+      identical to the serial computation.
+  */
+  void updateGaussian (int thread, double& cost, long int& nrOfUpdates);
+
   //! Recursively estimates all features marginalized out at or below this node.
   /*! The estimate (\c tree->feature) for all features in \c
       featuresPassed must already be computed. 
@@ -299,7 +390,53 @@ class TmNode
   void estimate ();  
 
   //! Same as \c estimate but uses the optimized representation in \c TmGaussian::RCompressed 
+  /*! If \c tree has a thread pool (\c TmTreemap::setNrOfThreads),
+      the subtrees are estimated in parallel. See the overloaded
+      version. */
   void estimateUsingRCompressed ();
+
+  //! Recursive subroutine of \c estimateUsingRCompressed () executed by thread \c thread
+  /*! Uses the float workspace of \c thread (\c
+      TmTreemap::workspaceFloatOfThread). A node only reads the
+      estimates of the features passed from its parent and writes the
+      estimates of the features marginalized out at itself. So after a
+      node is finished its two subtrees are independent. If \c
+      forkDepth>0 and both children need an estimate, the first child
+      is spawned as a task to \c TmTreemap::threadPool while this
+      thread continues with the second one. Nodes flagged \c
+      DONT_UPDATE_ESTIMATE are skipped with their subtree as usual.
+
+      If \c tree->incrementalEstimateEpsilon>=0, a node is not
+      recomputed if its Gaussian did not change and no estimate in
+      \c featurePassed moved by more than the epsilon since it was
+      computed (\c IS_ESTIMATE_VALID). If additionally \c
+      IS_SUBTREE_ESTIMATE_VALID is set, the whole subtree is skipped.
+      Adds the number of nodes actually estimated to \c
+      nrOfEstimates. Returns whether \c IS_SUBTREE_ESTIMATE_VALID was
+      set in this run.
+   */
+  bool estimateUsingRCompressed (int thread, int forkDepth, long int& nrOfEstimates);
+
+  //! Whether some estimate in \c featurePassed differs from \c estimateInput by more than \c epsilon
+  bool hasEstimateInputChanged (float epsilon) const;  
+
+  //! Estimates the features marginalized out at this node and not below
+  /*! The estimate of the features in \c featurePassed must already
+      be computed. Uses \c gaussian.RCompressed if available and the
+      workspace of thread \c thread. Sets \c estimateStamp and, for
+      incremental estimation, \c estimateInput and \c
+      IS_ESTIMATE_VALID.
+   */
+  void estimateMarginalized (int thread);  
+
+  //! Estimates the features marginalized out at this node and all ancestors
+  /*! Only nodes where \c estimateStamp is outdated are computed,
+      starting with the topmost one. So the cost is proportional to
+      the depth of the node and sucessive calls for nodes in the same
+      region of the tree reuse the common part of the path. \c
+      DONT_UPDATE_ESTIMATE is ignored. The Gaussians must be valid.
+  */
+  void estimateFromRoot ();  
   
 
   //! Changes the original distribution of a leaf to \c gaussian.
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!\file tmOptimizationQueue.cc 
+   \brief Implementation of \c TmOptimizationQueue
+   \author Udo Frese
+
+  Contains the implementation of class \c TmOptimizationQueue, the
+  indexed priority queue of nodes waiting for the HTP optimization.
+*/
+#include "tmOptimizationQueue.h"
+
+TmOptimizationQueue::TmOptimizationQueue ()
+  :heap(), entry(), nextSequence(0)
+{}
+
+
+void TmOptimizationQueue::push (int index, double priority)
+{
+  assert (index>=0);  
+  if (index>=(int) entry.size()) entry.resize (index+1);
+  Entry& e = entry[index];
+  if (e.position<0) {
+    e.position = heap.size();
+    e.sequence = nextSequence++;    
+    heap.push_back (index);
+    e.priority = priority;
+    moveUp (e.position);
+  }
+  else {
+    double oldPriority = e.priority;
+    e.priority = priority;
+    if (priority>oldPriority) moveUp (e.position);
+    else moveDown (e.position);
+  }  
+}
+
+
+void TmOptimizationQueue::remove (int index)
+{
+  if (!contains (index)) return;
+  int i = entry[index].position;
+  int last = heap.size()-1;  
+  if (i!=last) swap (i, last);
+  heap.pop_back();
+  entry[index].position = -1;
+  if (i!=last) {
+    moveUp (i);
+    moveDown (i);
+  }  
+}
+
+
+void TmOptimizationQueue::clear ()
+{
+  for (int i=0; i<(int) heap.size(); i++) entry[heap[i]].position = -1;
+  heap.clear();
+}
+
+
+int TmOptimizationQueue::memory () const
+{
+  return sizeof(TmOptimizationQueue) + heap.capacity()*sizeof(int) + entry.capacity()*sizeof(Entry);
+}
+
+
+void TmOptimizationQueue::swap (int i, int j)
+{
+  int h = heap[i];
+  heap[i] = heap[j];
+  heap[j] = h;
+  entry[heap[i]].position = i;
+  entry[heap[j]].position = j;  
+}
+
+
+void TmOptimizationQueue::moveUp (int i)
+{
+  while (i>0) {
+    int parent = (i-1)/2;
+    if (!isBefore (i, parent)) break;
+    swap (i, parent);
+    i = parent;    
+  }  
+}
+
+
+void TmOptimizationQueue::moveDown (int i)
+{
+  int n = heap.size();  
+  while (true) {
+    int best = i;
+    int c = 2*i+1;    
+    if (c<n && isBefore (c, best)) best = c;
+    if (c+1<n && isBefore (c+1, best)) best = c+1;
+    if (best==i) break;
+    swap (i, best);
+    i = best;    
+  }  
+}
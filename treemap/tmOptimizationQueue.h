@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TMOPTIMIZATIONQUEUE_H
+#define TMOPTIMIZATIONQUEUE_H
+
+
+/*!\file tmOptimizationQueue.h
+   \brief Class \c TmOptimizationQueue, the priority queue of nodes to be optimized
+
+   \author Udo Frese
+*/
+
+#include "tmTypes.h"
+
+//! Indexed priority queue of node indices for \c TmTreemap::Optimizer
+/*! Every node index is contained at most once together with a
+    priority. \c front() is the index with the largest priority, among
+    indices with equal priority the one inserted first. Pushing an
+    index that is already contained only changes its priority. So the
+    priority can be increased or decreased in \c O(log n).
+
+    The queue is a binary heap over \c heap. \c entry[index] holds
+    priority and position in \c heap of every index. So \c entry has
+    the size of the largest index pushed and the queue does not
+    allocate memory once all nodes have been pushed.
+*/
+class TmOptimizationQueue 
+{
+ public:
+  //! Empty queue
+  TmOptimizationQueue ();
+
+  //! Whether there is no index in the queue
+  bool empty () const {return heap.empty();}  
+
+  //! Number of indices in the queue
+  int size () const {return heap.size();}  
+
+  //! The \c i-th index in heap order (not in order of priority)
+  int operator[] (int i) const {return heap[i];}  
+
+  //! The index with the largest priority
+  int front () const {
+    assert (!heap.empty());
+    return heap[0];    
+  }  
+
+  //! Whether \c index is in the queue
+  bool contains (int index) const {
+    return index>=0 && index<(int) entry.size() && entry[index].position>=0;
+  }  
+
+  //! Priority of \c index, which must be in the queue
+  double priority (int index) const {
+    assert (contains (index));
+    return entry[index].priority;
+  }  
+
+  //! Inserts \c index or changes its priority if it is already in the queue
+  void push (int index, double priority);  
+
+  //! Removes \c front()
+  void pop_front () {remove (front());}  
+
+  //! Removes \c index if it is in the queue
+  void remove (int index);
+
+  //! Removes all indices
+  void clear ();  
+
+  //! Memory consumption in bytes
+  int memory () const;  
+
+ protected:
+  //! Priority and heap position of one index
+  class Entry 
+    {
+    public:
+      Entry () :priority(0), position(-1), sequence(0) {}
+      
+      //! Priority the index has been pushed with
+      double priority;
+
+      //! Position in \c heap or \c -1 if not in the queue
+      int position;
+      
+      //! Order of insertion used to break ties in \c priority
+      long sequence;      
+    };  
+
+  //! Whether the index at \c heap[i] has to be in front of the one at \c heap[j]
+  bool isBefore (int i, int j) const {
+    const Entry& a = entry[heap[i]];
+    const Entry& b = entry[heap[j]];
+    return a.priority>b.priority || (a.priority==b.priority && a.sequence<b.sequence);
+  }  
+
+  //! Exchanges \c heap[i] and \c heap[j] updating \c Entry::position
+  void swap (int i, int j);  
+
+  //! Restores the heap property from \c heap[i] upwards
+  void moveUp (int i);
+
+  //! Restores the heap property from \c heap[i] downwards
+  void moveDown (int i);  
+
+  //! Binary heap of the indices in the queue
+  XycVector<int> heap;
+
+  //! Priority and heap position indexed by the index
+  XycVector<Entry> entry;
+
+  //! Sequence number given to the next inserted index
+  long nextSequence;  
+};
+
+#endif
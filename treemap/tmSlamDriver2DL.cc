@@ -110,7 +110,7 @@ void TmSlamDriver2DL::create (int nrOfLandmarks, int reservePoses, const VmVecto
   fl.push_back (poseFeature+1);
   fl.push_back (poseFeature+2);
 
-  NonlinearLeaf* leaf = new NonlinearLeaf (this);
+  NonlinearLeaf* leaf = new (allocator) NonlinearLeaf (this);
   leaf->resetFlag (TmNode::CAN_BE_INTEGRATED);  
   leaf->poseFeature = poseFeature;  
   leaf->absolutePose = AbsolutePose (poseFeature, initialPose, initialPoseCov);
@@ -275,6 +275,12 @@ void TmSlamDriver2DL::deleteFeature (TmFeatureId id)
 }
 
 
+int TmSlamDriver2DL::renumberFeatures ()
+{
+  return 0;  
+}
+
+
 void TmSlamDriver2DL::hasBeenSparsifiedOut (TmFeatureId id)
 {
   TmTreemap::hasBeenSparsifiedOut (id);
@@ -316,7 +322,7 @@ void TmSlamDriver2DL::observe (const ObservationList& observation)
 
 
 
-  NonlinearLeaf* leaf = new NonlinearLeaf (this);
+  NonlinearLeaf* leaf = new (allocator) NonlinearLeaf (this);
   leaf->resetFlag (TmNode::CAN_BE_INTEGRATED);  
   leaf->poseFeature = poseFeature;  
   leaf->odometry = Odometry (oldPoseFeature, poseFeature, relativePose, relativePoseCov);
@@ -419,6 +425,12 @@ TmNode* TmSlamDriver2DL::NonlinearLeaf::duplicate() const
 }
 
 
+TmNode* TmSlamDriver2DL::NonlinearLeaf::duplicate (TmAllocator& allocator) const
+{
+  return new (allocator) NonlinearLeaf (*this);
+}
+
+
 int TmSlamDriver2DL::NonlinearLeaf::memory() const
 {
   return TmNode::memory () - sizeof(TmNode) + sizeof (TmSlamDriver2DL) + 
@@ -613,7 +625,7 @@ void TmSlamDriver2DL::checkForSparsification (TmNode* n)
   TmExtendedFeatureList fl;
   n->computeFeaturesInvolved (fl);
   for (int i=0; i<(int) fl.size(); i++) {
-    TmFeature& f = feature[fl[i].id];    
+    TmFeature f = feature[fl[i].id];    
     if (f.marginalizationNode==n && f.userFlag()==POSEX && canBeSparsifiedOut (fl[i].id))
       sparsifyOut (fl[i].id, 3); // Always sparsify out POSEX, POSEY, POSETHETA
   }
@@ -682,7 +694,7 @@ void TmSlamDriver2DL::onlyUpdateLevel (int level, bool setDontUpdateFlag)
     Pose& p = pose[i];    
     assert (p.level==level);    
     if (p.featureId>=0) {
-      TmFeature& f = feature[p.featureId];
+      TmFeature f = feature[p.featureId];
       if (f.marginalizationNode!=NULL) f.marginalizationNode->resetFlagUpToRoot (TmNode::DONT_UPDATE_ESTIMATE);
     }
     i = p.nextPoseInSameLevel;    
@@ -692,7 +704,7 @@ void TmSlamDriver2DL::onlyUpdateLevel (int level, bool setDontUpdateFlag)
     Landmark& lm = landmark[i];    
     assert (lm.level==level);    
     if (lm.featureId>=0) {
-      TmFeature& f = feature[lm.featureId];
+      TmFeature f = feature[lm.featureId];
       if (f.marginalizationNode!=NULL) f.marginalizationNode->resetFlagUpToRoot (TmNode::DONT_UPDATE_ESTIMATE);
     }
     i = lm.nextLandmarkInSameLevel;    
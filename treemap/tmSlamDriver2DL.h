@@ -558,6 +558,9 @@ class TmSlamDriver2DL : public TmTreemap
       //! overloaded function virtually calling the copy constructor
       virtual TmNode* duplicate() const;      
 
+      //! overloaded function virtually calling the copy constructor
+      virtual TmNode* duplicate (TmAllocator& allocator) const;      
+
       //! Returns the storage space (Bytes) of this node without children
       virtual int memory() const;  
 
@@ -681,6 +684,13 @@ class TmSlamDriver2DL : public TmTreemap
   //! \c TmTreemap function overloaded to maintain \c pose.
   virtual void deleteFeature (TmFeatureId id);  
 
+  //! \c TmTreemap function overloaded, does nothing
+  /*! Poses and landmarks are found from their feature id by their
+      offset to \c poseBaseFeature and \c landmarkBaseFeature, so the
+      features cannot be renumbered. Returns 0.
+   */
+  virtual int renumberFeatures ();  
+
   //! Overloaded \c TmTreemap function
   /*! Uses \c pose to reset the \c CAN_BE_SPARSIFIED flag in all
       poses within \c sparsificationDistance range.
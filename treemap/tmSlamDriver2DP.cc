@@ -142,13 +142,27 @@ void TmSlamDriver2DP::addLink (const Link& link)
   poseALinPoint[1] = poseBLinPoint[1] + s*link.d[0] + c*link.d[1];
   poseALinPoint[2] = vmNormalizedAngle (poseBLinPoint[2] + link.d[2], poseAEst[2]);
 
-  // Now linearize the measurement equation and scale according to the covariance
-  XymMatrixC LInv, A;
-  linearizeLink (A, poseALinPoint, poseBLinPoint, link.d, link.poseB>=0);
-  inverseCholeskyFactor (LInv, XymMatrixC(link.dCov));  
+  // Now linearize the measurement equation and scale according to the
+  // covariance. Everything has fixed size, so only the Gaussian
+  // itself is allocated.
+  VmMatrix3x3 Ja, Jb, L, LJ;
+  VmVector3 y, lY;
+  bool hasB = link.poseB>=0;  
+  linearizeLink (Ja, Jb, y, poseALinPoint, poseBLinPoint, link.d, hasB);
+  vmCholeskyInverse (link.dCov, L); // C = L^-TL^-1
 
   // Add the link as a single Gaussian leaf
-  TmGaussian linearizedLink (LInv*A, fl, false);
+  TmGaussian linearizedLink (fl, 3);
+  XymMatrixC& R = linearizedLink.R;  
+  R.appendRow (3, true);
+  vmMultiply (LJ, L, Ja);
+  R.store (LJ, 0, 0);
+  if (hasB) {
+    vmMultiply (LJ, L, Jb);
+    R.store (LJ, 0, 3);
+  }  
+  vmMultiply (lY, L, y);
+  R.storeCol (lY, 0, fl.size());
   addLeaf (linearizedLink);
 }
 
@@ -156,22 +170,11 @@ void TmSlamDriver2DP::addLink (const Link& link)
 void TmSlamDriver2DP::linearizeLink (XymMatrixC& A, const VmVector3& poseALinPoint, 
 				     const VmVector3& poseBLinPoint, const VmVector3& d, bool includeJacobianForB)
 {
-  assert (isFinite (poseALinPoint) && isFinite(poseBLinPoint));  
+  VmMatrix3x3 Ja, Jb;
+  VmVector3 y;
+  linearizeLink (Ja, Jb, y, poseALinPoint, poseBLinPoint, d, includeJacobianForB);
   if (includeJacobianForB) A.create (3, 7);
   else A.create (3, 4);  
-  double c = cos(poseBLinPoint[2]), s = sin(poseBLinPoint[2]);  
-  VmMatrix3x3 Ja = {{ c,  s, 0},
-                    {-s,  c, 0},
-		    { 0,  0, 1}}; // df(a,b)/da | a=poseALinPoint, b=poseBLinPoint
-  VmMatrix3x3 Jb = {{-c, -s, -s*(poseALinPoint[0]-poseBLinPoint[0]) + c*(poseALinPoint[1]-poseBLinPoint[1])},
-		    { s, -c, -c*(poseALinPoint[0]-poseBLinPoint[0]) - s*(poseALinPoint[1]-poseBLinPoint[1])},
-                    { 0,  0, -1}}; // df(a,b)/db | a=poseALinPoint, b=poseBLinPoint
-  VmVector3 y = { c*(poseALinPoint[0]-poseBLinPoint[0]) + s*(poseALinPoint[1]-poseBLinPoint[1]) -d[0],
-		 -s*(poseALinPoint[0]-poseBLinPoint[0]) + c*(poseALinPoint[1]-poseBLinPoint[1]) -d[1],
-		  vmNormalizedAngle((poseALinPoint[2]-poseBLinPoint[2])- d[2])};   // f(poseALinPoint, poseBLinPoint) - d  
-  
-  vmMultiplySub (y, Ja, poseALinPoint);
-  if (includeJacobianForB) vmMultiplySub (y, Jb, poseBLinPoint);
   A.store (Ja, 0, 0);
   if (includeJacobianForB){
     A.store (Jb, 0, 3);
@@ -181,6 +184,32 @@ void TmSlamDriver2DP::linearizeLink (XymMatrixC& A, const VmVector3& poseALinPoi
 }
 
 
+void TmSlamDriver2DP::linearizeLink (VmMatrix3x3& Ja, VmMatrix3x3& Jb, VmVector3& y, 
+                                     const VmVector3& poseALinPoint, const VmVector3& poseBLinPoint, 
+                                     const VmVector3& d, bool includeJacobianForB)
+{
+  assert (isFinite (poseALinPoint) && isFinite(poseBLinPoint));  
+  double c = cos(poseBLinPoint[2]), s = sin(poseBLinPoint[2]);  
+  // df(a,b)/da | a=poseALinPoint, b=poseBLinPoint
+  VmMatrix3x3 JaV = {{ c,  s, 0},
+                     {-s,  c, 0},
+                     { 0,  0, 1}};
+  // df(a,b)/db | a=poseALinPoint, b=poseBLinPoint
+  VmMatrix3x3 JbV = {{-c, -s, -s*(poseALinPoint[0]-poseBLinPoint[0]) + c*(poseALinPoint[1]-poseBLinPoint[1])},
+                     { s, -c, -c*(poseALinPoint[0]-poseBLinPoint[0]) - s*(poseALinPoint[1]-poseBLinPoint[1])},
+                     { 0,  0, -1}};
+  // f(poseALinPoint, poseBLinPoint) - d  
+  VmVector3 yV = { c*(poseALinPoint[0]-poseBLinPoint[0]) + s*(poseALinPoint[1]-poseBLinPoint[1]) -d[0],
+                  -s*(poseALinPoint[0]-poseBLinPoint[0]) + c*(poseALinPoint[1]-poseBLinPoint[1]) -d[1],
+                   vmNormalizedAngle((poseALinPoint[2]-poseBLinPoint[2])- d[2])};   
+  vmMultiplySub (yV, JaV, poseALinPoint);
+  if (includeJacobianForB) vmMultiplySub (yV, JbV, poseBLinPoint);
+  vmCopy (JaV, Ja);
+  vmCopy (JbV, Jb);
+  vmCopy (yV, y);
+}
+
+
 
 void TmSlamDriver2DP::poseEstimate (int idx, double& x, double& y, double &theta) const
 {
@@ -205,6 +234,14 @@ void TmSlamDriver2DP::nameOfFeature (char* txt, int featureId, int& n) const
 }
 
 
+void TmSlamDriver2DP::featuresRenumbered (const TmFeatureList& newId)
+{
+  TmTreemap::featuresRenumbered (newId);
+  for (int i=0; i<pose2Feature.size(); i++) 
+    if (pose2Feature[i]>=0) pose2Feature[i] = newId[pose2Feature[i]];
+}
+
+
 int TmSlamDriver2DP::memory () const
 {
   return TmTreemap::memory()+ sizeof(TmSlamDriver2DP) - sizeof (TmTreemap) + pose2Feature.capacity()*sizeof(int);
@@ -195,6 +195,9 @@ class TmSlamDriver2DP : public TmTreemap
 
   //! Overloaded \c TmTreemap function
   virtual int memory () const;  
+
+  //! Overloaded \c TmTreemap function, maps \c pose2Feature
+  virtual void featuresRenumbered (const TmFeatureList& newId);
   
 
 // protected:
@@ -229,6 +232,12 @@ class TmSlamDriver2DP : public TmTreemap
 			     const VmVector3& poseBLinPoint, const VmVector3& d,
 			     bool includeJacobianForB=true); 
 
+  //! Overloaded, returns \c A=(Ja,Jb,y) as fixed size matrices
+  /*! Used by \c addLink, which so needs no heap allocated matrices. */
+  static void linearizeLink (VmMatrix3x3& Ja, VmMatrix3x3& Jb, VmVector3& y, 
+                             const VmVector3& poseALinPoint, const VmVector3& poseBLinPoint, 
+                             const VmVector3& d, bool includeJacobianForB=true); 
+
   //! reserves and initializes the pose random variables of a link
   /*! The routine assures, that for both \c poseA and \c poseB features are existing.
       At least one of them must have an initialized estimate and the other one is
@@ -92,6 +92,21 @@ void TmSlamDriver3D::deleteFeature (TmFeatureId id)
 }
 
 
+void TmSlamDriver3D::featuresRenumbered (const TmFeatureList& newId)
+{
+  TmTreemap::featuresRenumbered (newId);
+  IntRVMap renumbered;  
+  for (IntRVMap::iterator it=variablesByFeatureId.begin();it!=variablesByFeatureId.end();it++) {
+    RandomVariable* rv = (*it).second;
+    rv->featureId = newId[rv->featureId];
+    assert (rv->featureId>=0);    
+    renumbered[rv->featureId] = rv;
+  }
+  variablesByFeatureId.swap (renumbered);
+  if (dummyPoseId>=0) dummyPoseId = newId[dummyPoseId];  
+}
+
+
 TmSlamDriver3D::~TmSlamDriver3D ()
 {
   clear();
@@ -145,8 +160,8 @@ void TmSlamDriver3D::observe (const LandmarkObservationList& obs)
     }  
 
   NonlinearLeaf* leaf;
-  if (isFirstPoseX) leaf = new NonlinearLeaf (this, obs, initialPose);  
-  else leaf = new NonlinearLeaf (this, obs);  
+  if (isFirstPoseX) leaf = new (allocator) NonlinearLeaf (this, obs, initialPose);  
+  else leaf = new (allocator) NonlinearLeaf (this, obs);  
   leaf->resetFlag (TmNode::CAN_BE_INTEGRATED);  
 
   VmMatrix4x4 pose;
@@ -279,6 +294,12 @@ TmNode* TmSlamDriver3D::NonlinearLeaf::duplicate() const
 }
 
 
+TmNode* TmSlamDriver3D::NonlinearLeaf::duplicate (TmAllocator& allocator) const
+{
+  return new (allocator) NonlinearLeaf (*this);  
+}
+
+
 int TmSlamDriver3D::NonlinearLeaf::memory() const
 {
   return TmNode::memory() - sizeof(TmNode) + sizeof (NonlinearLeaf) +
@@ -303,6 +303,9 @@ protected:
       //! overloaded function virtually calling the copy constructor
       virtual TmNode* duplicate() const;
 
+      //! overloaded function virtually calling the copy constructor
+      virtual TmNode* duplicate (TmAllocator& allocator) const;
+
       //! overloaded \c TmNode function
       virtual int memory() const;  
 
@@ -428,6 +431,12 @@ protected:
    */
   virtual void deleteFeature (TmFeatureId id);  
 
+  //! \c TmTreemap function overloaded
+  /*! Maps \c RandomVariable::featureId, \c variablesByFeatureId and
+      \c dummyPoseId.
+   */
+  virtual void featuresRenumbered (const TmFeatureList& newId);  
+
   //! Sets \c recentlyObservedLandmarks as the landmark ids in \c obs
   void setRecentlyObservedLandmarks (const LandmarkObservationList& obs);  
 };
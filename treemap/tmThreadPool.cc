@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!\file tmThreadPool.cc 
+   \brief Implementation of \c TmThreadPool
+   \author Udo Frese
+
+  Contains the implementation of class \c TmThreadPool, a small
+  work-stealing thread pool used to process subtrees in parallel.
+*/
+#include "tmThreadPool.h"
+#include <sched.h>
+#include <stdexcept>
+
+TmThreadPool::TmThreadPool (int nrOfThreads)
+  :worker(), nrOfQueuedTasks(0), nrOfSleeping(0), shutdown(false), threadStart()
+{
+  if (nrOfThreads<1) nrOfThreads = 1;  
+  pthread_mutex_init (&sleepMutex, NULL);
+  pthread_cond_init (&wakeUp, NULL);  
+  worker.resize (nrOfThreads);
+  threadStart.resize (nrOfThreads);  
+  for (int i=0; i<nrOfThreads; i++) {
+    worker[i] = new Worker;
+    pthread_mutex_init (&worker[i]->mutex, NULL);
+    threadStart[i].pool   = this;
+    threadStart[i].thread = i;    
+  }
+  for (int i=1; i<nrOfThreads; i++) 
+    if (pthread_create (&worker[i]->thread, NULL, &threadMain, &threadStart[i])!=0) 
+      throw runtime_error ("Could not create thread for TmThreadPool");
+}
+
+
+TmThreadPool::~TmThreadPool ()
+{
+  pthread_mutex_lock (&sleepMutex);
+  shutdown = true;
+  pthread_cond_broadcast (&wakeUp);  
+  pthread_mutex_unlock (&sleepMutex);
+  for (int i=1; i<(int) worker.size(); i++) pthread_join (worker[i]->thread, NULL);
+  for (int i=0; i<(int) worker.size(); i++) {
+    assert (worker[i]->queue.empty());    
+    pthread_mutex_destroy (&worker[i]->mutex);
+    delete worker[i];
+  }
+  pthread_cond_destroy (&wakeUp);
+  pthread_mutex_destroy (&sleepMutex);  
+}
+
+
+void TmThreadPool::spawn (Task* task, Group& group, int thread)
+{
+  assert (0<=thread && thread<(int) worker.size());  
+  task->group = &group;
+  __sync_fetch_and_add (&group.pending, 1);
+  Worker* w = worker[thread];  
+  pthread_mutex_lock (&w->mutex);
+  w->queue.push_back (task);
+  pthread_mutex_unlock (&w->mutex);
+  __sync_fetch_and_add (&nrOfQueuedTasks, 1);
+  if (__sync_fetch_and_add (&nrOfSleeping, 0)>0) {
+    pthread_mutex_lock (&sleepMutex);
+    pthread_cond_signal (&wakeUp);
+    pthread_mutex_unlock (&sleepMutex);
+  }
+}
+
+
+void TmThreadPool::wait (Group& group, int thread)
+{
+  while (__sync_fetch_and_add (&group.pending, 0)>0) {
+    Task* task = fetchTask (thread);
+    if (task!=NULL) execute (task, thread);
+    else sched_yield ();    
+  }
+}
+
+
+TmThreadPool::Task* TmThreadPool::fetchTask (int thread)
+{
+  if (__sync_fetch_and_add (&nrOfQueuedTasks, 0)==0) return NULL;  
+  Task* task = NULL;  
+  // Own queue from the back (most recent, smallest task)
+  Worker* w = worker[thread];  
+  pthread_mutex_lock (&w->mutex);
+  if (!w->queue.empty()) {
+    task = w->queue.back();
+    w->queue.pop_back();
+  }
+  pthread_mutex_unlock (&w->mutex);
+  // Steal from the front of other queues (oldest, largest task)
+  int n = worker.size();  
+  for (int i=1; task==NULL && i<n; i++) {
+    Worker* v = worker[(thread+i)%n];
+    pthread_mutex_lock (&v->mutex);
+    if (!v->queue.empty()) {
+      task = v->queue.front();
+      v->queue.pop_front();
+    }
+    pthread_mutex_unlock (&v->mutex);    
+  }
+  if (task!=NULL) __sync_fetch_and_sub (&nrOfQueuedTasks, 1);
+  return task;  
+}
+
+
+void TmThreadPool::execute (Task* task, int thread)
+{
+  Group* group = task->group;  
+  task->run (thread);
+  // After this, the task may be destroyed by the thread waiting for it
+  __sync_fetch_and_sub (&group->pending, 1);
+}
+
+
+void TmThreadPool::workerLoop (int thread)
+{
+  while (true) {
+    Task* task = fetchTask (thread);
+    if (task!=NULL) {
+      execute (task, thread);
+      continue;      
+    }
+    // We announce going to sleep before checking for tasks and \c spawn
+    // counts the task before checking for sleepers. So one of both sees
+    // the other and no wake up is lost.
+    pthread_mutex_lock (&sleepMutex);
+    __sync_fetch_and_add (&nrOfSleeping, 1);
+    while (!shutdown && __sync_fetch_and_add (&nrOfQueuedTasks, 0)==0) 
+      pthread_cond_wait (&wakeUp, &sleepMutex);
+    __sync_fetch_and_sub (&nrOfSleeping, 1);
+    bool stop = shutdown;    
+    pthread_mutex_unlock (&sleepMutex);
+    if (stop) return;    
+  }
+}
+
+
+void* TmThreadPool::threadMain (void* arg)
+{
+  ThreadStart* start = (ThreadStart*) arg;
+  start->pool->workerLoop (start->thread);
+  return NULL;  
+}
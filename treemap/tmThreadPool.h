@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2009, Universitaet Bremen
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Universitaet Bremen nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TMTHREADPOOL_H
+#define TMTHREADPOOL_H
+
+
+/*!\file tmThreadPool.h
+   \brief Class \c TmThreadPool, a small work-stealing thread pool
+
+   \author Udo Frese
+*/
+
+#include "tmTypes.h"
+#include <deque>
+#include <pthread.h>
+
+//! A work-stealing pool of threads for fork-join parallelism on the tree
+/*! The pool is used to process independent subtrees of a \c
+    TmTreemap in parallel. A task is a recursive computation on a
+    subtree. It may \c spawn further tasks (usually for one child)
+    and \c wait for them. Every thread has its own queue of spawned
+    tasks. It executes tasks from the back of its own queue and, if
+    that is empty, steals tasks from the front of the other threads'
+    queues. Since the front holds the oldest and hence usually largest
+    subtrees, load balancing works well even for unbalanced trees.
+
+    Threads are numbered \c 0..nrOfThreads()-1. Thread 0 is the thread
+    calling into the pool (i.e. the application), the others are
+    worker threads created by the constructor. The number is passed to
+    \c Task::run so a task can use thread specific workspace.
+
+    A thread waiting for a \c Group does not block but executes other
+    tasks in the meantime. So it is allowed to wait from inside a
+    task and thread 0 takes part in the computation.
+
+    Tasks must not throw exceptions.
+*/
+class TmThreadPool 
+{
+ public:
+  class Group;  
+
+  //! A unit of work executed by the pool
+  class Task 
+    {
+    public:
+      Task () :group(NULL) {}
+      virtual ~Task() {}      
+
+      //! Does the work, \c thread is the number of the executing thread
+      virtual void run (int thread)=0;      
+
+    protected:
+      friend class TmThreadPool;      
+      //! The group to which the task has been spawned
+      Group* group;      
+    };  
+
+  //! A set of tasks one can wait for
+  class Group 
+    {
+    public:
+      Group () :pending(0) {}      
+
+    protected:
+      friend class TmThreadPool;      
+      //! Nr of tasks spawned to the group but not finished
+      volatile int pending;      
+    };  
+
+  //! Creates the pool with \c nrOfThreads threads including the calling one
+  /*! So \c nrOfThreads-1 worker threads are started. */
+  TmThreadPool (int nrOfThreads);
+
+  //! Stops and joins all worker threads
+  ~TmThreadPool ();
+
+  //! Number of threads including the calling thread 0
+  int nrOfThreads () const {return (int) worker.size();}  
+
+  //! Puts \c task into the queue of \c thread
+  /*! \c thread must be the number of the calling thread. \c task must
+      stay valid until \c wait(group) has returned. */
+  void spawn (Task* task, Group& group, int thread);
+
+  //! Executes tasks until all tasks in \c group are finished
+  /*! \c thread must be the number of the calling thread. */
+  void wait (Group& group, int thread);  
+
+ protected:
+  //! Queue and thread handle for a single thread
+  class Worker 
+    {
+    public:
+      //! Spawned tasks, the owner takes from the back, thieves from the front
+      std::deque<Task*> queue;      
+      //! Protects \c queue
+      pthread_mutex_t mutex;      
+      //! The thread (not used for thread 0)
+      pthread_t thread;
+    };  
+
+  //! One entry for every thread
+  XycVector<Worker*> worker;  
+
+  //! Nr of tasks in all queues
+  volatile int nrOfQueuedTasks;  
+
+  //! Nr of workers sleeping (or about to sleep) on \c wakeUp
+  volatile int nrOfSleeping;  
+
+  //! Set to stop the worker threads
+  bool shutdown;  
+
+  //! Protects \c shutdown and is used with \c wakeUp
+  pthread_mutex_t sleepMutex;
+
+  //! Signalled when tasks are spawned or the pool shuts down
+  pthread_cond_t wakeUp;  
+
+  //! Takes a task from the own queue or steals one, returns \c NULL if none
+  Task* fetchTask (int thread);
+
+  //! Runs \c task and marks it as finished in its group
+  void execute (Task* task, int thread);  
+
+  //! Main loop of worker thread \c thread
+  void workerLoop (int thread);  
+
+  //! Argument passed to \c threadMain
+  class ThreadStart 
+    {
+    public:
+      TmThreadPool* pool;
+      int thread;
+    };  
+  XycVector<ThreadStart> threadStart;  
+
+  //! Entry point for \c pthread_create
+  static void* threadMain (void* arg);  
+
+ private:
+  //! The pool cannot be copied
+  TmThreadPool (const TmThreadPool&);
+  TmThreadPool& operator= (const TmThreadPool&);  
+};
+
+
+#endif
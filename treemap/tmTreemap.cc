@@ -44,34 +44,50 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <set>
 #include <stdlib.h>
 #include "tmTreemap.h"
+#include "tmBackgroundOptimizer.h"
+#include <xymlapack/xymLAPACK.h>
 
 #ifdef linux
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <time.h>
 #endif
 
 float tmNan = nan("NAN");
 
 #define JOINFACTOR 1.0 //! TODO: originally we had 1.5*
+#define KL_CANDIDATE_BLOCK_SIZE 16 // candidates evaluated in one task by optimalKLStep
 
 TmTreemap::TmTreemap()
-  :root (NULL), node(), unusedNodes(), isEstimateValid (true), isGaussianValidValid(true), feature(), 
-   optimizer(), stat(), workspace(), workspaceFloat()
+  :root (NULL), node(), unusedNodes(), isEstimateValid (true), estimateStamp (0), isGaussianValidValid(true), feature(), isFirstOfFeatureBlock(),
+   parallelUpdateThreshold (TmNode::updateGaussianCost (20)), incrementalEstimateEpsilon (-1), nrOfNodesCompactedPerEstimate (0), quantizeGaussiansAfter (-1),
+   freezeSubtreesAfter (-1), mixedPrecisionDiagonalRatio (-1),
+   optimizer(), stat(), workspace(), workspaceFloat(), threadPool(NULL), backgroundOptimizer(NULL), allocator(),
+   gaussianTimePerCost(1), estimateTime(0), klRunTime(0),
+   threadWorkspace(), threadWorkspaceFloat(), moveEvaluator(), klCandidate(), klCandidateCost()
 {
   for (int i=0; i<MAX_FEATURE_BLOCK_SIZE; i++) firstUnusedFeature[i]=-1;  
 }
 
 TmTreemap::TmTreemap (const TmTreemap& tm)
-  :root (NULL), node(), unusedNodes (), isEstimateValid (true), isGaussianValidValid(true), feature(), 
-   optimizer(), stat(), workspace(), workspaceFloat()
+  :root (NULL), node(), unusedNodes (), isEstimateValid (true), estimateStamp (0), isGaussianValidValid(true), feature(), isFirstOfFeatureBlock(),
+   parallelUpdateThreshold (TmNode::updateGaussianCost (20)), incrementalEstimateEpsilon (-1), nrOfNodesCompactedPerEstimate (0), quantizeGaussiansAfter (-1),
+   freezeSubtreesAfter (-1), mixedPrecisionDiagonalRatio (-1),
+   optimizer(), stat(), workspace(), workspaceFloat(), threadPool(NULL), backgroundOptimizer(NULL), allocator(),
+   gaussianTimePerCost(1), estimateTime(0), klRunTime(0),
+   threadWorkspace(), threadWorkspaceFloat(), moveEvaluator(), klCandidate(), klCandidateCost()
 {
   *this = tm;
 }
 
 
 TmTreemap::TmTreemap (int nrOfMovesPerStep, int maxNrOfUnsuccessfulMoves)
-  :root (NULL), node(), unusedNodes(), isEstimateValid (true), isGaussianValidValid(true), feature(), 
-   optimizer(), stat(), workspace(), workspaceFloat()
+  :root (NULL), node(), unusedNodes(), isEstimateValid (true), estimateStamp (0), isGaussianValidValid(true), feature(), isFirstOfFeatureBlock(),
+   parallelUpdateThreshold (TmNode::updateGaussianCost (20)), incrementalEstimateEpsilon (-1), nrOfNodesCompactedPerEstimate (0), quantizeGaussiansAfter (-1),
+   freezeSubtreesAfter (-1), mixedPrecisionDiagonalRatio (-1),
+   optimizer(), stat(), workspace(), workspaceFloat(), threadPool(NULL), backgroundOptimizer(NULL), allocator(),
+   gaussianTimePerCost(1), estimateTime(0), klRunTime(0),
+   threadWorkspace(), threadWorkspaceFloat(), moveEvaluator(), klCandidate(), klCandidateCost()
 {
   for (int i=0; i<MAX_FEATURE_BLOCK_SIZE; i++) firstUnusedFeature[i]=-1;  
   create (nrOfMovesPerStep, maxNrOfUnsuccessfulMoves);
@@ -88,7 +104,9 @@ void TmTreemap::create (int nrOfMovesPerStep, int maxNrOfUnsuccessfulMoves)
 TmTreemap& TmTreemap::operator = (const TmTreemap& tm)
 {
   if (&tm==this) return *this;
+  if (backgroundOptimizer!=NULL) backgroundOptimizer->discard ();  
   isEstimateValid = tm.isEstimateValid;
+  estimateStamp = tm.estimateStamp;  
   isGaussianValidValid = tm.isGaussianValidValid;  
   feature = tm.feature;
   optimizer = tm.optimizer;  
@@ -98,7 +116,18 @@ TmTreemap& TmTreemap::operator = (const TmTreemap& tm)
   stat = tm.stat;  
   workspace = tm.workspace;  
   workspaceFloat = tm.workspaceFloat;  
+  parallelUpdateThreshold = tm.parallelUpdateThreshold;
+  incrementalEstimateEpsilon = tm.incrementalEstimateEpsilon;
+  nrOfNodesCompactedPerEstimate = tm.nrOfNodesCompactedPerEstimate;
+  quantizeGaussiansAfter = tm.quantizeGaussiansAfter;
+  freezeSubtreesAfter = tm.freezeSubtreesAfter;
+  mixedPrecisionDiagonalRatio = tm.mixedPrecisionDiagonalRatio;
+  gaussianTimePerCost = tm.gaussianTimePerCost;
+  estimateTime = tm.estimateTime;
+  klRunTime = tm.klRunTime;  
+  setNrOfThreads (tm.nrOfThreads());  
   for (int i=0; i<MAX_FEATURE_BLOCK_SIZE; i++) firstUnusedFeature[i] = tm.firstUnusedFeature[i];
+  isFirstOfFeatureBlock = tm.isFirstOfFeatureBlock;  
   // We reset all marginalization node pointers to NULL for which we
   // cannot compute the involved features. This is necessary since
   // recursiveCopyTreeFrom can only change pointers to nodes where the
@@ -111,6 +140,15 @@ TmTreemap& TmTreemap::operator = (const TmTreemap& tm)
       feature[i].marginalizationNode = NULL;
   }  
   root = recursiveCopyTreeFrom (tm.root);
+  setBackgroundOptimization (tm.isBackgroundOptimization());
+  if (tm.backgroundOptimizer!=NULL) {
+    // The nodes \c tm optimizes in the background are not in the queue
+    const XycVector<int>& lca = tm.backgroundOptimizer->nodesBeingOptimized();
+    for (int i=0; i<(int) lca.size(); i++) {
+      TmNode* n = getNode (lca[i]);
+      if (n!=NULL) n->setToBeOptimized ();
+    }
+  }  
 #if ASSERT_LEVEL>=2
   TmTreemap::assertIt (); 
    // Don't use the virtual one here, because member variables of a 
@@ -128,9 +166,10 @@ TmNode* TmTreemap::recursiveCopyTreeFrom (const TmNode* n2)
   TmExtendedFeatureList fl;
   n2->computeFeaturesInvolved (fl);
   for (int i=0; i<(int) fl.size(); i++) {
-    TmFeature& feat = feature[fl[i].id];
+    TmFeature feat = feature[fl[i].id];
     if (feat.marginalizationNode==n2) feat.marginalizationNode = nCopy;
   }
+  if (nCopy->isFrozen()) setFrozenMarginalizationNodes (nCopy);  
   node[n2->index] = nCopy;
   if (!n2->isLeaf()) {
     nCopy->child[0] = recursiveCopyTreeFrom (n2->child[0]);
@@ -144,7 +183,68 @@ TmNode* TmTreemap::recursiveCopyTreeFrom (const TmNode* n2)
 
 TmTreemap::~TmTreemap ()
 {
+  delete backgroundOptimizer;  
   recursivelyDelete (root);
+  delete threadPool;  
+}
+
+
+void TmTreemap::setNrOfThreads (int n)
+{
+  if (n<1) n = 1;  
+  if (n==nrOfThreads()) return;
+  delete threadPool;
+  threadPool = NULL;  
+  threadWorkspace.clear();  
+  threadWorkspaceFloat.clear();  
+  if (n>1) {
+    threadPool = new TmThreadPool (n);
+    threadWorkspace.resize (n);
+    threadWorkspaceFloat.resize (n);
+  }  
+  allocator.setNrOfThreads (n);  
+}
+
+
+void TmTreemap::setBackgroundOptimization (bool on)
+{
+  if (on==isBackgroundOptimization()) return;
+  if (on) {
+    optimizer.lcaIndex = -1;
+    backgroundOptimizer = new TmBackgroundOptimizer (this);
+  }
+  else {
+    backgroundOptimizer->finish ();
+    delete backgroundOptimizer;
+    backgroundOptimizer = NULL;
+  }
+}
+
+
+int TmTreemap::nrOfThreads () const
+{
+  if (threadPool==NULL) return 1;
+  else return threadPool->nrOfThreads();  
+}
+
+
+void TmTreemap::reserveWorkspace (int rows, int cols)
+{
+  // \c TmGaussian::multiplyTriangular needs a \c cols*cols triangle and a row
+  int n = max (xymGEQR2WorkspaceSize (rows, cols), cols*cols+cols);
+  for (int i=0; i<nrOfThreads(); i++) {
+    XymVector& ws = workspaceOfThread (i);
+    if (n>ws.size()) ws.reserve (n, true);
+  }
+}
+
+
+int TmTreemap::parallelEstimationDepth () const
+{
+  if (threadPool==NULL) return 0;
+  int depth = 3;
+  for (int n=1; n<nrOfThreads(); n*=2) depth++;
+  return depth;  
 }
 
   
@@ -167,6 +267,44 @@ void TmTreemap::recursiveAllNodes (TmNode* n, XycVector<TmNode*>& innerNode, Xyc
 }
 
 
+//! Task for \c TmThreadPool evaluating \c TmTreemap::klCandidate[first..end-1]
+/*! The candidates are searched one after the other with the best
+    cost found so far as bound, starting with \c bound. The bound
+    only depends on candidates before, so the result does not depend
+    on the scheduling.
+*/
+class TmTreemap::KLCandidateTask : public TmThreadPool::Task
+{
+public:
+  KLCandidateTask ()
+    :tree(NULL), lca(NULL), joinOnlyBelow(0), bound(vmInf()), first(0), end(0)
+  {}
+
+  //! The tree and the node, the cost of which is optimized
+  TmTreemap* tree;
+  TmNode* lca;
+  //! See \c optimalKLStep
+  double joinOnlyBelow;  
+  //! Initial bound for the search
+  double bound;  
+  //! Range of candidates evaluated
+  int first, end;  
+
+  virtual void run (int thread)
+  {
+    MoveEvaluator& evaluator = tree->moveEvaluator[thread];
+    double bestCost = bound;    
+    for (int i=first; i<end; i++) {
+      Move& move = tree->klCandidate[i];      
+      evaluator.cost = 0;      
+      evaluator.optimalMove (lca, move.subtree->whichSideOf (lca), bestCost, joinOnlyBelow, move);
+      tree->klCandidateCost[i] = evaluator.cost;      
+      if (move.cost<bestCost) bestCost = move.cost;      
+    }    
+  }  
+};
+
+
 void TmTreemap::optimalKLStep (TmNode* lca, double joinOnlyBelow, Move& move)
 {
 #if ASSERT_LEVEL>=3
@@ -179,8 +317,49 @@ void TmTreemap::optimalKLStep (TmNode* lca, double joinOnlyBelow, Move& move)
   
   move.clear();  
   if (!lca->isLeaf()) {
-    recursiveOptimalKL (lca, lca->child[0], 0, joinOnlyBelow, move);
-    recursiveOptimalKL (lca, lca->child[1], 1, joinOnlyBelow, move);  
+    klCandidate.clear();    
+    recursiveCandidatesKL (lca, lca->child[0], 0);
+    recursiveCandidatesKL (lca, lca->child[1], 1);
+    int n = klCandidate.size();    
+    klCandidateCost.resize (n);
+    if ((int) moveEvaluator.size()<nrOfThreads()) moveEvaluator.resize (nrOfThreads());
+    for (int i=0; i<(int) moveEvaluator.size(); i++) moveEvaluator[i].tree = this;    
+    if (n>0) {      
+      // The first candidate gives a bound for all others. They are
+      // then evaluated in blocks of \c KL_CANDIDATE_BLOCK_SIZE in
+      // parallel. The blocks are the same without thread pool, so
+      // the search is the same in both cases.
+      KLCandidateTask first;
+      first.tree          = this;
+      first.lca           = lca;
+      first.joinOnlyBelow = joinOnlyBelow;
+      first.first         = 0;
+      first.end           = 1;
+      first.run (0);
+      int nrOfTasks = (n-1+KL_CANDIDATE_BLOCK_SIZE-1)/KL_CANDIDATE_BLOCK_SIZE;
+      KLCandidateTask* task = new KLCandidateTask[nrOfTasks];
+      TmThreadPool::Group group;      
+      for (int i=0; i<nrOfTasks; i++) {
+        task[i]       = first;        
+        task[i].bound = klCandidate[0].cost;        
+        task[i].first = 1+i*KL_CANDIDATE_BLOCK_SIZE;
+        task[i].end   = min(n, task[i].first+KL_CANDIDATE_BLOCK_SIZE);
+        if (threadPool!=NULL && i+1<nrOfTasks) threadPool->spawn (&task[i], group, 0);
+        else task[i].run (0);        
+      }
+      if (threadPool!=NULL) threadPool->wait (group, 0);
+      delete[] task;
+    }
+    // Choose the best move, the first one in case of equal cost
+    for (int i=0; i<n; i++) {
+      stat.accumulatedOptimizationCost += klCandidateCost[i];      
+      if (klCandidate[i].cost<move.cost) move = klCandidate[i];
+    }
+    assert (!move.join || move.cost<joinOnlyBelow+TmNode::costEps());
+    // Charge updating \c featurePassed from \c lca to the root as a
+    // tentative move would. \c optimizeFullRuns is calibrated to that.
+    for (TmNode* a=lca->parent; a!=NULL; a=a->parent)
+      stat.accumulatedOptimizationCost += TmNode::updateFeaturePassedCost (a->featurePassed.size());
   }
   updateFeaturePassed();  
   isGaussianValidValid =  oldIsGaussianValidValid;
@@ -195,135 +374,15 @@ void TmTreemap::optimalKLStep (TmNode* lca, double joinOnlyBelow, Move& move)
 }
 
 
-void TmTreemap::recursiveOptimalKL (TmNode* lca, TmNode* subtreeBelow, int sideOfLca, double joinOnlyBelow, Move& bestMove)
+void TmTreemap::recursiveCandidatesKL (TmNode* lca, TmNode* subtreeBelow, int sideOfLca)
 {
   if (isIntersectionEmpty (subtreeBelow->featurePassed, lca->child[1-sideOfLca]->featurePassed)) return;
-
-  if (subtreeBelow->isFlag(TmNode::CAN_BE_MOVED)) {    
-    // try to move \c subtreeBelow to the other side
-#if ASSERT_LEVEL>=3
-    char treestruct1[10000], treestruct2[10000];
-    lca->sprintTreeIndex (treestruct1);
-#endif
-    
-    Move move (subtreeBelow, NULL); // Consider to move \c subtreeBelow
-    if (subtreeBelow->parent!=lca) {
-      // first move to the other side of lca
-      subtreeBelow->moveTo (lca->child[1-sideOfLca], true);
-      lca->updateFeaturePassed ();
-
-      // Find the best place for it there
-      recursiveOptimalDescend (lca->boundForChild (1-sideOfLca, bestMove.cost), lca->boundForChild (1-sideOfLca, joinOnlyBelow), move, true);
-      move.cost = max(move.cost, lca->child[sideOfLca]->worstCaseUpdateCost) + lca->updateCost;
-
-      // And move it back
-      subtreeBelow->moveTo (move.oldAbove, true);
-      subtreeBelow->makeChildNr (move.whichChild);
-    }
-    else {
-      // We move one whole side of \c lca to the other. So just call recursiveOptimalDescend
-      // But we do not allow subtree to stay where it is, because this would be a null-move.
-      recursiveOptimalDescend (bestMove.cost, joinOnlyBelow, move, false);
-    }    
-    if (move.cost<bestMove.cost) bestMove = move;        
-    
-    lca->updateFeaturePassed ();      
-  
-#if ASSERT_LEVEL>=3
-    lca->sprintTreeIndex (treestruct2);
-    assert (strcmp(treestruct1, treestruct2)==0);    
-#endif
-  }
-  
-  assert (!bestMove.join || bestMove.cost<joinOnlyBelow+TmNode::costEps());  
+  // Consider to move \c subtreeBelow to the other side
+  if (subtreeBelow->isFlag(TmNode::CAN_BE_MOVED)) klCandidate.push_back (Move (subtreeBelow));
   if (!subtreeBelow->isLeaf()) {    
-    recursiveOptimalKL (lca, subtreeBelow->child[0], sideOfLca, joinOnlyBelow, bestMove);
-    recursiveOptimalKL (lca, subtreeBelow->child[1], sideOfLca, joinOnlyBelow, bestMove);    
+    recursiveCandidatesKL (lca, subtreeBelow->child[0], sideOfLca);
+    recursiveCandidatesKL (lca, subtreeBelow->child[1], sideOfLca);
   }
-  assert (!bestMove.join || bestMove.cost<joinOnlyBelow+TmNode::costEps());  
-}
-
-
-void TmTreemap::recursiveOptimalDescend (double bound, double joinOnlyBelow, Move& bestMove, bool mayStayHere)
-{
-  assert(bestMove.subtree!=NULL);
-  TmNode* s = bestMove.subtree;
-  bestMove.cost  = vmInf();
-  bestMove.above = NULL;
-  if (bound<0 || s->parent == NULL) return;  
-
-  
-  s->parent->updateFeaturePassed();
-  TmNode* sibling;
-  int whichChild;
-  s->getSibling (sibling, whichChild);  
-
-  if (isIntersectionEmpty (s->featurePassed, sibling->featurePassed)) return; // move only to somewhere across the border  
-
-  if (mayStayHere) {    
-    // let s stay where it is namely above \c sibling() 
-    bestMove.above      = sibling;  
-    bestMove.cost       = s->parent->worstCaseUpdateCost; // preliminary
-    if (bestMove.cost<bound) bound = bestMove.cost;
-  }
-
-  if (s->parent!=NULL && s->isLeaf() && sibling->isLeaf()) {
-    // Try whether \c subtree and \c above can be joined    
-    double cost = JOINFACTOR*costOfJoining (s->parent); 
-    if (cost<bestMove.cost && cost<joinOnlyBelow) {
-      bestMove.above      = sibling;
-      bestMove.join       = true;      
-      bestMove.cost       = cost;
-    }    
-  }
-
-  double lowerBound = s->worstCaseUpdateCost+TmNode::updateGaussianCost(s->featurePassed.size()); // lower bound for target function
-  if (lowerBound>=bound) return;  
-
-#if ASSERT_LEVEL>=3
-    char treestruct1[10000], treestruct2[10000];
-    s->parent->sprintTreeIndex (treestruct1);
-#endif
-
-  if (!sibling->isLeaf()) {
-#ifndef NDEBUG
-    double oldSiblingCost = sibling->worstCaseUpdateCost;
-#endif
-    Move bestAbove0 (bestMove), bestAbove1 (bestMove);
-
-    // Check locations somewhere below sibling->child[0]
-    s->moveTo (sibling->child[0], true);
-    sibling->updateFeaturePassed();
-    recursiveOptimalDescend (sibling->boundForChild (0, bound), sibling->boundForChild (0, joinOnlyBelow), bestAbove0, true);
-    bestAbove0.cost = max(bestAbove0.cost, sibling->child[1]->worstCaseUpdateCost) + sibling->updateCost;
-    if (bestAbove0.cost<bestMove.cost) {        
-      bestMove  = bestAbove0;
-      bound = bestMove.cost;
-    }
-
-    // Check locations somewhere below sibling->child[1]
-    s->moveTo (sibling->child[1], true);
-    sibling->updateFeaturePassed();
-    recursiveOptimalDescend (sibling->boundForChild (1, bound), sibling->boundForChild (1, joinOnlyBelow), bestAbove1, true);
-    bestAbove1.cost = max(bestAbove1.cost, sibling->child[0]->worstCaseUpdateCost) + sibling->updateCost;    
-    if (bestAbove1.cost<bestMove.cost) {
-      bestMove  = bestAbove1;
-      bound = bestMove.cost;
-    }
-
-    // Move back
-    s->moveTo (sibling, true);
-    s->makeChildNr (whichChild);    
-    sibling->parent->updateFeaturePassed();
-    assert (oldSiblingCost == sibling->worstCaseUpdateCost);
-  }
-
-#if ASSERT_LEVEL>=3
-  assert ((finite(bestMove.cost)) != (bestMove.above==NULL));
-  assert (!bestMove.join || bestMove.cost<joinOnlyBelow);  
-  s->parent->sprintTreeIndex (treestruct2);
-  assert (strcmp(treestruct1, treestruct2)==0);    
-#endif
 }
 
 
@@ -403,6 +462,7 @@ TmFeatureId TmTreemap::newFeatureBlock (int n)
         firstUnusedFeature[nn-n] = id+n;
       }
       for (int j=id; j<id+n; j++) feature[j].setFlag (TmFeature::IS_EMPTY, 0);
+      markFeatureBlock (id, n);
       return id;      
     }
     nn += n;
@@ -410,13 +470,22 @@ TmFeatureId TmTreemap::newFeatureBlock (int n)
   id = feature.size();  
   feature.resize (id+n);
   for (int j=id; j<id+n; j++) feature[j].setFlag (TmFeature::IS_EMPTY, 0);
+  markFeatureBlock (id, n);
   return id;  
 }
 
+
+void TmTreemap::markFeatureBlock (TmFeatureId id, int n)
+{
+  if (isFirstOfFeatureBlock.size()<id+n) isFirstOfFeatureBlock.resize (id+n, false);
+  isFirstOfFeatureBlock[id] = true;
+  for (int i=id+1; i<id+n; i++) isFirstOfFeatureBlock[i] = false;
+}
+
   
 void TmTreemap::deleteFeature (TmFeatureId id)
 {
-  TmFeature& fId = feature[id];  
+  TmFeature fId = feature[id];  
   fId.setFlag (TmFeature::IS_EMPTY, TmFeature::IS_EMPTY);
   fId.marginalizationNode = NULL;  
   // Try to join it to any existing block
@@ -460,6 +529,67 @@ void TmTreemap::printFeatureFragmentation () const
 }
 
 
+int TmTreemap::renumberFeatures ()
+{
+  if (backgroundOptimizer!=NULL) backgroundOptimizer->finish ();
+  // A block is removed if all its features are unused, otherwise it
+  // is moved down as a whole
+  int n = feature.size(), nNew = 0;
+  TmFeatureList newId (n, -1);
+  for (int first=0; first<n; ) {
+    int end = first+1;
+    while (end<n && !(end<isFirstOfFeatureBlock.size() && isFirstOfFeatureBlock[end])) end++;
+    bool isUsed = false;
+    for (int i=first; i<end; i++) if (!feature[i].isEmpty()) isUsed = true;
+    if (isUsed) for (int i=first; i<end; i++) newId[i] = nNew++;
+    first = end;
+  }
+  if (nNew==n) return 0;
+
+  for (int i=0; i<(int) node.size(); i++) {
+    TmNode* nd = node[i];
+    if (nd==NULL) continue;
+    renumber (nd->featurePassed, newId);
+    renumber (nd->gaussian.feature, newId);
+    if (nd->linearizationPointFeature>=0) 
+      nd->linearizationPointFeature = newId[nd->linearizationPointFeature];
+    if (nd->gaussian.linearizationPointFeature>=0) 
+      nd->gaussian.linearizationPointFeature = newId[nd->gaussian.linearizationPointFeature];
+    nd->frozen.renumber (newId);
+  }
+  feature.renumber (newId, nNew);
+  XycVector<bool> isFirst (nNew, false);
+  for (int i=0; i<isFirstOfFeatureBlock.size(); i++) 
+    if (newId[i]>=0) isFirst[newId[i]] = isFirstOfFeatureBlock[i];
+  isFirstOfFeatureBlock.swap (isFirst);
+
+  // The unused features left are inside blocks, link them anew
+  for (int i=0; i<MAX_FEATURE_BLOCK_SIZE; i++) firstUnusedFeature[i]=-1;
+  for (int i=0; i<nNew; ) {
+    if (!feature[i].isEmpty()) {
+      i++;
+      continue;
+    }
+    int len = 1;
+    while (i+len<nNew && len<MAX_FEATURE_BLOCK_SIZE-1 && feature[i+len].isEmpty()) len++;
+    for (int j=i+1; j<i+len; j++) feature[j].setNextUnusedFeature (-1);
+    feature[i].setNextUnusedFeature (firstUnusedFeature[len]);
+    firstUnusedFeature[len] = i;
+    i += len;
+  }
+#if ASSERT_LEVEL>=3
+  assertUnusedFeatureLists();  
+#endif
+  featuresRenumbered (newId);
+  return n-nNew;  
+}
+
+
+void TmTreemap::featuresRenumbered (const TmFeatureList& newId)
+{
+}
+
+
 void TmTreemap::hasBeenSparsifiedOut (TmFeatureId id)
 {
   assert (feature[id].isFlag(TmFeature::CAN_BE_SPARSIFIED));  
@@ -468,7 +598,7 @@ void TmTreemap::hasBeenSparsifiedOut (TmFeatureId id)
 
 TmNode* TmTreemap::addLeaf (const TmGaussian& gaussian, int flags)
 {
-  TmNode* leaf = new TmNode;
+  TmNode* leaf = new (allocator) TmNode;
   leaf->index = -1;  
   leaf->gaussian = gaussian;
   leaf->status = (flags & TmNode::CAN_BE_INTEGRATED ) | TmNode::CAN_BE_MOVED;  
@@ -507,7 +637,7 @@ void TmTreemap::addNonlinearLeaf (TmNode* newLeaf)
   isEstimateValid = false;
   if (root!=NULL) {
     // Make a new node root with newLeaf and root as children
-    TmNode* n = new TmNode;
+    TmNode* n = new (allocator) TmNode;
     newNodeIndex (n);    
     n->status = TmNode::CAN_BE_MOVED | TmNode::IS_OPTIMIZED;
        // We need \c IS_OPTIMIZED because otherwise \c setToBeOptimized
@@ -541,6 +671,7 @@ void TmTreemap::addNonlinearLeaf (TmNode* newLeaf)
 
 void TmTreemap::clear()
 {
+  if (backgroundOptimizer!=NULL) backgroundOptimizer->discard ();  
   recursivelyDelete (root);  
   root = NULL;
   unusedNodes.clear();
@@ -549,22 +680,100 @@ void TmTreemap::clear()
   feature.clear();
   node.clear();  
   for (int i=0; i<MAX_FEATURE_BLOCK_SIZE; i++) firstUnusedFeature[i]=-1;
+  isFirstOfFeatureBlock.clear();  
   stat = TreemapStatistics();  
   workspace.clear();
   workspaceFloat.clear();  
+  allocator.clearBuffers ();  
 }
 
 
 void TmTreemap::optimizeFullRuns ()
 {
-  double oldAccumulatedOptimizationCost, factor=2;  
   if (root==NULL) return;  
+  if (backgroundOptimizer!=NULL) {
+    backgroundOptimizer->synchronize ();
+    return;
+  }  
+  optimizeRunsUntil (vmInf());
+}
+
+
+int TmTreemap::optimizeRunsUntil (double deadline)
+{
+  double oldAccumulatedOptimizationCost, factor=2;  
+  int nrOfRuns = 0;  
+  bool hasDeadline = (deadline<vmInf());  
   oldAccumulatedOptimizationCost = stat.accumulatedOptimizationCost;  
   while (updateGaussiansCost () + stat.accumulatedOptimizationCost - oldAccumulatedOptimizationCost
          <factor*root->worstCaseUpdateCost) {  //! TODO originally we had a do..while loop
-    if (optimizer.optimizationQueue.empty()) return;    
+    if (optimizer.optimizationQueue.empty()) break;
+    double t0 = 0;    
+    if (hasDeadline) {
+      t0 = monotonicTime ();
+      if (t0+klRunTime>deadline) break;
+    }    
     optimizer.oneKLRun ();
+    nrOfRuns++;    
+    if (hasDeadline) klRunTime = max (monotonicTime()-t0, 0.9*klRunTime);
   } 
+  return nrOfRuns;  
+}
+
+
+TmTreemap::StepResult TmTreemap::runStep (double deadline)
+{
+  StepResult result;  
+  if (root!=NULL) {
+    // Gaussians and estimate first, they are what the application waits for
+    updateFeaturePassed ();    
+    double cost = recursiveInvalidGaussiansCost (root);
+    if (cost>0) {
+      estimateStamp++;      
+      double t0 = monotonicTime ();
+      recursiveUpdateGaussiansUntil (root, deadline-estimateTime);
+      double updatedCost = cost - recursiveInvalidGaussiansCost (root);
+      if (updatedCost>=TmNode::updateGaussianCost (20)) // too short to be measured otherwise
+        gaussianTimePerCost = max ((monotonicTime()-t0)/updatedCost, 0.9*gaussianTimePerCost);
+      result.isGaussianUpdateDeferred = !root->isFlag (TmNode::IS_GAUSSIAN_VALID);
+    }
+    if (!isEstimateValid) {
+      double t1 = monotonicTime ();      
+      if (result.isGaussianUpdateDeferred || t1+estimateTime>deadline) result.isEstimateDeferred = true;
+      else {
+        computeLinearEstimate ();
+        estimateTime = max (monotonicTime()-t1, 0.9*estimateTime);
+      }
+    }
+    // The remaining time is used for optimization
+    if (backgroundOptimizer!=NULL) backgroundOptimizer->synchronize ();
+    else result.nrOfKLRuns = optimizeRunsUntil (deadline);
+  }  
+  result.nrOfNodesToBeOptimized = optimizer.optimizationQueue.size();  
+  return result;  
+}
+
+
+bool TmTreemap::recursiveUpdateGaussiansUntil (TmNode* n, double deadline)
+{
+  if (n->isFlag (TmNode::IS_GAUSSIAN_VALID)) return true;
+  if (monotonicTime()+recursiveInvalidGaussiansCost(n)*gaussianTimePerCost<=deadline) {
+    n->updateGaussian ();
+    return true;
+  }
+  if (!n->isLeaf()) {
+    recursiveUpdateGaussiansUntil (n->child[0], deadline);
+    recursiveUpdateGaussiansUntil (n->child[1], deadline);
+  }
+  return false;  
+}
+
+
+double TmTreemap::recursiveInvalidGaussiansCost (const TmNode* n) const
+{
+  if (n->isFlag (TmNode::IS_GAUSSIAN_VALID)) return 0;
+  else if (n->isLeaf()) return n->updateCost;
+  else return n->updateCost + recursiveInvalidGaussiansCost (n->child[0]) + recursiveInvalidGaussiansCost (n->child[1]);
 }
 
 
@@ -603,7 +812,10 @@ void TmTreemap::computeLinearEstimate ()
 {
   if (isEstimateValid || root==NULL) return;  
   updateGaussians ();
-  if (root->gaussian.RCompressed.empty()) root->estimate ();
+  if (nrOfNodesCompactedPerEstimate>0) compactNodes (nrOfNodesCompactedPerEstimate);
+  if (freezeSubtreesAfter>=0) freezeSubtrees ();
+  if (quantizeGaussiansAfter>=0) quantizeGaussians ();
+  if (!root->gaussian.isCompressed()) root->estimate ();
   else root->estimateUsingRCompressed ();  
   isEstimateValid = true; 
 #if ASSERT_LEVEL>=3
@@ -612,6 +824,285 @@ void TmTreemap::computeLinearEstimate ()
 }
 
 
+int TmTreemap::compactNodes (int maxNrOfNodes)
+{
+  if (root==NULL || maxNrOfNodes<=0) return 0;
+  int budget = maxNrOfNodes;
+  bool isStable, isContiguous;
+  const char* end;  
+  int size = recursiveCompactNodes (root, budget, isStable, isContiguous, end);
+  if (isStable && !isContiguous && size<=budget) {
+    relocateSubtree (root);
+    budget -= size;
+  }
+  stat.nrOfNodesCompacted += maxNrOfNodes-budget;  
+#if ASSERT_LEVEL>=3
+  assertIt ();
+#endif
+  return maxNrOfNodes-budget;  
+}
+
+
+int TmTreemap::recursiveCompactNodes (TmNode* n, int& budget, bool& isStable, bool& isContiguous, const char*& end)
+{
+  int blockSize = TmAllocator::blockSize (n);
+  isStable = n->isFlag (TmNode::IS_FEATURE_PASSED_VALID) && n->isFlag (TmNode::IS_GAUSSIAN_VALID) &&
+    TmAllocator::blockSizeFor (TmAllocator::sizeOf (n))>0;
+  isContiguous = blockSize>0;
+  end = ((const char*) n) + blockSize;
+  if (n->isLeaf()) return 1;
+
+  int size = 1;
+  int childSize[2];
+  bool childIsStable[2], childIsContiguous[2];
+  for (int i=0; i<2; i++) {
+    const char* childEnd;
+    childSize[i] = recursiveCompactNodes (n->child[i], budget, childIsStable[i], childIsContiguous[i], childEnd);
+    size += childSize[i];
+    isContiguous = isContiguous && childIsContiguous[i] && (const char*) n->child[i]==end;
+    end = childEnd;
+  }
+  isStable = isStable && n->isFlag (TmNode::IS_OPTIMIZED) && childIsStable[0] && childIsStable[1];
+  if (!isStable || size>budget) {
+    // \c n will not be relocated as a whole, so relocate the children
+    for (int i=0; i<2; i++) 
+      if (childIsStable[i] && !childIsContiguous[i] && childSize[i]<=budget) {
+        relocateSubtree (n->child[i]);
+        budget -= childSize[i];
+      }
+    isStable = isContiguous = false;    
+  }
+  return size;  
+}
+
+
+void TmTreemap::relocateSubtree (TmNode* n)
+{
+  XycVector<TmNode*> oldNode;
+  n->nodesBelow (oldNode);
+  int bytes = 0;
+  for (int i=0; i<(int) oldNode.size(); i++) bytes += TmAllocator::blockSizeFor (TmAllocator::sizeOf (oldNode[i]));
+  allocator.reserveContiguous (bytes);
+  allocator.setContiguous (true);
+  TmExtendedFeatureList fl;
+  for (int i=0; i<(int) oldNode.size(); i++) {
+    TmNode* nOld = oldNode[i];
+    TmNode* nNew = nOld->duplicate (allocator);
+    fl.clear ();
+    nOld->computeFeaturesInvolved (fl);
+    for (int j=0; j<(int) fl.size(); j++) {
+      TmFeature feat = feature[fl[j].id];
+      if (feat.marginalizationNode==nOld) feat.marginalizationNode = nNew;
+    }
+    if (nNew->isFrozen()) setFrozenMarginalizationNodes (nNew);    
+    node[nOld->index] = nNew;
+  }
+  allocator.setContiguous (false);
+  // Redirect the links using the indices, the old nodes are still intact
+  for (int i=0; i<(int) oldNode.size(); i++) {
+    TmNode* nNew = node[oldNode[i]->index];
+    if (!nNew->isLeaf()) 
+      for (int j=0; j<2; j++) {
+        nNew->child[j] = node[nNew->child[j]->index];
+        nNew->child[j]->parent = nNew;
+      }
+  }
+  TmNode* nNew = node[n->index];
+  if (n->parent==NULL) root = nNew;
+  else if (n->parent->child[0]==n) n->parent->child[0] = nNew;
+  else n->parent->child[1] = nNew;
+  for (int i=0; i<(int) oldNode.size(); i++) delete oldNode[i];
+}
+
+
+int TmTreemap::quantizeGaussians ()
+{
+  if (root==NULL) return 0;
+  int n = recursiveQuantizeGaussians (root);
+  stat.nrOfGaussiansQuantized += n;
+  return n;  
+}
+
+
+int TmTreemap::recursiveQuantizeGaussians (TmNode* n)
+{
+  int ctr = 0;
+  if (!n->isLeaf()) ctr = recursiveQuantizeGaussians (n->child[0]) + recursiveQuantizeGaussians (n->child[1]);
+  if (n->isFlag (TmNode::IS_GAUSSIAN_VALID) && !n->gaussian.RCompressed.empty() && canBeQuantized (n)) {
+    n->gaussian.quantize ();
+    n->resetFlag (TmNode::IS_ESTIMATE_VALID);
+    ctr++;    
+  }
+  // The estimates below change slightly
+  if (ctr>0) n->resetFlag (TmNode::IS_SUBTREE_ESTIMATE_VALID);
+  return ctr;  
+}
+
+
+bool TmTreemap::canBeQuantized (const TmNode* n) const
+{
+  return !n->isLeaf() && quantizeGaussiansAfter>=0 && estimateStamp-n->gaussianStamp>=quantizeGaussiansAfter;
+}
+
+
+int TmTreemap::freezeSubtrees ()
+{
+  if (root==NULL) return 0;
+  int n = 0;
+  if (recursiveFreezeSubtrees (root, n) && !root->isLeaf()) n += freezeSubtree (root);
+  return n;  
+}
+
+
+bool TmTreemap::recursiveFreezeSubtrees (TmNode* n, int& nrOfNodes)
+{
+  if (n->isLeaf()) return canBeFrozen (n);
+  bool canBeFrozen0 = recursiveFreezeSubtrees (n->child[0], nrOfNodes);
+  bool canBeFrozen1 = recursiveFreezeSubtrees (n->child[1], nrOfNodes);
+  if (canBeFrozen0 && canBeFrozen1 && canBeFrozen (n)) return true;
+  // \c n is not frozen, so freeze the children as large as possible
+  if (canBeFrozen0 && !n->child[0]->isLeaf()) nrOfNodes += freezeSubtree (n->child[0]);
+  if (canBeFrozen1 && !n->child[1]->isLeaf()) nrOfNodes += freezeSubtree (n->child[1]);
+  return false;  
+}
+
+
+bool TmTreemap::canBeFrozen (const TmNode* n) const
+{
+  const int flags = TmNode::IS_FEATURE_PASSED_VALID | TmNode::IS_GAUSSIAN_VALID | TmNode::IS_OPTIMIZED;
+  return freezeSubtreesAfter>=0 && (n->status & flags)==flags && 
+    (n->isFlag (TmNode::CAN_BE_INTEGRATED) || n->isFrozen()) &&
+    n->gaussian.isCompressed() && estimateStamp-n->gaussianStamp>=freezeSubtreesAfter;
+}
+
+
+int TmTreemap::freezeSubtree (TmNode* n)
+{
+  assert (!n->isLeaf() && isGaussianValidValid);  
+  TmFrozenSubtree frozen;
+  frozen.create (n);
+  n->frozen.swap (frozen);  
+  setFrozenMarginalizationNodes (n);
+  int nrOfNodes = stat.nrOfNodes;  
+  recursivelyDelete (n->child[0]);
+  recursivelyDelete (n->child[1]);
+  n->child[0] = n->child[1] = NULL;  
+  nrOfNodes -= stat.nrOfNodes;
+  stat.nrOfNodesFrozen += nrOfNodes;  
+  // \c n must not be joined now, since the nodes below are missing
+  for (TmNode* n2=n; n2!=NULL && n2->isFlag (TmNode::CAN_BE_INTEGRATED); n2=n2->parent) 
+    n2->resetFlag (TmNode::CAN_BE_INTEGRATED);
+  return nrOfNodes;  
+}
+
+
+void TmTreemap::thawSubtree (TmNode* n)
+{
+  if (!n->isFrozen()) return;  
+  const TmFrozenNode* fn = n->frozen.begin();
+  n->child[0] = thawNode (fn, n, n);
+  n->child[1] = thawNode (fn, n, n);
+  assert (fn==n->frozen.end());
+  stat.nrOfNodesFrozen -= n->frozen.nrOfNodes();  
+  n->frozen.clear ();
+  // Every frozen node could be integrated
+  for (TmNode* n2=n; n2!=NULL && !n2->isFlag (TmNode::CAN_BE_INTEGRATED); n2=n2->parent) {
+    if (!n2->isLeaf() && !(n2->child[0]->isFlag (TmNode::CAN_BE_INTEGRATED) && n2->child[1]->isFlag (TmNode::CAN_BE_INTEGRATED))) break;
+    n2->setFlag (TmNode::CAN_BE_INTEGRATED);
+  }  
+  // The estimates below have not been computed in the last estimation
+  n->resetFlagUpToRoot (TmNode::IS_SUBTREE_ESTIMATE_VALID);
+}
+
+
+TmNode* TmTreemap::thawNode (const TmFrozenNode*& fn, TmNode* parent, TmNode* n)
+{
+  const TmFrozenNode* f = fn;
+  fn = fn->next();  
+  TmNode* nNew = new (allocator) TmNode;
+  newNodeIndex (nNew);
+  nNew->tree   = this;
+  nNew->parent = parent;
+  nNew->status = f->status & ~(TmFrozenNode::IS_LEAF | TmNode::IS_ESTIMATE_VALID | TmNode::IS_SUBTREE_ESTIMATE_VALID);
+  nNew->firstFeaturePassed = f->firstFeaturePassed;
+  nNew->estimateStamp = n->estimateStamp;
+  nNew->gaussianStamp = n->gaussianStamp;
+  f->getGaussian (nNew->gaussian);
+  TmExtendedFeatureList& fl = nNew->gaussian.feature;
+  int nPassed = f->n - f->firstFeaturePassed;
+  // Recompute what \c updateFeaturePassed has computed from the
+  // Gaussian and the children
+  nNew->featurePassed.resizeWithUndefinedData (nPassed);
+  if (f->isLeaf()) {
+    nNew->child[0] = nNew->child[1] = NULL;
+    nNew->linearizationPointFeature = f->linearizationPointFeature;
+    nNew->updateCost = nNew->worstCaseUpdateCost = TmNode::updateGaussianCost (f->n);
+    // The counts of the features passed are the ones in the Gaussian
+    for (int i=0; i<nPassed; i++) nNew->featurePassed[i] = fl[f->firstFeaturePassed+i];
+  }
+  else {
+    TmNode* c0 = nNew->child[0] = thawNode (fn, nNew, n);
+    TmNode* c1 = nNew->child[1] = thawNode (fn, nNew, n);
+    if (c0->linearizationPointFeature>=0 && c1->linearizationPointFeature>=0) 
+      nNew->linearizationPointFeature = c0->linearizationPointFeature;
+    else nNew->linearizationPointFeature = -1;    
+    nNew->updateCost = TmNode::updateGaussianCost (f->n);
+    nNew->worstCaseUpdateCost = max (c0->worstCaseUpdateCost, c1->worstCaseUpdateCost) + nNew->updateCost;
+    // The counts of the features passed are summed from the children,
+    // all lists being sorted
+    const TmExtendedFeatureId* a = c0->featurePassed.begin();
+    const TmExtendedFeatureId* aE = c0->featurePassed.end();
+    const TmExtendedFeatureId* b = c1->featurePassed.begin();
+    const TmExtendedFeatureId* bE = c1->featurePassed.end();
+    for (int i=0; i<nPassed; i++) {
+      int id = fl[f->firstFeaturePassed+i].id;
+      int count = 0;
+      while (a!=aE && a->id<id) a++;
+      if (a!=aE && a->id==id) count += a->count;
+      while (b!=bE && b->id<id) b++;
+      if (b!=bE && b->id==id) count += b->count;
+      nNew->featurePassed[i] = TmExtendedFeatureId (id, count);
+    }
+    // The counts of the Gaussian are not stored. They are the counts
+    // passed plus the counts of the children's Gaussians, as summed
+    // by \c TmGaussian::multiplyTriangular.
+    for (int i=0; i<nPassed; i++) fl[f->firstFeaturePassed+i].count = nNew->featurePassed[i].count;
+    for (int k=0; k<2; k++) {
+      const TmGaussian& g = nNew->child[k]->gaussian;
+      for (int j=nNew->child[k]->firstFeaturePassed; j<(int) g.feature.size(); j++) {
+        int i = 0;
+        while (fl[i].id!=g.feature[j].id) i++;
+        fl[i].count += g.feature[j].count;
+      }
+    }
+  }
+  TmNode** tM = feature.marginalizationNodes();  
+  for (int i=0; i<f->firstFeaturePassed; i++)
+    if (tM[fl[i].id]==n) tM[fl[i].id] = nNew;
+  return nNew;  
+}
+
+
+void TmTreemap::setFrozenMarginalizationNodes (TmNode* n)
+{
+  TmNode** tM = feature.marginalizationNodes();  
+  TmExtendedFeatureList fl;  
+  for (const TmFrozenNode* fn=n->frozen.begin(); fn!=n->frozen.end(); fn=fn->next()) {
+    fn->getFeatures (fl);
+    for (int i=0; i<fn->firstFeaturePassed; i++) tM[fl[i].id] = n;
+  }  
+}
+
+
+TmNode* TmTreemap::thawMarginalizationNode (TmFeatureId id)
+{
+  TmNode* n = feature[id].marginalizationNode;
+  if (n==NULL || !n->isFrozen()) return n;
+  thawSubtree (n);
+  return feature[id].marginalizationNode;
+}
+
+
 TmTreemap::SlamStatistic TmTreemap::slamStatistics () const
 {
   return SlamStatistic();
@@ -620,7 +1111,30 @@ TmTreemap::SlamStatistic TmTreemap::slamStatistics () const
 
 void TmTreemap::updateGaussians ()
 {
-  if (root!=NULL) root->updateGaussian ();
+  if (root==NULL) return;
+  if (!isGaussianValid()) estimateStamp++;
+  root->updateGaussian ();
+}
+
+
+float TmTreemap::estimateOf (TmFeatureId id)
+{
+  updateGaussians ();
+  TmNode* n = feature[id].marginalizationNode;
+  if (n!=NULL) n->estimateFromRoot ();
+  return feature[id].est;
+}
+
+
+void TmTreemap::estimatesOf (const TmFeatureList& id, XycVector<float>& est)
+{
+  updateGaussians ();
+  est.resize (id.size());
+  for (int i=0; i<(int) id.size(); i++) {
+    TmNode* n = feature[id[i]].marginalizationNode;
+    if (n!=NULL) n->estimateFromRoot ();
+    est[i] = feature[id[i]].est;
+  }
 }
 
 
@@ -639,7 +1153,10 @@ void TmTreemap::assertEstimate ()
   for (int i=0; i<(int) feature.size(); i++)
     if (feature[i].isDefined()) all.push_back(TmExtendedFeatureId (i,0));
   TmGaussian joined (all, root->rowsBelow());
-  recursivelyMultiply (joined, root);
+  XycVector<int>& columnOfFeature = allocator.threadBuffers (0).columnOfFeature;  
+  TmGaussian::indexColumns (all, columnOfFeature);
+  recursivelyMultiply (joined, root, columnOfFeature);
+  TmGaussian::unindexColumns (all, columnOfFeature);
   joined.triangularize ();
   XymVector v(all.size());  
   joined.mean (v, all.size());
@@ -660,6 +1177,8 @@ void TmTreemap::computeStatistics ( TreemapStatistics& stat, bool expensive) con
 {
   stat = this->stat;
   stat.nrOfNodesToBeOptimized = optimizer.optimizationQueue.size();
+  stat.nrOfGaussianAllocations = allocator.nrOfAllocations ();  
+  stat.nrOfMixedPrecisionFallbacks = allocator.nrOfMixedPrecisionFallbacks ();  
   if (expensive) stat.memory = memory ();
   else stat.memory = 0;  
 }
@@ -675,8 +1194,11 @@ void TmTreemap::computeEstimateByQR ()
   if (root!=NULL) m = root->rowsBelow();
   else m=0;  
   TmGaussian joined (all, m);
-  recursivelyMultiply (joined, root);
-  joined.triangularize ();
+  XycVector<int>& columnOfFeature = allocator.threadBuffers (0).columnOfFeature;  
+  TmGaussian::indexColumns (all, columnOfFeature);
+  recursivelyMultiply (joined, root, columnOfFeature);
+  TmGaussian::unindexColumns (all, columnOfFeature);
+  joined.triangularize (workspace, threadPool, 0);
   XymVector v(all.size());  
   joined.mean (v, all.size());
   for (int i=0; i<(int) all.size(); i++) 
@@ -709,9 +1231,12 @@ void TmTreemap::joinSubtree (TmNode* subtree)
   // Now do it
   // collect all Gaussians
   for (int i=0; i<(int) fl.size(); i++) fl[i].count = 0;  
-  TmGaussian joined (fl, subtree->rowsBelow());
-  recursivelyMultiply (joined, subtree);  
-  joined.triangularize();
+  TmGaussian joined;
+  joined.createTriangular (fl);  
+  XycVector<int>& columnOfFeature = allocator.threadBuffers (0).columnOfFeature;  
+  TmGaussian::indexColumns (fl, columnOfFeature);
+  recursivelyMultiplyTriangular (joined, subtree, columnOfFeature);  
+  TmGaussian::unindexColumns (fl, columnOfFeature);
 
   // Free features and adapt counter
   recursivelySubtractCount (subtree);  
@@ -785,9 +1310,9 @@ void TmTreemap::identifyFeatures (const XycVector<pair<int, int> >& assignment)
   for (int i=0; i<(int) assignment.size(); i++) {
     int from = assignment[i].first;
     int to   = assignment[i].second;
-    TmNode* m = feature[from].marginalizationNode;
-    if (feature[to].marginalizationNode!=NULL)
-      feature[to].marginalizationNode->resetFlagUpToRoot (TmNode::IS_FEATURE_PASSED_VALID | TmNode::IS_GAUSSIAN_VALID);    
+    TmNode* m = thawMarginalizationNode (from);
+    TmNode* mTo = thawMarginalizationNode (to);
+    if (mTo!=NULL) mTo->resetFlagUpToRoot (TmNode::IS_FEATURE_PASSED_VALID | TmNode::IS_GAUSSIAN_VALID);    
     m->recursivelyIdentifyFeature (from, to);
     feature[to].addTotalCount (feature[from].totalCount());
     deleteFeature (from);    
@@ -824,15 +1349,34 @@ void TmTreemap::recursivelyDelete (TmNode* n)
 }
 
 
-void TmTreemap::recursivelyMultiply (TmGaussian& join, TmNode* subtree)
+void TmTreemap::recursivelyMultiply (TmGaussian& join, TmNode* subtree, const XycVector<int>& columnOfFeature)
 {
-  if (subtree->isLeaf()) {
-    join.multiply (subtree->gaussian, 0); 
+  if (subtree->isFrozen()) {
+    TmGaussian g;
+    for (const TmFrozenNode* fn=subtree->frozen.begin(); fn!=subtree->frozen.end(); fn=fn->next()) 
+      if (fn->isLeaf()) {
+        fn->getGaussian (g);
+        join.multiply (g, 0, &columnOfFeature);
+      }
+  }
+  else if (subtree->isLeaf()) {
+    join.multiply (subtree->gaussian, 0, &columnOfFeature); 
     // TODO rotate
   }
   else {
-    recursivelyMultiply (join, subtree->child[0]);
-    recursivelyMultiply (join, subtree->child[1]);
+    recursivelyMultiply (join, subtree->child[0], columnOfFeature);
+    recursivelyMultiply (join, subtree->child[1], columnOfFeature);
+  }
+}
+
+
+void TmTreemap::recursivelyMultiplyTriangular (TmGaussian& join, TmNode* subtree, const XycVector<int>& columnOfFeature)
+{
+  if (subtree->isLeaf()) 
+    join.multiplyTriangular (subtree->gaussian, 0, workspace, allocator.threadBuffers (0).column, &columnOfFeature);
+  else {
+    recursivelyMultiplyTriangular (join, subtree->child[0], columnOfFeature);
+    recursivelyMultiplyTriangular (join, subtree->child[1], columnOfFeature);
   }
 }
 
@@ -908,7 +1452,15 @@ void TmTreemap::effectOfJoining (TmNode* subtree, TmExtendedFeatureList& fl, int
 
 void TmTreemap::recursivelyAdd (TmExtendedFeatureList& fl, TmNode* subtree) const
 {
-  if (subtree->isLeaf()) {
+  if (subtree->isFrozen()) {
+    TmExtendedFeatureList leafFl;    
+    for (const TmFrozenNode* fn=subtree->frozen.begin(); fn!=subtree->frozen.end(); fn=fn->next()) 
+      if (fn->isLeaf()) {
+        fn->getFeatures (leafFl);
+        for (int i=0; i<fn->n; i++) fl.push_back (leafFl[i]);
+      }
+  }
+  else if (subtree->isLeaf()) {
     // add only features from leaves
     for (int i=0; i<(int) subtree->gaussian.feature.size(); i++)
       fl.push_back (subtree->gaussian.feature[i]);
@@ -931,7 +1483,15 @@ void TmTreemap::computeFeaturesInvolvedBelow (TmNode* subtree, TmExtendedFeature
 void TmTreemap::recursivelyCount (TmNode* n, XycVector<int>& count) const
 {
   if (n==NULL) return;  
-  if (n->isLeaf()) {
+  if (n->isFrozen()) {
+    TmExtendedFeatureList fl;    
+    for (const TmFrozenNode* fn=n->frozen.begin(); fn!=n->frozen.end(); fn=fn->next()) 
+      if (fn->isLeaf()) {
+        fn->getFeatures (fl);
+        for (int i=0; i<fn->n; i++) count[fl[i].id] += fl[i].count;
+      }
+  }
+  else if (n->isLeaf()) {
     for (int i=0; i<(int) n->gaussian.feature.size(); i++) {
       int ct = n->gaussian.feature[i].count;      
       count[n->gaussian.feature[i].id] += ct;
@@ -1040,10 +1600,7 @@ void TmTreemap::assertIt () const
       isOptimized = n->isFlag (TmNode::IS_OPTIMIZED);
     }
     else isOptimized = true;
-    int ctr =0;    
-    for (int j=0; j<(int) optimizer.optimizationQueue.size(); j++)
-      if (optimizer.optimizationQueue[j]==i) ctr++;
-    assert (ctr>=(isOptimized?0:1));
+    assert (isOptimized || optimizer.optimizationQueue.contains (i));
   }  
   assert (stat.nrOfNodes==ctr);  
   assertUnusedFeatureLists ();  
@@ -1060,7 +1617,7 @@ void TmTreemap::findLeavesInvolving (TmFeatureId id, XycVector<TmNode*>& node)
   node.clear();  
   int ctr=0;  
   if (0<=id && id<(int) feature.size()) {
-    TmNode* lca = feature[id].marginalizationNode;
+    TmNode* lca = thawMarginalizationNode (id);
     if (lca!=NULL) lca->recursiveAddLeavesInvolving (id, node, ctr);
     assert (ctr==feature[id].totalCount());    
   }
@@ -1097,6 +1654,19 @@ double TmTreemap::time()
 }
 
 
+double TmTreemap::monotonicTime ()
+{
+#ifdef linux
+  timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9*ts.tv_nsec;
+#else
+#error no linux
+  return 0;
+#endif
+}
+
+
 void TmTreemap::calibrateGaussianPerformance (int nMax, double coef[4], int deactivate, char* filename)
 {
 /*  XycVector<double> data;  
@@ -1181,11 +1751,18 @@ int TmTreemap::memory () const
   int mem = sizeof(TmTreemap);
   mem += node.capacity() * sizeof(TmNode);
   mem += unusedNodes.capacity() * sizeof(int);
-  mem += feature.capacity() * sizeof(TmFeature);
+  mem += feature.memory();
+  mem += isFirstOfFeatureBlock.capacity() * sizeof(bool);
   mem += optimizer.memory() - sizeof(Optimizer);
   mem += workspace.memoryUsage();
   mem += workspaceFloat.capacity() * sizeof(float);  
+  for (int i=0; i<(int) threadWorkspace.size(); i++) mem += threadWorkspace[i].memoryUsage();  
+  for (int i=0; i<(int) threadWorkspaceFloat.size(); i++) mem += threadWorkspaceFloat[i].capacity() * sizeof(float);  
+  for (int i=0; i<(int) moveEvaluator.size(); i++) mem += moveEvaluator[i].memory();
+  mem += klCandidate.capacity() * (sizeof(Move) + sizeof(double));  
   if (root!=NULL) mem += root->recursiveMemory ();  
+  if (backgroundOptimizer!=NULL) mem += backgroundOptimizer->memory ();  
+  mem += allocator.memory() - sizeof(TmAllocator);  
   return mem;  
 }
 
@@ -1361,17 +1938,253 @@ void TmTreemap::Move::undoIt ()
 }
 
 
+/****** TmTreemap::MoveEvaluator *********/
+
+TmTreemap::MoveEvaluator::MoveEvaluator ()
+  :tree (NULL), cost (0)
+{}
+
+
+void TmTreemap::MoveEvaluator::optimalMove (TmNode* lca, int sideOfLca, double bound, double joinOnlyBelow, Move& move)
+{
+  TmNode* s = move.subtree;
+  TmNode* other = lca->child[1-sideOfLca];  
+  if (s->parent!=lca) {
+    // first (virtually) move \c s to the other side of \c lca directly above \c other
+    const TmExtendedFeatureList* fpSide;
+    int lpFSide;    
+    double wcSide = costWithout (lca, sideOfLca, s, fpSide, lpFSide);
+    // the parent of \c s takes the place of \c other which keeps its side
+    TmExtendedFeatureList& fpOther = (fpSide==&buffer[0]) ? buffer[1] : buffer[0];
+    int lpF;    
+    if (sideOfLca==0) lpF = linearizationPointFeature (s->linearizationPointFeature, other->linearizationPointFeature);
+    else lpF = linearizationPointFeature (other->linearizationPointFeature, s->linearizationPointFeature);
+    int nOther = merge (other->featurePassed, s->featurePassed, lpF, fpOther);
+    cost += TmNode::updateFeaturePassedCost (nOther);
+    int n = sizeOfUnion (*fpSide, fpOther);
+    cost += TmNode::updateFeaturePassedCost (n);    
+    double updateCost = TmNode::updateGaussianCost (n);
+
+    // Find the best place for it there (same as \c TmNode::boundForChild)
+    double boundOther = bound - updateCost;
+    if (wcSide>=boundOther) boundOther = -1;
+    double joinOnlyBelowOther = joinOnlyBelow - updateCost;
+    if (wcSide>=joinOnlyBelowOther) joinOnlyBelowOther = -1;
+    descend (other, sideOfLca==0, nOther, boundOther, joinOnlyBelowOther, move, true);
+    move.cost = max(move.cost, wcSide) + updateCost;
+  }
+  else {
+    // We move one whole side of \c lca to the other. So just call descend
+    // But we do not allow subtree to stay where it is, because this would be a null-move.
+    descend (other, sideOfLca==0, 0, bound, joinOnlyBelow, move, false);
+  }
+}
+
+
+void TmTreemap::MoveEvaluator::descend (TmNode* sibling, bool isSubtreeFirst, int nrOfFeatures, double bound, double joinOnlyBelow, Move& bestMove, bool mayStayHere)
+{
+  assert(bestMove.subtree!=NULL);
+  TmNode* s = bestMove.subtree;
+  bestMove.cost  = vmInf();
+  bestMove.above = NULL;
+  if (bound<0) return;  
+
+  if (isIntersectionEmpty (s->featurePassed, sibling->featurePassed)) return; // move only to somewhere across the border  
+
+  if (mayStayHere) {    
+    // let s stay where it is namely above \c sibling
+    double wc0 = s->worstCaseUpdateCost;
+    double wc1 = sibling->worstCaseUpdateCost;
+    bestMove.above      = sibling;  
+    bestMove.cost       = (wc0<wc1 ? wc1 : wc0) + TmNode::updateGaussianCost (nrOfFeatures); // preliminary
+    if (bestMove.cost<bound) bound = bestMove.cost;
+  }
+
+  if (s->isLeaf() && sibling->isLeaf()) {
+    // Try whether \c subtree and \c above can be joined    
+    int lpF;    
+    if (isSubtreeFirst) lpF = linearizationPointFeature (s->linearizationPointFeature, sibling->linearizationPointFeature);
+    else lpF = linearizationPointFeature (sibling->linearizationPointFeature, s->linearizationPointFeature);
+    double cost = JOINFACTOR*costOfJoining (s, sibling, lpF); 
+    if (cost<bestMove.cost && cost<joinOnlyBelow) {
+      bestMove.above      = sibling;
+      bestMove.join       = true;      
+      bestMove.cost       = cost;
+    }    
+  }
+
+  double lowerBound = s->worstCaseUpdateCost+TmNode::updateGaussianCost(s->featurePassed.size()); // lower bound for target function
+  if (lowerBound>=bound) return;  
+
+  if (!sibling->isLeaf()) {
+    // Check locations somewhere below sibling->child[0] and sibling->child[1]
+    Move initialMove (bestMove);    
+    for (int k=0; k<2; k++) {
+      TmNode* below = sibling->child[k];
+      TmNode* other = sibling->child[1-k];
+      // \c below keeps its side in the new parent of \c s which
+      // replaces it as child of \c sibling
+      int lpF;      
+      if (k==0) lpF = linearizationPointFeature (below->linearizationPointFeature, s->linearizationPointFeature);
+      else lpF = linearizationPointFeature (s->linearizationPointFeature, below->linearizationPointFeature);
+      int nBelow = merge (below->featurePassed, s->featurePassed, lpF, buffer[0]);
+      cost += TmNode::updateFeaturePassedCost (nBelow);
+      int n = sizeOfUnion (buffer[0], other->featurePassed);
+      cost += TmNode::updateFeaturePassedCost (n);
+      double updateCost = TmNode::updateGaussianCost (n);
+      double otherCost  = other->worstCaseUpdateCost;      
+
+      double boundBelow = bound - updateCost;
+      if (otherCost>=boundBelow) boundBelow = -1;
+      double joinOnlyBelowBelow = joinOnlyBelow - updateCost;
+      if (otherCost>=joinOnlyBelowBelow) joinOnlyBelowBelow = -1;
+      Move bestAbove (initialMove);
+      descend (below, k==1, nBelow, boundBelow, joinOnlyBelowBelow, bestAbove, true);
+      bestAbove.cost = max(bestAbove.cost, otherCost) + updateCost;
+      if (bestAbove.cost<bestMove.cost) {        
+        bestMove  = bestAbove;
+        bound = bestMove.cost;
+      }
+    }
+  }
+
+#if ASSERT_LEVEL>=3
+  assert ((finite(bestMove.cost)) != (bestMove.above==NULL));
+  assert (!bestMove.join || bestMove.cost<joinOnlyBelow);  
+#endif
+}
+
+
+double TmTreemap::MoveEvaluator::costWithout (TmNode* lca, int sideOfLca, TmNode* subtree, const TmExtendedFeatureList*& fp, int& lpF)
+{
+  assert (subtree->parent!=lca && subtree->whichSideOf (lca)==sideOfLca);  
+  // The sibling of \c subtree takes the place of its parent
+  TmNode* sibling = subtree->sibling();
+  fp  = &sibling->featurePassed;
+  lpF = sibling->linearizationPointFeature;
+  double wc = sibling->worstCaseUpdateCost;
+  int b = 0;  
+  for (TmNode* n = subtree->parent; n->parent!=lca; n = n->parent) {
+    TmNode* p     = n->parent;
+    TmNode* other = n->sibling();    
+    int lpFP;
+    if (p->child[0]==n) lpFP = linearizationPointFeature (lpF, other->linearizationPointFeature);
+    else lpFP = linearizationPointFeature (other->linearizationPointFeature, lpF);
+    int nr = merge (*fp, other->featurePassed, lpFP, buffer[b]);
+    cost += TmNode::updateFeaturePassedCost (nr);    
+    double wcOther = other->worstCaseUpdateCost;
+    wc  = (wc<wcOther ? wcOther : wc) + TmNode::updateGaussianCost (nr);
+    fp  = &buffer[b];
+    lpF = lpFP;
+    b   = 1-b;    
+  }
+  return wc;  
+}
+
+
+int TmTreemap::MoveEvaluator::merge (const TmExtendedFeatureList& a, const TmExtendedFeatureList& b, int lpF, TmExtendedFeatureList& result)
+{
+  int n = 0;  
+  result.resizeWithUndefinedData (a.size()+b.size());
+  const TmExtendedFeatureId* fA    = a.begin();
+  const TmExtendedFeatureId* fAEnd = a.end();  
+  const TmExtendedFeatureId* fB    = b.begin();
+  const TmExtendedFeatureId* fBEnd = b.end();
+  TmExtendedFeatureId* r = result.begin();
+  const int* tC = tree->feature.multiPurposeFields();  
+  while (fA!=fAEnd || fB!=fBEnd) {
+    int id, count;    
+    if (fB==fBEnd || (fA!=fAEnd && fA->id<fB->id)) { // only in 'a'
+      id    = fA->id;
+      count = fA->count;
+      fA++;      
+    }
+    else if (fA==fAEnd || fB->id<fA->id) { // only in 'b'
+      id    = fB->id;
+      count = fB->count;
+      fB++;
+    }
+    else { // in both
+      id    = fA->id;
+      count = fA->count + fB->count;
+      fA++;
+      fB++;      
+    }
+    n++;    
+    if (id==lpF || count<TmFeature::totalCountOfExistingFeature (tC[id])) {
+      r->id    = id;
+      r->count = count;
+      r++;      
+    }
+  }
+  result.eraseAfter (r);
+  return n;  
+}
+
+
+int TmTreemap::MoveEvaluator::sizeOfUnion (const TmExtendedFeatureList& a, const TmExtendedFeatureList& b)
+{
+  int n = 0;  
+  const TmExtendedFeatureId* fA    = a.begin();
+  const TmExtendedFeatureId* fAEnd = a.end();  
+  const TmExtendedFeatureId* fB    = b.begin();
+  const TmExtendedFeatureId* fBEnd = b.end();
+  while (fA!=fAEnd && fB!=fBEnd) {
+    if (fA->id<fB->id) fA++;
+    else if (fB->id<fA->id) fB++;
+    else {
+      fA++;
+      fB++;      
+    }    
+    n++;    
+  }
+  return n + (fAEnd-fA) + (fBEnd-fB);
+}
+
+
+double TmTreemap::MoveEvaluator::costOfJoining (const TmNode* a, const TmNode* b, int lpF)
+{
+  // Same as \c TmTreemap::effectOfJoining but only counting
+  if (!a->isFlag (TmNode::CAN_BE_INTEGRATED) || !b->isFlag (TmNode::CAN_BE_INTEGRATED)) return vmInf();
+  TmExtendedFeatureList& flx = buffer[1];
+  flx.clear();
+  for (int i=0; i<(int) a->gaussian.feature.size(); i++) flx.push_back (a->gaussian.feature[i]);
+  for (int i=0; i<(int) b->gaussian.feature.size(); i++) flx.push_back (b->gaussian.feature[i]);
+  sumUp (flx);
+  if (flx.size()==0) return vmInf(); // not allowed to be joined  
+  int nMP = 0; // how many will be marginalized out at the joined node or passed to the parent
+  for (int i=0; i<(int) flx.size(); i++) {
+    const TmExtendedFeatureId& feat = flx[i];
+    const TmFeature& feat2 = tree->feature[feat.id];    
+    if (feat.id==lpF) nMP++;
+    else if (feat.count < feat2.totalCount()) {
+      if (!feat2.isFlag (TmFeature::CAN_BE_SPARSIFIED)) nMP++;
+    }
+    else if (!feat2.isFlag (TmFeature::CAN_BE_MARGINALIZED_OUT)) nMP++;
+  }
+  return TmNode::updateGaussianCost (nMP);
+}
+
+
+int TmTreemap::MoveEvaluator::memory () const
+{
+  return sizeof (MoveEvaluator) + (buffer[0].capacity() + buffer[1].capacity()) * sizeof (TmExtendedFeatureId);
+}
+
+
 /****** TmTreemap::Optimizer *********/
 
 TmTreemap::Optimizer::Optimizer ()
   :tree (NULL), optimizationQueue(), lcaIndex(-1), initialCost(0), unsuccessfulMoves(), 
-   maxNrOfUnsuccessfulMoves(-1), nrOfMovesPerStep(-1), report()
+   maxNrOfUnsuccessfulMoves(-1), nrOfMovesPerStep(-1), report(), mayJoin(true), moveLog(NULL),
+   prioritizeCriticalPath(false)
 {}
 
 
 TmTreemap::Optimizer::Optimizer (TmTreemap* tree, int nrOfMovesPerStep, int maxNrOfUnsuccessfulMoves)
   :tree (NULL), optimizationQueue(), lcaIndex(-1), initialCost(0), unsuccessfulMoves(), 
-   maxNrOfUnsuccessfulMoves(-1), nrOfMovesPerStep(-1), report()
+   maxNrOfUnsuccessfulMoves(-1), nrOfMovesPerStep(-1), report(), mayJoin(true), moveLog(NULL),
+   prioritizeCriticalPath(false)
 {
   create (tree, nrOfMovesPerStep, maxNrOfUnsuccessfulMoves);  
 }
@@ -1379,22 +2192,30 @@ TmTreemap::Optimizer::Optimizer (TmTreemap* tree, int nrOfMovesPerStep, int maxN
 
 TmNode* TmTreemap::Optimizer::nextNodeToBeOptimized ()
 {
-  TmNode* n = NULL;  
-  while (!optimizationQueue.empty() && n==NULL) {    
-    if (lcaIndex<0) { // Fetch new node
-      lcaIndex = optimizationQueue.front();
-      n = tree->getNode (lcaIndex);
-      if (n!=NULL) {
-        initialCost = n->worstCaseUpdateCost;
-      }      
-    }    
-    else n = tree->getNode (lcaIndex); // Just get ptr to old node    
-    if (n==NULL) { // Node does not exist any more
+  if (lcaIndex>=0) { // Continue with the old node
+    TmNode* n = tree->getNode (lcaIndex);
+    if (n!=NULL) return n;
+    optimizationQueue.remove (lcaIndex); // Node does not exist any more
+    lcaIndex = -1;
+  }
+  tree->updateFeaturePassed ();
+  while (!optimizationQueue.empty()) {
+    int index = optimizationQueue.front();
+    TmNode* n = tree->getNode (index);
+    if (n==NULL || n->isFlag (TmNode::IS_OPTIMIZED)) { // Node does not exist any more
       optimizationQueue.pop_front();
-      lcaIndex = -1;
+      continue;
     }
+    double p = priority (n);
+    if (p<optimizationQueue.priority (index)) { // Outdated, so sort in again
+      optimizationQueue.push (index, p);
+      continue;
+    }
+    lcaIndex = index;
+    initialCost = n->worstCaseUpdateCost;
+    return n;
   }
-  return n;  
+  return NULL;
 }
   
 
@@ -1421,7 +2242,18 @@ string TmTreemap::Optimizer::getAndClearReport ()
 
 int TmTreemap::Optimizer::memory () const
 {
-  return sizeof(Optimizer) + optimizationQueue.size()*sizeof(int) + unsuccessfulMoves.capacity()*sizeof(MoveIndices);
+  return sizeof(Optimizer) + optimizationQueue.memory() - sizeof(TmOptimizationQueue) + unsuccessfulMoves.capacity()*sizeof(MoveIndices);
+}
+
+
+double TmTreemap::Optimizer::priority (const TmNode* n) const
+{
+  if (!prioritizeCriticalPath || tree->root==NULL) return 0;
+  // Cost of the most expensive path from the root through \c n
+  double pathCost = n->worstCaseUpdateCost;
+  for (const TmNode* a=n->parent; a!=NULL; a=a->parent) pathCost += a->updateCost;
+  double cost = max (n->worstCaseUpdateCost, TmNode::costEps());
+  return pathCost / max (tree->root->worstCaseUpdateCost, TmNode::costEps()) / cost;
 }
 
 
@@ -1450,7 +2282,8 @@ void TmTreemap::Optimizer::oneKLRun ()
   bool didSomething = false;  
   while ((int) moves.size()<maxNrOfUnsuccessfulMoves) {
     // Do greedy moves preliminary even if they increase worstCaseUpdateCost
-    tree->optimalKLStep (currentLca, bestCost-TmNode::costEps(), move);
+    if (mayJoin) tree->optimalKLStep (currentLca, bestCost-TmNode::costEps(), move);
+    else tree->optimalKLStep (currentLca, -vmInf(), move);
     assert (!move.join || move.cost<bestCost+TmNode::costEps());
     if (move.isEmpty()) break;
     moves.push_back (move);    
@@ -1473,6 +2306,10 @@ void TmTreemap::Optimizer::oneKLRun ()
         report += txt;        
         if (moves[i].join) report += " joined ";
 #endif
+        if (moveLog!=NULL) {
+          moves[i].setOldAbove ();
+          moveLog->push_back (MoveIndices (moves[i].subtree->index, moves[i].above->index, moves[i].oldAbove->index));
+        }        
         moves[i].doIt ();
       }
       bestCost = moves.back().cost;
@@ -1495,14 +2332,15 @@ void TmTreemap::Optimizer::oneKLRun ()
     moves[i].subtree ->setFlag (TmNode::CAN_BE_MOVED);
   }  
   if (didSomething) {
-    optimizationQueue.push_back (optimizationQueue.front());  
+    // lca stays in the queue and is continued by the next run
 #ifndef NDEBUG
     sprintf (txt, " (%6.4fms >> %6.4fms) ", initialCost*1000, bestCost*1000);    
     report += txt;    
 #endif
   }
   else {
-    TmNode* n = tree->getNode (optimizationQueue.front());
+    TmNode* n = tree->getNode (lcaIndex);
+    optimizationQueue.remove (lcaIndex);
     lcaIndex = -1;    
     if (n!=NULL) n->setFlag (TmNode::IS_OPTIMIZED);
 #ifndef NDEBUG
@@ -1510,7 +2348,6 @@ void TmTreemap::Optimizer::oneKLRun ()
 #endif
     if (n!=NULL) tree->checkForSparsification (n);
   }
-  optimizationQueue.pop_front();
   tree->updateFeaturePassed();
   tree->isGaussianValidValid = oldIsGaussianValidValid;  
 #if ASSERT_LEVEL>=2
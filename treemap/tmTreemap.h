@@ -44,10 +44,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tmTypes.h"
 #include "tmNode.h"
 #include "tmFeature.h"
-#include <deque>
+#include "tmThreadPool.h"
+#include "tmOptimizationQueue.h"
 #include <vectormath/vectormath.h>
 #include <stdexcept>
 
+class TmBackgroundOptimizer;
+
 //! A treemap. The main classed used by an application to perform SLAM
 /*!
  */
@@ -57,6 +60,7 @@ class TmTreemap
 
   friend class MainWindow;
   friend class TmNode;  
+  friend class TmBackgroundOptimizer;  
   
   //! Uninitialised treemap
   TmTreemap();
@@ -95,6 +99,13 @@ class TmTreemap
   //! updated.
   bool isEstimateValid;  
 
+  //! Incremented whenever Gaussians are recomputed
+  /*! A node whose \c TmNode::estimateStamp equals \c estimateStamp
+      holds up to date estimates for the features marginalized out
+      there. Used by \c estimateOf to reuse estimates computed before.
+   */
+  int estimateStamp;  
+
   //! Whether the nodes \c gaussianValid flags reflect the current situation.
   /*! This flag is usually true. Only during the HTP optimization algorithm
       the systems moves nodes to variuous positions invalidating their 
@@ -142,6 +153,32 @@ class TmTreemap
   //! Prints information on reused feature numbers
   void printFeatureFragmentation () const;  
 
+  //! Renumbers the features removing unused entries from \c feature
+  /*! Deleted features leave unused entries in \c feature that are
+      only reused for blocks of at most the same size (see \c
+      printFeatureFragmentation). This function removes all blocks
+      returned by \c newFeatureBlock where every feature is unused
+      and moves the other features down, rewriting the feature ids
+      of all nodes in one sweep. The order of the features is kept,
+      so all lists remain sorted and no Gaussian has to be
+      recomputed. A block is moved as a whole, so its features remain
+      consecutive, even if some of them are unused.
+
+      Afterwards \c featuresRenumbered is called, so derived classes
+      can update the feature ids they store. The background
+      optimization is finished before. Returns the number of entries
+      removed.
+  */
+  virtual int renumberFeatures ();
+
+  //! Is called by \c renumberFeatures after the features have been renumbered
+  /*! Feature \c i is now feature \c newId[i] or has been removed if
+      \c newId[i]<0. A derived class storing feature ids must
+      overload this function and map them. The default implementation
+      does nothing.
+  */
+  virtual void featuresRenumbered (const TmFeatureList& newId);
+
 
   //! Is called, when feature \c id is sparsified out during joining of leaves
   /*! The default implementation just does nothing. However
@@ -166,7 +203,72 @@ class TmTreemap
 
 
   //! Optimizes with full runs. Not spreading runs over several steps.
+  /*! With background optimization (\c setBackgroundOptimization)
+      this only exchanges results with the background thread and
+      returns immediately. */
   virtual void optimizeFullRuns ();
+
+  //! What \c runStep did and what it deferred to later steps
+  class StepResult
+    {
+    public:
+      StepResult ()
+        :nrOfKLRuns(0), nrOfNodesToBeOptimized(0), isGaussianUpdateDeferred(false),
+        isEstimateDeferred(false)
+        {}
+
+      //! Number of \c Optimizer::oneKLRun performed
+      int nrOfKLRuns;
+
+      //! Nodes left in \c Optimizer::optimizationQueue
+      int nrOfNodesToBeOptimized;
+
+      //! Whether invalid Gaussians were not updated
+      bool isGaussianUpdateDeferred;
+
+      //! Whether the estimate was not computed
+      /*! Then \c TmFeature::est still holds the estimate of an
+          earlier step. */
+      bool isEstimateDeferred;
+
+      //! Whether Gaussians and estimate are up to date
+      bool isComplete () const {return !isGaussianUpdateDeferred && !isEstimateDeferred;}
+    };
+
+  //! One SLAM step with a hard time limit
+  /*! Does the work of \c updateGaussians, \c computeLinearEstimate
+      and \c optimizeFullRuns but stops when \c monotonicTime()
+      reaches \c deadline. The Gaussians are updated and the estimate
+      computed first, since these are needed by the application. The
+      remaining time is used for KL runs, up to the budget of \c
+      optimizeFullRuns. The moves of these runs invalidate Gaussians
+      that are updated in the next step. With \c deadline=vmInf()
+      nothing is deferred.
+
+      None of these computations can be interrupted. So a computation
+      is only started if it is predicted to finish before the
+      deadline. The prediction is based on the time the last
+      computations took (\c gaussianTimePerCost, \c estimateTime, \c
+      klRunTime). If not all Gaussians can be updated, the largest
+      subtrees that fit are updated, so later steps have less to do.
+      Everything that is not started is deferred and the tree
+      remains valid. With background optimization the KL runs are
+      always done by the background thread.
+  */
+  StepResult runStep (double deadline);  
+
+  //! Moves the HTP optimization into a background thread
+  /*! If \c on, a \c TmBackgroundOptimizer is created that optimizes
+      a structural copy of one subtree at a time. Its moves are
+      applied in \c optimizeFullRuns, which is the safe point where
+      the tree may change. So the KL runs do not add to the time of a
+      SLAM step. Switching off waits for the background thread and
+      applies its last result.
+   */
+  void setBackgroundOptimization (bool on);
+
+  //! Whether \c setBackgroundOptimization is on
+  bool isBackgroundOptimization () const {return backgroundOptimizer!=NULL;}
   
 
   //! Return a textual description what happened in the last optimizations
@@ -337,7 +439,7 @@ class TmTreemap
       is returned.
 
       The leaf is first inserted above the root but immediately moved
-      to a reasonable location by \c recursiveOptimalDescend.
+      to a reasonable location by \c optimalKLStep.
   */
   TmNode* addLeaf (const TmGaussian& gaussian, int flags=TmNode::CAN_BE_INTEGRATED);
   
@@ -372,7 +474,7 @@ class TmTreemap
       are indices to this array. Take care to reserve enough
       memory to avoid copying.
   */
-  XycVector<TmFeature> feature;
+  TmFeatureArray feature;
 
   //! We maintain lists of free blocks of features below this size
   enum {MAX_FEATURE_BLOCK_SIZE=16};
@@ -384,6 +486,13 @@ class TmTreemap
    */
   int firstUnusedFeature[MAX_FEATURE_BLOCK_SIZE];
 
+  //! Whether a block returned by \c newFeatureBlock begins at a feature
+  /*! Used by \c renumberFeatures to move blocks as a whole. Features
+      beyond \c isFirstOfFeatureBlock.size() have been added by
+      resizing \c feature and belong to the block before.
+   */
+  XycVector<bool> isFirstOfFeatureBlock;
+
 
   //! Returns the node with \c index
   TmNode* getNode (int index) const
@@ -440,10 +549,184 @@ class TmTreemap
   */
   void updateAllEstimates ();  
 
+  //! Returns the estimate for feature \c id computing only what is needed for it
+  /*! Updates the Gaussians and estimates the features along the path
+      from the root to \c feature[id].marginalizationNode. Nodes which
+      have been estimated since the Gaussians were last changed, by
+      \c computeLinearEstimate or a previous query, are not computed
+      again. So querying \c k features costs O(k log n) and
+      neighbouring features share most of their path. The estimates
+      of all features marginalized out on the path are updated in \c
+      feature as a side effect. Returns \c feature[id].est unchanged
+      if the feature is not represented in any node.
+  */
+  float estimateOf (TmFeatureId id);  
+
+  //! Batched version of \c estimateOf
+  /*! Sets \c est[i] to the estimate of \c id[i].*/
+  void estimatesOf (const TmFeatureList& id, XycVector<float>& est);  
+
 
   //! Update all Gaussians but not the estimate
+  /*! Uses the thread pool set by \c setNrOfThreads, see \c TmNode::updateGaussian. */
   void updateGaussians ();
 
+  //! Sets the number of threads used for updating Gaussians
+  /*! For \c n>1 a \c TmThreadPool with \c n threads (including the
+      calling one) is created. \c updateGaussians updates and \c
+      computeLinearEstimate estimates independent subtrees in
+      parallel. The result is bitwise identical to the serial
+      computation. With \c n=1 (the default) everything is computed
+      in the calling thread.
+   */
+  void setNrOfThreads (int n);
+
+  //! Number of threads set by \c setNrOfThreads
+  int nrOfThreads () const;  
+
+  //! Reserves the workspace of all threads for Gaussians up to \c rows x \c cols
+  /*! Uses the workspace query \c xymGEQR2WorkspaceSize, so
+      triangularizing and updating Gaussians up to that size never
+      reallocate the workspace. Otherwise it grows on demand. Must
+      be called after \c setNrOfThreads.
+   */
+  void reserveWorkspace (int rows, int cols);
+
+  //! Minimal \c TmNode::updateCost of a node for updating its children in parallel
+  /*! Spawning a task costs a few microseconds, so small subtrees are
+      better updated by a single thread. */
+  double parallelUpdateThreshold;  
+
+  //! Threshold for skipping unchanged nodes when computing the estimate
+  /*! If \c >=0, \c computeLinearEstimate does not recompute a node
+      whose Gaussian did not change and where no estimate passed
+      from the parent moved by more than \c
+      incrementalEstimateEpsilon since the node was computed. If this
+      holds for a whole subtree, the subtree is skipped without being
+      visited (see \c TmNode::estimateUsingRCompressed). So the
+      estimation cost is proportional to the part of the map affected
+      by new information. The estimates are then only approximate,
+      with \c 0 meaning unchanged inputs are skipped and the result
+      is exact. A negative value (the default) computes all nodes
+      every time. The number of nodes skipped is reported in \c
+      TreemapStatistics::nrOfNodesNotEstimated.
+   */
+  float incrementalEstimateEpsilon;  
+
+  //! Relocates subtrees so their nodes lie contiguously in DFS order
+  /*! \c TmNode::estimateUsingRCompressed visits the nodes in
+      pre-order (node, \c child[0], \c child[1]). After the tree
+      has been modified for a while, the nodes are scattered over
+      the \c allocator. This routine looks for maximal subtrees that
+      are not laid out in pre-order and copies them into one
+      contiguous piece of the \c allocator, in pre-order. The copy
+      also allocates the Gaussians' buffers in that order. Only
+      subtrees whose Gaussians are valid and which are optimized
+      (\c TmNode::IS_OPTIMIZED) are relocated, since others are
+      likely to change soon anyway.
+
+      At most \c maxNrOfNodes nodes are relocated, so by calling it
+      regularly the tree is compacted incrementally. The scan itself
+      is O(n) but much cheaper than the estimation. Node indices
+      are kept and \c TmFeature::marginalizationNode is redirected,
+      but any other pointer to a node of the tree is invalid
+      afterwards. Returns the number of nodes relocated.
+   */
+  int compactNodes (int maxNrOfNodes);  
+
+  //! Number of nodes \c computeLinearEstimate relocates by \c compactNodes
+  /*! The default \c 0 disables compaction. */
+  int nrOfNodesCompactedPerEstimate;  
+
+  //! Quantizes the Gaussians of all nodes where \c canBeQuantized
+  /*! Calls \c TmGaussian::quantize, which halves the memory of \c
+      TmGaussian::RCompressed at the cost of a bounded error in the
+      estimate. A Gaussian that is recomputed later is stored
+      unquantized again until it qualifies again. The scan is O(n).
+      Returns the number of Gaussians quantized.
+   */
+  int quantizeGaussians ();  
+
+  //! Whether the Gaussian of \c n shall be quantized by \c quantizeGaussians
+  /*! The default implementation quantizes the Gaussians of inner
+      nodes which have not been recomputed for \c
+      quantizeGaussiansAfter calls to \c updateGaussians that changed
+      something, i.e. nodes deep in the tree not affected by new
+      measurements. Leaves are not quantized, since they hold the
+      original information and would accumulate the error.  A derived
+      class can overload it to implement its own policy.
+   */
+  virtual bool canBeQuantized (const TmNode* n) const;  
+
+  //! Age after which \c computeLinearEstimate quantizes a Gaussian
+  /*! See \c canBeQuantized. A negative value (the default) disables
+      quantization. */
+  int quantizeGaussiansAfter;  
+
+  //! Freezes all maximal subtrees where \c canBeFrozen holds for every node
+  /*! The nodes below the root of such a subtree are deleted and
+      stored packed in its \c TmNode::frozen (\c TmFrozenSubtree),
+      reducing their memory to less than half. The root then looks
+      like a leaf. Already frozen subtrees are merged into larger ones.
+      Only subtrees of at least three nodes are frozen. The scan is
+      O(n) in the number of nodes not frozen. Returns the number of
+      nodes frozen.
+
+      The nodes are rebuilt by \c thawSubtree when needed, i.e. if a
+      feature marginalized out below is observed again, the Gaussians
+      are recomputed or the leaves involving a feature are searched
+      (\c findLeavesInvolving, \c identifyFeatures). Nodes of a
+      derived class are rebuilt as plain \c TmNode. This is allowed,
+      because a \c TmNode::CAN_BE_INTEGRATED node may be replaced by
+      \c joinSubtree anyway.
+   */
+  int freezeSubtrees ();
+
+  //! Whether \c n may be frozen by \c freezeSubtrees
+  /*! The default implementation freezes nodes whose Gaussian is
+      valid, compressed and has not been recomputed for \c
+      freezeSubtreesAfter calls to \c updateGaussians that changed
+      something, that are optimized and may be integrated (\c
+      TmNode::CAN_BE_INTEGRATED), because these are promised to be
+      never changed by the application. A derived class can overload it
+      to implement its own policy.
+   */
+  virtual bool canBeFrozen (const TmNode* n) const;
+
+  //! Age after which \c computeLinearEstimate freezes a subtree
+  /*! See \c canBeFrozen. A negative value (the default) disables
+      freezing. */
+  int freezeSubtreesAfter;
+
+  //! Enables the mixed precision update of inner nodes if \c >=0
+  /*! If set, \c TmNode::updateGaussian rotates the children's rows
+      directly into the float triangle \c TmGaussian::RCompressed of
+      the node with double rotations (\c
+      TmGaussian::multiplyTriangularCompressed) instead of using a
+      double triangle compressed afterwards. If the \c
+      TmGaussian::diagonalRatio of the rows marginalized out is below
+      \c mixedPrecisionDiagonalRatio, i.e. the node is poorly
+      conditioned, the node is recomputed in double. Float has a
+      relative precision of about 6E-8, so \c 1E-4 is a reasonable
+      choice. The number of
+      these fallbacks is reported in \c
+      TreemapStatistics::nrOfMixedPrecisionFallbacks. A negative value
+      (the default) always uses double.
+   */
+  double mixedPrecisionDiagonalRatio;  
+
+  //! Rebuilds the nodes below \c n from \c n->frozen
+  /*! The nodes are restored with the same Gaussians and flags, so
+      nothing needs to be recomputed. They get new indices. */
+  void thawSubtree (TmNode* n);
+
+  //! Returns \c feature[id].marginalizationNode after thawing it if it is frozen
+  /*! If a feature has been marginalized out below a frozen node, \c
+      feature[id].marginalizationNode is the frozen node. Routines that
+      invalidate the node where \c id is actually marginalized out
+      must use this one instead. */
+  TmNode* thawMarginalizationNode (TmFeatureId id);
+
 
   //! Cost for updating all invalid Gaussians
   double updateGaussiansCost () const;  
@@ -529,6 +812,12 @@ class TmTreemap
   /*! Only implemented in LINUX. */
   static double time();
 
+  //! Returns the time of a monotonic clock in seconds
+  /*! Unlike \c time() this is always wall clock time and does not
+      jump when the system time is set. \c runStep expects its
+      deadline in this time. Only implemented in LINUX. */
+  static double monotonicTime();
+
   //! Calibrates the computation time of making a Gaussian as a 3rd order polynomial in n
   /*! The polynomial fitted is 
 
@@ -614,9 +903,40 @@ class TmTreemap
     //! Number of nodes where the Gaussian has been updated
     long int nrOfGaussianUpdates;  
     
+    //! Number of nodes where the estimate has been computed by \c TmNode::estimateUsingRCompressed
+    long int nrOfEstimates;
+
+    //! Number of nodes not estimated by the last \c computeLinearEstimate
+    /*! Nodes are skipped because of incremental estimation (\c
+        incrementalEstimateEpsilon) or \c TmNode::DONT_UPDATE_ESTIMATE.
+    */
+    int nrOfNodesNotEstimated;    
+
+    //! Number of nodes relocated by \c compactNodes
+    /*! Accumulated since initializing the treemap(). */
+    long int nrOfNodesCompacted;    
+
+    //! Number of Gaussians quantized by \c quantizeGaussians
+    /*! Accumulated since initializing the treemap(). */
+    long int nrOfGaussiansQuantized;    
+
+    //! Number of nodes currently stored in a \c TmNode::frozen
+    /*! These are not included in \c nrOfNodes. */
+    int nrOfNodesFrozen;    
+
     //! Corresponding accumulated cost for \c optimalKLStep
     double accumulatedOptimizationCost;      
 
+    //! Number of heap allocations by \c TmNode::updateGaussian
+    /*! Accumulated since initializing the treemap(). Grows only while
+        the scratch memory (\c TmAllocator::ThreadBuffers) is not
+        yet large enough. */
+    long int nrOfGaussianAllocations;    
+
+    //! Number of nodes recomputed in double because of \c mixedPrecisionDiagonalRatio
+    /*! Accumulated since initializing the treemap(). */
+    long int nrOfMixedPrecisionFallbacks;    
+
     class HTPEntry 
     {
     public:
@@ -637,7 +957,9 @@ class TmTreemap
 
     TreemapStatistics ()
       : nrOfNodes(0), nrOfNodesToBeOptimized(0),
-      accumulatedUpdateCost(0), nrOfGaussianUpdates(0), accumulatedOptimizationCost (0), memory(0)
+      accumulatedUpdateCost(0), nrOfGaussianUpdates(0), nrOfEstimates(0), nrOfNodesNotEstimated(0),
+      nrOfNodesCompacted(0), nrOfGaussiansQuantized(0), nrOfNodesFrozen(0), accumulatedOptimizationCost (0), nrOfGaussianAllocations(0),
+      nrOfMixedPrecisionFallbacks(0), memory(0)
       {}      
 
       //! Tells the statistics, that we tried \c n step and whether we had success
@@ -752,7 +1074,14 @@ class TmTreemap
   void recursivelyAdd (TmExtendedFeatureList& fl, TmNode* subtree) const;  
 
   //! Recursively stacks all input Gaussians below \c subtree into \c join
-  void recursivelyMultiply (TmGaussian& join, TmNode* subtree);  
+  /*! \c columnOfFeature is an index of \c join.feature (\c
+      TmGaussian::indexColumns) built once and used for all leaves. */
+  void recursivelyMultiply (TmGaussian& join, TmNode* subtree, const XycVector<int>& columnOfFeature);  
+
+  //! Same as \c recursivelyMultiply but rotates into a triangular \c join
+  /*! Uses \c TmGaussian::multiplyTriangular, so \c join stays
+      triangular and needs no QR decomposition afterwards. */
+  void recursivelyMultiplyTriangular (TmGaussian& join, TmNode* subtree, const XycVector<int>& columnOfFeature);  
 
   //! Recursively deletes \c n and all ancestors.
   void recursivelyDelete (TmNode* n);
@@ -775,6 +1104,47 @@ class TmTreemap
    */
   TmNode* recursiveCopyTreeFrom (const TmNode* n2);  
 
+  //! Auxiliary function for \c compactNodes
+  /*! Scans the subtree below \c n and relocates subtrees below it
+      with \c relocateSubtree, decreasing \c budget by the number of
+      nodes relocated. Returns the number of nodes below \c n. \c
+      isStable is set, if the whole subtree below \c n may be
+      relocated, \c isContiguous, if it already is in pre-order in
+      the \c allocator and \c end to the end of its last node's
+      block.
+   */
+  int recursiveCompactNodes (TmNode* n, int& budget, bool& isStable, bool& isContiguous, const char*& end);  
+
+  //! Copies the subtree below \c n into one contiguous piece of \c allocator
+  /*! The nodes are copied in pre-order and the originals deleted. */
+  void relocateSubtree (TmNode* n);  
+
+  //! Auxiliary function for \c quantizeGaussians
+  /*! Quantizes the Gaussians below \c n and returns their number. */
+  int recursiveQuantizeGaussians (TmNode* n);
+
+  //! Auxiliary function for \c freezeSubtrees
+  /*! Returns whether \c canBeFrozen holds for all nodes below \c n.
+      Freezes the largest subtrees below \c n for which this holds
+      unless it holds for \c n itself and adds the number of nodes
+      frozen to \c nrOfNodes. */
+  bool recursiveFreezeSubtrees (TmNode* n, int& nrOfNodes);
+
+  //! Freezes the nodes below \c n, returns their number
+  int freezeSubtree (TmNode* n);  
+
+  //! Auxiliary function for \c thawSubtree
+  /*! Rebuilds the node \c fn and its subtree below \c parent and
+      advances \c fn to the node after that subtree. \c n is the node
+      being thawed. */
+  TmNode* thawNode (const TmFrozenNode*& fn, TmNode* parent, TmNode* n);  
+
+  //! Marks \c feature[id..id+n-1] as one block in \c isFirstOfFeatureBlock
+  void markFeatureBlock (TmFeatureId id, int n);
+
+  //! Sets \c TmFeature::marginalizationNode to \c n for all features marginalized out in \c n->frozen
+  void setFrozenMarginalizationNodes (TmNode* n);  
+
 
 
   
@@ -806,55 +1176,137 @@ class TmTreemap
 
 
   //! Subroutine for \c optimalKLStep
-  /*! Recursively checks all nodes below \c subtreeBelow which must be
-      below \c lca whether by moving them from one side of \c lca to
-      the other will improve \c lca->worstCaseUpdateCost.  It
-      considers only nodes that share at least one feature with \c
-      lca. If it finds a transfer that is better than \c move.cost it
-      replaces \c move. See \c recursiveOptimalDescend for \c joinOnlyBelow
-
-      It correctly handles the case when \c lca disappears because \c subtree
-      is one of its children.      
+  /*! Recursively appends all nodes below \c subtreeBelow which must
+      be below \c lca to \c klCandidate, if moving them from one side
+      of \c lca to the other could improve \c
+      lca->worstCaseUpdateCost. It considers only nodes that share at
+      least one feature with the other side of \c lca and that are
+      marked \c CAN_BE_MOVED. The nodes are appended in the order in
+      which they were formerly checked one after the other, so ties
+      between equally good moves are broken the same way.
   */
-  void recursiveOptimalKL (TmNode* lca, TmNode* subtreeBelow, int sideOfLca, double joinOnlyBelow, Move& bestMove);
-  
+  void recursiveCandidatesKL (TmNode* lca, TmNode* subtreeBelow, int sideOfLca);
+
+  //! Read-only evaluation of the moves considered by \c optimalKLStep
+  /*! Formerly the KL search moved a subtree tentatively with \c
+      TmNode::moveTo, recomputed \c featurePassed and moved it
+      back. The evaluator instead computes the \c worstCaseUpdateCost
+      the move would produce directly from \c featurePassed, \c
+      worstCaseUpdateCost and \c linearizationPointFeature of the
+      nodes involved. It modifies neither the tree nor \c
+      TmTreemap::feature, so several evaluators (one per thread) can
+      search for moves at the same time. All \c featurePassed below
+      the lca must be valid.
+
+      The computation is exactly the one of \c
+      TmNode::updateFeaturePassed applied to the virtually moved tree,
+      so the costs are bitwise identical to actually moving.
+   */
+  class MoveEvaluator 
+    {
+    public:
+      //! Empty constructor
+      MoveEvaluator ();      
+
+      //! The tree evaluated, must be set before use
+      const TmTreemap* tree;      
+
+      //! Formal cost of the \c featurePassed lists merged so far
+      /*! Same unit as \c TreemapStatistics::accumulatedOptimizationCost. */
+      double cost;      
+
+      //! Finds the best position on the other side of \c lca for \c move.subtree
+      /*! \c move.subtree must be below \c lca->child[sideOfLca] and
+          \c move must have been constructed from it. The cost
+          returned in \c move.cost is \c lca->worstCaseUpdateCost
+          after the move or, if \c move.subtree is a child of \c lca,
+          the cost of the node replacing \c lca. If no move with cost
+          \c <bound is found, \c move.cost is \c >=bound (usually
+          infinite). See \c descend for \c joinOnlyBelow.
+      */
+      void optimalMove (TmNode* lca, int sideOfLca, double bound, double joinOnlyBelow, Move& move);
 
-  //! Finds the best position below \c bestMove.subtree->parent to move \c bestMove.subtree.
-  /*! The routine optimizes \c .worstCaseUpdateCost of the least
-      common ancestor of \c bestMove.subtree and \c
-      bestMove.subtree->sibling(). In the current position this is \c
-      bestMove.subtree->parent. However, when \c bestMove.subtree
-      moves below \c bestMove.subtree->sibling(), \c
-      bestMove.subtree->parent moves with it and \c
-      bestMove.subtree->sibling() is the lca replacing \c
-      bestMove.subtree->parent in the overall tree.
+      //! Memory consumption in bytes
+      int memory () const;      
 
-      \c The whole move including cost is returned in \c bestMove.
+    protected:
+      //! Finds the best position for \c bestMove.subtree at or below \c sibling
+      /*! \c bestMove.subtree is virtually a child of a node (its
+          parent) the other child of which is \c sibling. It is child
+          0 if \c isSubtreeFirst and \c nrOfFeatures is the number of
+          features involved in the parent (see \c merge). The routine optimizes \c
+          .worstCaseUpdateCost of the least common ancestor of \c
+          bestMove.subtree and \c sibling. In the current position
+          this is the parent. When \c bestMove.subtree moves below \c
+          sibling, the parent moves with it and \c sibling is the lca
+          replacing the parent in the overall tree.
+
+          \c The whole move including cost is returned in \c bestMove.
+
+          If \c bestMove.subtree is a leaf the routine also considers
+          moving the leaf and joining it with another leaf as a single
+          step. However it returns this move only as optimal if the
+          resulting cost is below \c joinOnlyBelow. The reason for
+          this behavior is that joining cannot be undoed, so we accept
+          it in the KL optimization only if it actually leads to an
+          improved cost function.
+
+          If \c mayStayHere==false, the option to leave \c
+          bestMove.subtree where it is is forbidden.
+
+          The routine considers only nodes for \c bestMove.above that
+          share a landmark with \c bestMove.subtree. It further
+          terminates the search if the cost is \c >=bound.
+
+          For two optimal solutions \c bestAbove1, \c bestAbove2 the
+          routine chooses that one that leads to the smallest \c
+          worstCaseUpdateCost for the lca of \c bestAbove1 and \c
+          bestAbove2. This happens quite frequently if \c
+          bestMove.subtree is not on the worst case path after
+          insertion.
+
+          The routine does not modify \c bestMove.subtree and \c
+          bestMove.oldAbove.
+      */
+      void descend (TmNode* sibling, bool isSubtreeFirst, int nrOfFeatures, double bound, double joinOnlyBelow, Move& bestMove, bool mayStayHere);
+
+      //! \c worstCaseUpdateCost of \c lca->child[sideOfLca] after removing \c subtree from there
+      /*! \c subtree must be below \c lca->child[sideOfLca] but not a
+          child of \c lca. The \c featurePassed and \c
+          linearizationPointFeature of the changed child are returned
+          in \c *fp and \c lpF. \c *fp is either a \c featurePassed
+          of the tree or one of \c buffer.
+       */
+      double costWithout (TmNode* lca, int sideOfLca, TmNode* subtree, const TmExtendedFeatureList*& fp, int& lpF);
 
-      If \c bestMove.subtree is a leaf the routine also considers
-      moving the leaf and joining it with another leaf as a single
-      step. However it returns this move only as optimal if the
-      resulting cost is below \c joinOnlyBelow. The reason for this
-      behavior is that joining cannot be undoed, so we accept it in
-      the KL optimization only if it actually leads to an improved
-      cost function.
+      //! Same as \c TmNode::mergeFeatureLists for children \c a and \c b
+      /*! The \c featurePassed list of the parent with linearization
+          point feature \c lpF is returned in \c result, the number of
+          features involved (defining \c TmNode::updateCost) is
+          returned.
+      */
+      int merge (const TmExtendedFeatureList& a, const TmExtendedFeatureList& b, int lpF, TmExtendedFeatureList& result);
 
-      If \c mayStayHere==false, the option to leave \c bestMove.subtree
-      where it is is forbidden.
+      //! Number of different features in \c a and \c b 
+      static int sizeOfUnion (const TmExtendedFeatureList& a, const TmExtendedFeatureList& b);
 
-      The routine considers only nodes for \c bestMove.above that
-      share a landmark with \c bestMove.subtree. It further terminates
-      the search if the cost is \c >=bound. 
+      //! Same as \c costOfJoining for the parent of leaves \c a and \c b
+      /*! \c lpF is the linearization point feature of that parent. */
+      double costOfJoining (const TmNode* a, const TmNode* b, int lpF);
 
-      For two optimal solutions \c bestAbove1, \c bestAbove2 the
-      routine chooses that one that leads to the smallest \c
-      worstCaseUpdateCost for the lca of \c bestAbove1 and \c
-      bestAbove2. This happens quite frequently if \c bestMove.subtree is not
-      on the worst case path after insertion.
+      //! \c TmNode::linearizationPointFeature of a node with children having \c lpF0 and \c lpF1 
+      static int linearizationPointFeature (int lpF0, int lpF1) 
+      {
+        if (lpF0>=0 && lpF1>=0) return lpF0;
+        else return -1;
+      }      
 
-      The routine does not modify \c bestMove.subtree and \c bestMove.oldAbove.
-   */
-  void recursiveOptimalDescend (double bound, double joinOnlyBelow, Move& bestMove, bool mayStayHere=true);
+      //! Workspace for \c featurePassed lists of virtual nodes
+      TmExtendedFeatureList buffer[2];      
+    };  
+
+  //! Task for \c threadPool evaluating part of \c klCandidate
+  class KLCandidateTask;  
 
   //! This class contains the state of the KL based HTP optimizer
   /*! The general strategy with KL is to greedily move the subtree that
@@ -879,14 +1331,17 @@ class TmTreemap
       //! The tree on which to operate
       TmTreemap* tree;
 
-      //! FIFO queue of node indices that will be processed by the HTP subalgorithm
+      //! Priority queue of node indices that will be processed by the HTP subalgorithm
       /*! Contains all nodes that do not have \c IS_OPTIMIZED
-        set. Whenever a nodes \c IS_OPTIMIZED flag is reset, the node is
-        pushed to the back of the queue. \c optimize() takes nodes from
-        the front. The queue may contain nodes that have already been optimized
-        and it may contain nodes twice. These are ignored by \c optimize. 
+        set, each once, with \c priority() as priority. Whenever a
+        nodes \c IS_OPTIMIZED flag is reset, the node is pushed to the
+        queue. \c oneKLRun() takes the node with the largest priority
+        and among equal priorities the one pushed first. So without \c
+        prioritizeCriticalPath the queue is FIFO. The queue may
+        contain indices of nodes that have been removed. These are
+        ignored.
       */
-      deque<int> optimizationQueue;
+      TmOptimizationQueue optimizationQueue;
       
       
       //! Index of the node, the worstCaseUpdateCost of which is optimized.
@@ -930,6 +1385,24 @@ class TmTreemap
       */
       string report;      
 
+      //! Whether \c oneKLRun may join leaves
+      /*! Joining changes the Gaussians and cannot be undone. It is
+          disabled when optimizing a structural copy of the tree (\c
+          TmBackgroundOptimizer).
+      */
+      bool mayJoin;      
+
+      //! If not \c NULL, every move made permanent by \c oneKLRun is appended here
+      XycVector<MoveIndices>* moveLog;      
+
+      //! Whether \c optimizationQueue is ordered by \c priority()
+      /*! If \c false (default), nodes are optimized in the order
+          they have been pushed. This has been the better choice on the
+          simulated datasets, since nodes below a change are usually
+          optimized first then.
+      */
+      bool prioritizeCriticalPath;      
+
       //! Initialize
       void create (TmTreemap* treem, int nrOfMovesPerStep, int maxNrOfUnsuccessfulMoves);
       
@@ -943,20 +1416,36 @@ class TmTreemap
       //! Returns \c report and clears it.
       string getAndClearReport ();      
 
+      //! Priority of \c n in \c optimizationQueue
+      /*! \c 0 if \c prioritizeCriticalPath is \c false. Otherwise
+          an estimate of the expected gain per cost of optimizing \c
+          n. The gain is the update cost of the most expensive path
+          from the root to a leaf through \c n relative to \c
+          root->worstCaseUpdateCost. It is \c 1 for the nodes on the
+          critical path, that bound the cost of an update. The cost is
+          \c n->worstCaseUpdateCost, since a KL run on a larger
+          subtree considers more moves. The priority is computed from
+          the values stored in the nodes, even if they are not valid.
+      */
+      double priority (const TmNode* n) const;      
+
       //! Memory consumption in bytes
       int memory () const;      
 
     protected:
       //! Fetches the next node that should be optimized from \c optimizationQueue
-      /*! Reads and removes nodes from \c optimizationQueue that have \c
+      /*! If \c lcaIndex is valid, returns that node. Otherwise
+        reads and removes nodes from \c optimizationQueue that have \c
         IS_OPTIMIZED flag set or that have invalid indices (may happen
-        when a node is removed).  Then returns the first valid node but
-        does NOT remove it from \c optimizationQueue. Sets \c lcaIndex
-        and \c initialCost.
-
-        During optimization the node to be optimized is still \c
-        optimizationQueue.front(). It is only removed after the
-        optimization is finished. See \c lcaIndex.
+        when a node is removed). The priority of the front node may be
+        outdated. So it is recomputed and if it decreased, the node is
+        pushed again with the new priority. Then returns the first valid
+        node but does NOT remove it from \c optimizationQueue. Sets \c
+        lcaIndex and \c initialCost.
+
+        During optimization the node to be optimized is still in \c
+        optimizationQueue. It is only removed after the optimization
+        is finished. See \c lcaIndex.
       */
       TmNode* nextNodeToBeOptimized ();
     };
@@ -991,6 +1480,86 @@ class TmTreemap
       calls so we save the allocation and deallocation.
   */
   XycVector<float> workspaceFloat;  
+
+  //! Pool of threads for parallel computation or \c NULL if only one thread is used
+  TmThreadPool* threadPool;  
+
+  //! Optimizer thread used by \c optimizeFullRuns or \c NULL (the default)
+  TmBackgroundOptimizer* backgroundOptimizer;  
+
+  //! Pool for the nodes and the Gaussians' buffers of this tree
+  /*! Nodes added to the tree or relocated by \c compactNodes are
+      allocated by \c new \c (allocator), copies made by \c
+      TmNode::duplicate are on the heap. Not copied by \c
+      operator=. */
+  TmAllocator allocator;  
+
+  //! KL runs of \c optimizeFullRuns, but only those predicted to finish before \c deadline
+  /*! Returns the number of runs performed. */
+  int optimizeRunsUntil (double deadline);  
+
+  //! Updates the Gaussians below \c n, as far as predicted to finish before \c deadline
+  /*! If the whole subtree does not fit, the children's subtrees
+      are tried, so the update makes progress in every step. Returns
+      whether the Gaussian of \c n is valid. */
+  bool recursiveUpdateGaussiansUntil (TmNode* n, double deadline);
+
+  //! Sum of \c updateCost of all nodes below \c n with invalid Gaussian
+  /*! Unlike \c updateGaussiansCost this is the cost of the actual
+      update. \c IS_FEATURE_PASSED_VALID must hold. */
+  double recursiveInvalidGaussiansCost (const TmNode* n) const;  
+
+  //! Measured seconds per unit of \c updateGaussiansCost() for \c runStep
+  /*! Starts with \c 1, since the cost is calibrated in seconds. Like
+      \c klRunTime a maximum that decays with every measurement. */
+  double gaussianTimePerCost;
+
+  //! Predicted seconds of \c computeLinearEstimate in \c runStep
+  /*! Like \c klRunTime a maximum that decays with every run. */
+  double estimateTime;  
+
+  //! Predicted seconds of a KL run for \c runStep
+  /*! The time of the last runs as a maximum that decays with every
+      run, because the time of different runs varies a lot. */
+  double klRunTime;  
+
+  //! Workspace for threads \c 1..nrOfThreads()-1 (same as \c workspace for thread 0)
+  XycVector<XymVector> threadWorkspace;  
+
+  //! Returns the workspace for thread \c thread
+  /*! Thread 0 is the calling thread which uses \c workspace. */
+  XymVector& workspaceOfThread (int thread) 
+    {
+      if (thread==0) return workspace;
+      else return threadWorkspace[thread];      
+    }  
+
+  //! Float workspace for threads \c 1..nrOfThreads()-1 (same as \c workspaceFloat for thread 0)
+  XycVector<XycVector<float> > threadWorkspaceFloat;  
+
+  //! Returns the float workspace for thread \c thread
+  XycVector<float>& workspaceFloatOfThread (int thread) 
+    {
+      if (thread==0) return workspaceFloat;
+      else return threadWorkspaceFloat[thread];      
+    }  
+
+  //! Evaluator for every thread used by \c optimalKLStep
+  XycVector<MoveEvaluator> moveEvaluator;  
+
+  //! Nodes \c optimalKLStep considers to move with the best move found for each
+  XycVector<Move> klCandidate;  
+
+  //! Formal cost of evaluating \c klCandidate[i] (see \c MoveEvaluator::cost)
+  XycVector<double> klCandidateCost;  
+
+  //! Depth up to which \c TmNode::estimateUsingRCompressed spawns tasks
+  /*! The work per node is small, so instead of a cost threshold
+      subtrees are spawned in the top levels of the tree only, giving
+      about 8 tasks per thread. The tree is balanced by the optimizer
+      and work stealing evens out the rest. 0 without thread pool.
+   */
+  int parallelEstimationDepth () const;  
   
  protected:
 
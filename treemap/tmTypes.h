@@ -53,6 +53,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vectormath/vectormath.h>
 
 #include <xycontainer/xycVector.h>
+#include <xycontainer/xycSmallVector.h>
 #include <math.h>
 #include <stdlib.h>
 
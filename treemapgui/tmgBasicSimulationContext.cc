@@ -101,6 +101,7 @@ void TmgBasicSimulationContext::StatisticEntry::fromTreemap (TmTreemap& tm)
   report            = tm.getAndClearReport ();  
   nrOfNodes         = stat2.nrOfNodes;
   nrOfToBeOptimized = stat2.nrOfNodesToBeOptimized;  
+  nrOfGaussianAllocations = stat2.nrOfGaussianAllocations;  
   mem               = 0; // to expensive  
 }
 
@@ -122,6 +123,7 @@ void TmgBasicSimulationContext::StatisticEntry::min (const StatisticEntry& s2)
   if (s2.nrOfToBeOptimized   < nrOfToBeOptimized  ) nrOfToBeOptimized   = s2.nrOfToBeOptimized;
   if (s2.nrOfGaussianUpdates < nrOfGaussianUpdates) nrOfGaussianUpdates = s2.nrOfGaussianUpdates;  
   if (s2.mem                 < mem                ) mem                 = s2.mem;  
+  if (s2.nrOfGaussianAllocations < nrOfGaussianAllocations) nrOfGaussianAllocations = s2.nrOfGaussianAllocations;  
 }
 
 
@@ -142,6 +144,7 @@ void TmgBasicSimulationContext::StatisticEntry::max (const StatisticEntry& s2)
   if (s2.nrOfToBeOptimized   > nrOfToBeOptimized  ) nrOfToBeOptimized   = s2.nrOfToBeOptimized;  
   if (s2.nrOfGaussianUpdates > nrOfGaussianUpdates) nrOfGaussianUpdates = s2.nrOfGaussianUpdates;  
   if (s2.mem                 > mem                ) mem                 = s2.mem;  
+  if (s2.nrOfGaussianAllocations > nrOfGaussianAllocations) nrOfGaussianAllocations = s2.nrOfGaussianAllocations;  
 }
 
 
@@ -158,14 +161,14 @@ void TmgBasicSimulationContext::replaceSuffix (char* result, char* filename, cha
 void TmgBasicSimulationContext::printStatComment (FILE* f)
 {
   fprintf (f, "#$1ct    $2n      $3m      $4p   $5pMag $6pSpars $7-wcCost $8+wcCost  $9-tBook  $10+tBook "\
-           "$11-tEst  $12+tEst $13+tFEst     $14-t     $15+t $16nod. $17ntO$18nGupd  $19mem      \n");  
+           "$11-tEst  $12+tEst $13+tFEst     $14-t     $15+t $16nod. $17ntO$18nGupd  $19mem       $20nGall\n");  
 }
 
 
 void TmgBasicSimulationContext::printStat (FILE* f, const StatisticEntry& minStat, const StatisticEntry& maxStat)
 {
-  //           $1  $2  $3  $4  $5  $6   $7    $8    $9    $10   $11   $12   $13   $14  $15   $16 $17 $18 $19
-  fprintf (f, "%4d %8d %8d %8d %8d %8d %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %6d %4d %4d %12d\n",
+  //           $1  $2  $3  $4  $5  $6   $7    $8    $9    $10   $11   $12   $13   $14  $15   $16 $17 $18 $19  $20
+  fprintf (f, "%4d %8d %8d %8d %8d %8d %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %9.6f %6d %4d %4d %12d %6ld\n",
            maxStat.snapshotCtr, /* $1 */
            maxStat.n /*$2*/, maxStat.m /*$3*/, maxStat.p /*$4*/, maxStat.pMarginalized /*$5*/, maxStat.pSparsified /*$6*/,
            minStat.worstCaseUpdateCost /*$7*/, maxStat.worstCaseUpdateCost /*$8*/,
@@ -174,6 +177,7 @@ void TmgBasicSimulationContext::printStat (FILE* f, const StatisticEntry& minSta
            maxStat.timeFullEstimation /*$13*/, 
            minStat.timeTotal /*$14*/, maxStat.timeTotal /*$15*/,
            maxStat.nrOfNodes /*$16*/, maxStat.nrOfToBeOptimized /*$17*/, maxStat.nrOfGaussianUpdates /*$18*/,
-           maxStat.mem /*$19*/
+           maxStat.mem /*$19*/,
+           maxStat.nrOfGaussianAllocations-minStat.nrOfGaussianAllocations /*$20*/
            );  
 }
@@ -72,6 +72,11 @@ class TmgBasicSimulationContext
       int nrOfGaussianUpdates;      
       //! Memory consumption in bytes
       int mem;      
+      //! Heap allocations of the Gaussian updates since the start (\c TreemapStatistics::nrOfGaussianAllocations)
+      /*! \c printStat prints the difference between maximum and
+          minimum, i.e. the allocations during the period, which
+          should be 0 in steady state. */
+      long int nrOfGaussianAllocations;      
 
       string report;
       
@@ -79,7 +84,7 @@ class TmgBasicSimulationContext
         :SlamStatistic(), worstCaseUpdateCost(0),
         timeBookkeeping(0), timeEstimation(0), timeFullEstimation(0), timeTotal(0),
         snapshotCtr (0), nrOfNodes (0), nrOfToBeOptimized (0), nrOfGaussianUpdates (0),
-        mem (0)
+        mem (0), nrOfGaussianAllocations (0)
         {}      
 
       void fromTreemap (TmTreemap& tm);      